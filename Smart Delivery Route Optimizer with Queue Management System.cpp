@@ -23,37 +23,653 @@
 #include <iomanip>
 #include <ctime>
 #include <sstream>
+#include <unordered_map>
+#include <limits>
+#include <functional>
+#include <thread>
+#include <fstream>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <string_view>
+#include <charconv>
+#include <cstdio>
+#include <random>
+#include <cmath>
+#include <mutex>
+#include <memory>
+#include <deque>
+#include <new>
+#include <map>
+#include <tuple>
+#include <type_traits>
+#include <cstdint>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
 
 using namespace std;
 
+// Build with -DSDRO_METRICS=0 to compile every instrumentation point out
+#ifndef SDRO_METRICS
+#define SDRO_METRICS 1
+#endif
+
+// ==================== HOT-PATH METRICS ====================
+
+enum MetricHistogram {
+    HIST_DISPATCH_NEXT,          // ns per dispatchNextDelivery
+    HIST_DISPATCH_ORDER,         // ns per order on a concurrent dispatch worker
+    HIST_FIND_SHORTEST_PATH,     // ns per SparseMatrix::findShortestPath
+    HIST_COURIER_LOOKUP,         // ns per getAvailableCourierForZone, 1 in 64 calls timed
+    HIST_CALENDAR_SLOT_SCAN,     // appointments scanned to pick from a calendar slot
+    HIST_LINKED_LIST_SCAN,       // nodes walked per AppointmentLinkedList insert
+    HIST_ASSIGNMENT_SOLVE,       // ns per AssignmentSolver::solve
+    METRIC_HISTOGRAM_COUNT
+};
+
+enum MetricCounter {
+    COUNTER_DIJKSTRA_RUNS,
+    COUNTER_DIJKSTRA_SETTLED,
+    COUNTER_DIJKSTRA_HEAP_PUSHES,
+    COUNTER_DIJKSTRA_HEAP_POPS,
+    COUNTER_ASTAR_RUNS,            // A* and ALT point-to-point searches
+    COUNTER_ASTAR_SETTLED,
+    COUNTER_BIDIRECTIONAL_RUNS,    // bidirectional Dijkstra searches
+    COUNTER_BIDIRECTIONAL_SETTLED, // nodes settled by both frontiers together
+    COUNTER_CH_QUERIES,
+    COUNTER_CH_SETTLED,
+    COUNTER_TREE_CACHE_HITS,
+    COUNTER_TREE_CACHE_MISSES,
+    COUNTER_TREE_REPAIRS,          // cached trees repaired after edge updates
+    COUNTER_TREE_REPAIR_SETTLED,   // nodes settled while repairing them
+    COUNTER_ROUTE_CACHE_HITS,
+    COUNTER_ROUTE_CACHE_MISSES,    // including entries left from an older graph version
+    COUNTER_ROUTE_CACHE_EVICTIONS,
+    COUNTER_COURIER_ZONE_HITS,     // courier found in the appointment's zone
+    COUNTER_COURIER_FALLBACKS,     // courier taken from another zone
+    COUNTER_COURIER_MISSES,        // no courier available at all
+    COUNTER_ASSIGNMENT_HUNGARIAN,  // batch assignments solved by the Hungarian method
+    COUNTER_ASSIGNMENT_AUCTIONS,   // batch assignments solved by auction
+    COUNTER_ASSIGNMENT_AUCTION_BIDS,
+    METRIC_COUNTER_COUNT
+};
+
+static const char* const HISTOGRAM_NAMES[METRIC_HISTOGRAM_COUNT] = {
+    "dispatchNextDelivery.ns", "dispatchOrder.ns", "findShortestPath.ns", "courierLookup.ns",
+    "calendarSlotScan.length", "linkedListScan.length", "assignmentSolve.ns"
+};
+
+static const char* const COUNTER_NAMES[METRIC_COUNTER_COUNT] = {
+    "dijkstra.runs", "dijkstra.settled", "dijkstra.heapPushes", "dijkstra.heapPops",
+    "astar.runs", "astar.settled", "bidirectional.runs", "bidirectional.settled",
+    "contractionHierarchy.queries", "contractionHierarchy.settled",
+    "treeCache.hits", "treeCache.misses", "treeCache.repairs", "treeCache.repairSettled",
+    "routeCache.hits", "routeCache.misses", "routeCache.evictions",
+    "courier.zoneHits", "courier.fallbacks", "courier.misses",
+    "assignment.hungarian", "assignment.auctions", "assignment.auctionBids"
+};
+
+// Log-linear buckets in the style of HDR histograms: each power of two is split into
+// 16 sub-buckets, so any recorded value is reported within about 6%.
+struct LatencyHistogram {
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_COUNT = 1 << SUB_BITS;
+    static constexpr int BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_COUNT;
+    
+    static int bucketOf(uint64_t value) {
+        if (value < (uint64_t)SUB_COUNT) return (int)value;
+        int magnitude = 63 - __builtin_clzll(value) - SUB_BITS + 1;
+        return magnitude * SUB_COUNT + (int)((value >> (magnitude - 1)) - SUB_COUNT);
+    }
+    
+    // Smallest value that falls into `bucket`
+    static uint64_t lowerBound(int bucket) {
+        if (bucket < SUB_COUNT) return (uint64_t)bucket;
+        int magnitude = bucket / SUB_COUNT;
+        return (uint64_t)(SUB_COUNT + bucket % SUB_COUNT) << (magnitude - 1);
+    }
+    
+    // Largest value that falls into `bucket`
+    static uint64_t upperBound(int bucket) {
+        if (bucket < SUB_COUNT) return (uint64_t)bucket;
+        return lowerBound(bucket) + ((uint64_t)1 << (bucket / SUB_COUNT - 1)) - 1;
+    }
+};
+
+// One thread's metrics. Only the owning thread writes, so updates are relaxed
+// load/store pairs rather than locked read-modify-writes; a reader may see a
+// slightly stale total but never a torn one.
+struct ThreadMetrics {
+    atomic<uint64_t> counters[METRIC_COUNTER_COUNT];
+    atomic<uint64_t> buckets[METRIC_HISTOGRAM_COUNT][LatencyHistogram::BUCKET_COUNT];
+    atomic<uint64_t> sums[METRIC_HISTOGRAM_COUNT];
+    atomic<uint64_t> maxima[METRIC_HISTOGRAM_COUNT];
+    uint32_t sampleTicks[METRIC_HISTOGRAM_COUNT];   // owner-only, drives sampled timers
+    
+    ThreadMetrics() {
+        memset(sampleTicks, 0, sizeof(sampleTicks));
+        reset();
+    }
+    
+    static void bump(atomic<uint64_t>& cell, uint64_t amount) {
+        cell.store(cell.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+    
+    void add(MetricCounter counter, uint64_t amount) { bump(counters[counter], amount); }
+    
+    // `weight` > 1 stands in for the unsampled calls of a sampled timer
+    void record(MetricHistogram histogram, uint64_t value, uint64_t weight = 1) {
+        bump(buckets[histogram][LatencyHistogram::bucketOf(value)], weight);
+        bump(sums[histogram], value * weight);
+        if (value > maxima[histogram].load(memory_order_relaxed)) {
+            maxima[histogram].store(value, memory_order_relaxed);
+        }
+    }
+    
+    void reset() {
+        for (auto& counter : counters) counter.store(0, memory_order_relaxed);
+        for (auto& histogram : buckets) {
+            for (auto& bucket : histogram) bucket.store(0, memory_order_relaxed);
+        }
+        for (auto& sum : sums) sum.store(0, memory_order_relaxed);
+        for (auto& maximum : maxima) maximum.store(0, memory_order_relaxed);
+    }
+};
+
+// Every thread's metrics block. When a thread exits its totals are folded into
+// `retired` and the block is handed to the next thread that starts, so there are never
+// more blocks than threads alive at once.
+class MetricsRegistry {
+private:
+    mutex lock;
+    vector<unique_ptr<ThreadMetrics>> threads;
+    vector<ThreadMetrics*> freeBlocks;   // zeroed, owned by no thread
+    ThreadMetrics retired;
+    
+public:
+    static MetricsRegistry& instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+    
+    ThreadMetrics* attach() {
+        lock_guard<mutex> guard(lock);
+        if (!freeBlocks.empty()) {
+            ThreadMetrics* block = freeBlocks.back();
+            freeBlocks.pop_back();
+            return block;
+        }
+        threads.emplace_back(new ThreadMetrics());
+        return threads.back().get();
+    }
+    
+    // Called by the owning thread as it exits
+    void detach(ThreadMetrics* block) {
+        lock_guard<mutex> guard(lock);
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+            ThreadMetrics::bump(retired.counters[c], block->counters[c].load(memory_order_relaxed));
+        }
+        for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+            for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; b++) {
+                ThreadMetrics::bump(retired.buckets[h][b], block->buckets[h][b].load(memory_order_relaxed));
+            }
+            ThreadMetrics::bump(retired.sums[h], block->sums[h].load(memory_order_relaxed));
+            uint64_t maximum = block->maxima[h].load(memory_order_relaxed);
+            if (maximum > retired.maxima[h].load(memory_order_relaxed)) {
+                retired.maxima[h].store(maximum, memory_order_relaxed);
+            }
+        }
+        block->reset();
+        freeBlocks.push_back(block);
+    }
+    
+    // Sum of all threads
+    void collect(vector<uint64_t>& counters, vector<vector<uint64_t>>& buckets,
+                 vector<uint64_t>& sums, vector<uint64_t>& maxima) {
+        lock_guard<mutex> guard(lock);
+        counters.assign(METRIC_COUNTER_COUNT, 0);
+        buckets.assign(METRIC_HISTOGRAM_COUNT, vector<uint64_t>(LatencyHistogram::BUCKET_COUNT, 0));
+        sums.assign(METRIC_HISTOGRAM_COUNT, 0);
+        maxima.assign(METRIC_HISTOGRAM_COUNT, 0);
+        auto add = [&](const ThreadMetrics* thread) {
+            for (int c = 0; c < METRIC_COUNTER_COUNT; c++) counters[c] += thread->counters[c].load(memory_order_relaxed);
+            for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+                for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; b++) {
+                    buckets[h][b] += thread->buckets[h][b].load(memory_order_relaxed);
+                }
+                sums[h] += thread->sums[h].load(memory_order_relaxed);
+                maxima[h] = max(maxima[h], thread->maxima[h].load(memory_order_relaxed));
+            }
+        };
+        for (const auto& thread : threads) add(thread.get());
+        add(&retired);
+    }
+    
+    void reset() {
+        lock_guard<mutex> guard(lock);
+        for (const auto& thread : threads) thread->reset();
+        retired.reset();
+    }
+};
+
+// A thread's claim on a metrics block, returned to the registry when the thread exits
+struct ThreadMetricsLease {
+    ThreadMetrics* block;
+    
+    ThreadMetricsLease() : block(MetricsRegistry::instance().attach()) {}
+    ~ThreadMetricsLease() { MetricsRegistry::instance().detach(block); }
+};
+
+inline ThreadMetrics& threadMetrics() {
+    thread_local ThreadMetricsLease lease;
+    return *lease.block;
+}
+
+// Records the lifetime of a scope, in nanoseconds, into a histogram. A clock read
+// costs tens of nanoseconds, so very short operations time one call in samplePeriod
+// (a power of two) and weight it to stand for the others.
+class ScopedTimer {
+private:
+    MetricHistogram histogram;
+    uint32_t weight;   // 0 when this call is not sampled
+    chrono::steady_clock::time_point start;
+    
+public:
+    explicit ScopedTimer(MetricHistogram target, uint32_t samplePeriod = 1) : histogram(target), weight(0) {
+        if ((++threadMetrics().sampleTicks[target] & (samplePeriod - 1)) != 0) return;
+        weight = samplePeriod;
+        start = chrono::steady_clock::now();
+    }
+    
+    ~ScopedTimer() {
+        if (weight == 0) return;
+        threadMetrics().record(histogram, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - start).count(), weight);
+    }
+};
+
+#if SDRO_METRICS
+#define METRIC_CONCAT_INNER(a, b) a##b
+#define METRIC_CONCAT(a, b) METRIC_CONCAT_INNER(a, b)
+#define METRIC_TIMER(histogram) ScopedTimer METRIC_CONCAT(metricTimer, __LINE__)(histogram)
+#define METRIC_SAMPLED_TIMER(histogram, period) ScopedTimer METRIC_CONCAT(metricTimer, __LINE__)(histogram, period)
+#define METRIC_COUNT(counter, amount) threadMetrics().add(counter, amount)
+#define METRIC_RECORD(histogram, value) threadMetrics().record(histogram, value)
+#else
+#define METRIC_TIMER(histogram) ((void)0)
+#define METRIC_SAMPLED_TIMER(histogram, period) ((void)0)
+#define METRIC_COUNT(counter, amount) ((void)0)
+#define METRIC_RECORD(histogram, value) ((void)0)
+#endif
+
+// Aggregated view of every thread's metrics, printable as text or JSON
+class MetricsReport {
+private:
+    vector<uint64_t> counters;
+    vector<vector<uint64_t>> buckets;
+    vector<uint64_t> sums;
+    vector<uint64_t> maxima;
+    
+    uint64_t countOf(int histogram) const {
+        uint64_t total = 0;
+        for (uint64_t bucket : buckets[histogram]) total += bucket;
+        return total;
+    }
+    
+    // Upper edge of the bucket holding the q-th quantile, capped at the true maximum
+    uint64_t quantile(int histogram, double q) const {
+        uint64_t total = countOf(histogram);
+        if (total == 0) return 0;
+        uint64_t rank = max<uint64_t>(1, (uint64_t)ceil(q * total));
+        uint64_t seen = 0;
+        for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; b++) {
+            seen += buckets[histogram][b];
+            if (seen >= rank) return min(LatencyHistogram::upperBound(b), maxima[histogram]);
+        }
+        return maxima[histogram];
+    }
+    
+public:
+    MetricsReport() { MetricsRegistry::instance().collect(counters, buckets, sums, maxima); }
+    
+    void writeText(ostream& out) const {
+#if !SDRO_METRICS
+        out << "Metrics were compiled out (SDRO_METRICS=0).\n";
+#else
+        out << "\n========== PERFORMANCE METRICS ==========\n";
+        out << left << setw(28) << "Histogram" << right << setw(10) << "count" << setw(12) << "mean"
+            << setw(10) << "p50" << setw(10) << "p99" << setw(10) << "p999" << setw(12) << "max" << "\n";
+        out << string(92, '-') << "\n";
+        for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+            uint64_t total = countOf(h);
+            out << left << setw(28) << HISTOGRAM_NAMES[h] << right << setw(10) << total
+                << setw(12) << fixed << setprecision(1) << (total ? (double)sums[h] / total : 0.0)
+                << setw(10) << quantile(h, 0.5) << setw(10) << quantile(h, 0.99)
+                << setw(10) << quantile(h, 0.999) << setw(12) << maxima[h] << "\n";
+        }
+        out << "\n" << left << setw(32) << "Counter" << right << setw(14) << "total" << "\n";
+        out << string(46, '-') << "\n";
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+            out << left << setw(32) << COUNTER_NAMES[c] << right << setw(14) << counters[c] << "\n";
+        }
+        out << left;
+#endif
+    }
+    
+    void writeJSON(ostream& out) const {
+        out << "{\n  \"enabled\": " << (SDRO_METRICS ? "true" : "false") << ",\n  \"histograms\": {";
+        for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+            uint64_t total = countOf(h);
+            out << (h ? "," : "") << "\n    \"" << HISTOGRAM_NAMES[h] << "\": {\"count\": " << total
+                << ", \"mean\": " << fixed << setprecision(1) << (total ? (double)sums[h] / total : 0.0)
+                << ", \"p50\": " << quantile(h, 0.5) << ", \"p99\": " << quantile(h, 0.99)
+                << ", \"p999\": " << quantile(h, 0.999) << ", \"max\": " << maxima[h] << "}";
+        }
+        out << "\n  },\n  \"counters\": {";
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+            out << (c ? "," : "") << "\n    \"" << COUNTER_NAMES[c] << "\": " << counters[c];
+        }
+        out << "\n  }\n}\n";
+    }
+};
+
+// ==================== MEMORY POOLS AND STRING INTERNING ====================
+
+// Objects are carved out of fixed-size chunks and freed slots go on a free list,
+// so steady churn of records reuses memory instead of hitting the allocator.
+// The owner must destroy() every live object before the pool goes away.
+template <typename T>
+class ObjectPool {
+private:
+    union Slot {
+        Slot* nextFree;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+    
+    static constexpr size_t CHUNK_SIZE = 1024;
+    vector<unique_ptr<Slot[]>> chunks;
+    Slot* freeList;
+    size_t usedInChunk;
+    size_t live;
+    
+public:
+    ObjectPool() : freeList(nullptr), usedInChunk(CHUNK_SIZE), live(0) {}
+    
+    template <typename... Args>
+    T* create(Args&&... args) {
+        Slot* slot;
+        if (freeList) {
+            slot = freeList;
+            freeList = slot->nextFree;
+        } else {
+            if (usedInChunk == CHUNK_SIZE) {
+                chunks.emplace_back(new Slot[CHUNK_SIZE]);
+                usedInChunk = 0;
+            }
+            slot = &chunks.back()[usedInChunk++];
+        }
+        live++;
+        return new (slot->storage) T(std::forward<Args>(args)...);
+    }
+    
+    void destroy(T* object) {
+        object->~T();
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        slot->nextFree = freeList;
+        freeList = slot;
+        live--;
+    }
+    
+    size_t liveCount() const { return live; }
+    
+    size_t bytesReserved() const { return chunks.size() * CHUNK_SIZE * sizeof(Slot); }
+};
+
+// Bump allocator for text. Strings are copied once into large blocks and handed
+// out as string_views; the blocks are only released with the arena itself. An owner
+// that drops strings reports them with release() and copies the survivors into a
+// fresh arena once most of the text is dead.
+class StringArena {
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    vector<unique_ptr<char[]>> blocks;
+    size_t used;
+    size_t blockCapacity;
+    size_t reserved;
+    size_t stored;      // bytes handed out
+    size_t released;    // bytes of those no longer referenced
+    
+public:
+    StringArena() : used(0), blockCapacity(0), reserved(0), stored(0), released(0) {}
+    
+    string_view store(string_view text) {
+        if (text.empty()) return string_view();
+        if (used + text.size() > blockCapacity) {
+            blockCapacity = max(BLOCK_SIZE, text.size());
+            blocks.emplace_back(new char[blockCapacity]);
+            reserved += blockCapacity;
+            used = 0;
+        }
+        char* destination = blocks.back().get() + used;
+        memcpy(destination, text.data(), text.size());
+        used += text.size();
+        stored += text.size();
+        return string_view(destination, text.size());
+    }
+    
+    void release(string_view text) { released += text.size(); }
+    
+    // Worth copying the live text out: it has at least one full block of dead text,
+    // and more dead text than live
+    bool mostlyReleased() const { return released >= BLOCK_SIZE && released * 2 > stored; }
+    
+    size_t bytesReserved() const { return reserved; }
+};
+
+// Maps names such as "Zone-A" to small dense integer IDs, so hot paths compare
+// and index by integer. Interned text lives for the whole run.
+class StringInterner {
+private:
+    StringArena arena;
+    unordered_map<string_view, int> ids;
+    vector<string_view> names;
+    mutable mutex lock;
+    
+public:
+    int intern(string_view text) {
+        lock_guard<mutex> guard(lock);
+        auto it = ids.find(text);
+        if (it != ids.end()) return it->second;
+        string_view stored = arena.store(text);
+        int id = (int)names.size();
+        names.push_back(stored);
+        ids.emplace(stored, id);
+        return id;
+    }
+    
+    // ID of an already interned name, -1 if it was never seen
+    int find(string_view text) const {
+        lock_guard<mutex> guard(lock);
+        auto it = ids.find(text);
+        return it == ids.end() ? -1 : it->second;
+    }
+    
+    string_view name(int id) const {
+        lock_guard<mutex> guard(lock);
+        return id >= 0 && id < (int)names.size() ? names[id] : string_view();
+    }
+    
+    int size() const {
+        lock_guard<mutex> guard(lock);
+        return (int)names.size();
+    }
+};
+
+// Process-wide table for zone and location names
+StringInterner& nameTable() {
+    static StringInterner table;
+    return table;
+}
+
+// ==================== DELIVERY TIME WINDOWS ====================
+
+const long long MINUTES_PER_DAY = 24 * 60;
+
+// Wall-clock minutes since 1970-01-01 00:00, no time zone applied. Delivery times
+// are parsed once into a window; ordering and the calendar queue use the integers.
+struct TimeWindow {
+    long long earliest;
+    long long latest;   // deadline
+    
+    TimeWindow() : earliest(0), latest(0) {}
+};
+
+// Days since 1970-01-01 for a Gregorian date
+long long daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    int yearOfEra = (int)(year - era * 400);
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// Day that bare "HH:MM" times belong to; today's local date unless set explicitly
+long long& serviceDay() {
+    static long long day = [] {
+        time_t now = time(nullptr);
+        tm local = *localtime(&now);
+        return daysFromCivil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+    }();
+    return day;
+}
+
+long long currentMinute() {
+    time_t now = time(nullptr);
+    tm local = *localtime(&now);
+    return daysFromCivil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday) * MINUTES_PER_DAY +
+           local.tm_hour * 60 + local.tm_min;
+}
+
+static bool parseDigits(string_view text, int& value) {
+    if (text.empty()) return false;
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+// "H:MM" or "HH:MM", 00:00 to 23:59
+static bool parseClock(string_view text, int& minuteOfDay) {
+    size_t colon = text.find(':');
+    int hours, minutes;
+    if (colon == string_view::npos || colon == 0 || colon > 2 || text.size() - colon != 3 ||
+        !parseDigits(text.substr(0, colon), hours) || !parseDigits(text.substr(colon + 1), minutes) ||
+        hours > 23 || minutes > 59) {
+        return false;
+    }
+    minuteOfDay = hours * 60 + minutes;
+    return true;
+}
+
+// "YYYY-MM-DD"
+static bool parseDate(string_view text, long long& day) {
+    static const int daysInMonth[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int year, month, dayOfMonth;
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-' ||
+        !parseDigits(text.substr(0, 4), year) || !parseDigits(text.substr(5, 2), month) ||
+        !parseDigits(text.substr(8, 2), dayOfMonth) || month < 1 || month > 12 ||
+        dayOfMonth < 1 || dayOfMonth > daysInMonth[month - 1]) {
+        return false;
+    }
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month == 2 && dayOfMonth == 29 && !leap) return false;
+    day = daysFromCivil(year, month, dayOfMonth);
+    return true;
+}
+
+// Accepts "HH:MM", "HH:MM-HH:MM" and either with a leading "YYYY-MM-DD " (or "T")
+// date; a bare date is the whole day. A window whose end is before its start runs
+// past midnight. A single time is a window of one minute.
+bool parseTimeWindow(string_view text, TimeWindow& window) {
+    while (!text.empty() && text.front() == ' ') text.remove_prefix(1);
+    while (!text.empty() && text.back() == ' ') text.remove_suffix(1);
+    
+    long long day = serviceDay();
+    if (text.size() >= 10 && text[4] == '-') {
+        if (!parseDate(text.substr(0, 10), day)) return false;
+        if (text.size() == 10) {
+            window.earliest = day * MINUTES_PER_DAY;
+            window.latest = window.earliest + MINUTES_PER_DAY - 1;
+            return true;
+        }
+        if (text[10] != ' ' && text[10] != 'T') return false;
+        text.remove_prefix(11);
+    }
+    
+    size_t dash = text.find('-');
+    int start, end;
+    if (!parseClock(text.substr(0, dash), start)) return false;
+    end = start;
+    if (dash != string_view::npos && !parseClock(text.substr(dash + 1), end)) return false;
+    
+    window.earliest = day * MINUTES_PER_DAY + start;
+    window.latest = day * MINUTES_PER_DAY + end + (end < start ? MINUTES_PER_DAY : 0);
+    return true;
+}
+
 // ==================== LINKED LIST FOR APPOINTMENT SCHEDULING ====================
 
 struct DeliveryAppointment {
     int appointmentId;
-    string customerName;
-    string address;
-    string deliveryTime;
+    string_view customerName;   // text is owned by the store's arena
+    string_view address;
+    string_view deliveryTime;
     int priority;  // 1 = highest, 5 = lowest
-    string zone;
+    int zoneId;    // interned in nameTable()
     bool completed;
     DeliveryAppointment* next;
+    int heapIndex;       // position in AppointmentStore heap, -1 when not pending
+    long long sequence;  // insertion order, keeps equal keys FIFO
+    TimeWindow window;   // parsed deliveryTime
+    int calendarSlot;    // CalendarQueue slot, -1 when not scheduled
+    int overdueIndex;    // position in the CalendarQueue overdue heap
+    DeliveryAppointment* calendarPrev;
+    DeliveryAppointment* calendarNext;
     
-    DeliveryAppointment(int id, string name, string addr, string time, int prio, string z)
+    DeliveryAppointment(int id, string_view name, string_view addr, string_view time, int prio, int zone)
         : appointmentId(id), customerName(name), address(addr), deliveryTime(time), 
-          priority(prio), zone(z), completed(false), next(nullptr) {}
+          priority(prio), zoneId(zone), completed(false), next(nullptr), heapIndex(-1), sequence(0),
+          calendarSlot(-1), overdueIndex(-1), calendarPrev(nullptr), calendarNext(nullptr) {}
+    
+    string_view zoneName() const { return nameTable().name(zoneId); }
 };
 
 class AppointmentLinkedList {
 private:
     DeliveryAppointment* head;
     int appointmentCount;
+    StringArena text;
     
 public:
     AppointmentLinkedList() : head(nullptr), appointmentCount(0) {}
     
     // Add appointment (sorted by priority and time)
-    void addAppointment(int id, string name, string addr, string time, int prio, string zone) {
-        DeliveryAppointment* newApp = new DeliveryAppointment(id, name, addr, time, prio, zone);
+    void addAppointment(int id, string_view name, string_view addr, string_view time, int prio, string_view zone) {
+        DeliveryAppointment* newApp = new DeliveryAppointment(id, text.store(name), text.store(addr),
+                                                              text.store(time), prio, nameTable().intern(zone));
         
         if (!head || head->priority > prio || 
             (head->priority == prio && head->deliveryTime > time)) {
@@ -61,11 +677,14 @@ public:
             head = newApp;
         } else {
             DeliveryAppointment* current = head;
+            uint64_t walked = 0;
             while (current->next && 
                    (current->next->priority < prio || 
                     (current->next->priority == prio && current->next->deliveryTime <= time))) {
                 current = current->next;
+                walked++;
             }
+            METRIC_RECORD(HIST_LINKED_LIST_SCAN, walked);
             newApp->next = current->next;
             current->next = newApp;
         }
@@ -145,7 +764,7 @@ public:
                  << setw(25) << current->address
                  << setw(15) << current->deliveryTime
                  << setw(10) << current->priority
-                 << setw(10) << current->zone
+                 << setw(10) << current->zoneName()
                  << setw(10) << (current->completed ? "Done" : "Pending") << "\n";
             current = current->next;
         }
@@ -163,486 +782,6678 @@ public:
     }
 };
 
-// ==================== CIRCULAR QUEUE FOR COURIER ASSIGNMENTS ====================
+// ==================== CALENDAR QUEUE FOR DUE APPOINTMENTS ====================
 
-struct Courier {
-    int courierId;
-    string name;
-    string currentZone;
-    bool available;
-    int currentLoad;
-    int maxLoad;
-    
-    // Default constructor
-    Courier() : courierId(-1), name(""), currentZone(""), available(true), currentLoad(0), maxLoad(5) {}
+// Timing wheel over appointment deadlines: one slot per minute for the day ahead of
+// the clock, each an intrusive list, plus an occupancy bitmap so empty slots are
+// skipped 64 at a time. Deadlines the clock has passed move into an overdue binary
+// heap, so bulk inserts of past deadlines stay O(1) on average; deadlines more than a
+// day out wait in an ordered overflow and join the wheel as the clock advances. Every
+// appointment in a slot shares one deadline minute.
+class CalendarQueue {
+public:
+    static constexpr int SLOT_COUNT = (int)MINUTES_PER_DAY;
     
-    Courier(int id, string n, string zone) 
-        : courierId(id), name(n), currentZone(zone), available(true), currentLoad(0), maxLoad(5) {}
-};
-
-class CircularQueue {
 private:
-    vector<Courier> couriers;
-    int front;
-    int rear;
-    int size;
-    int capacity;
+    static constexpr int WORD_COUNT = (SLOT_COUNT + 63) / 64;
+    static constexpr int OVERFLOW_SLOT = -2;
+    static constexpr int OVERDUE_SLOT = -3;
     
-public:
-    CircularQueue(int cap) : front(-1), rear(-1), size(0), capacity(cap), couriers(cap) {
+    // Deadline first, then priority, then insertion order
+    static bool moreUrgent(const DeliveryAppointment* a, const DeliveryAppointment* b) {
+        if (a->window.latest != b->window.latest) return a->window.latest < b->window.latest;
+        if (a->priority != b->priority) return a->priority < b->priority;
+        return a->sequence < b->sequence;
     }
     
-    bool isEmpty() {
-        return size == 0;
-    }
+    vector<DeliveryAppointment*> heads;
+    vector<DeliveryAppointment*> tails;
+    uint64_t occupied[WORD_COUNT];
+    long long clock;   // minute held by slot `cursor`
+    int cursor;
+    vector<DeliveryAppointment*> overdue;   // min-heap by moreUrgent
+    multimap<long long, DeliveryAppointment*> overflow;
+    int count;
     
-    bool isFull() {
-        return size == capacity;
+    void placeOverdue(size_t pos, DeliveryAppointment* app) {
+        overdue[pos] = app;
+        app->overdueIndex = (int)pos;
     }
     
-    void enqueue(int id, string name, string zone) {
-        if (isFull()) {
-            cout << "Courier queue is full!\n";
-            return;
+    void siftOverdueUp(size_t pos) {
+        DeliveryAppointment* app = overdue[pos];
+        while (pos > 0 && moreUrgent(app, overdue[(pos - 1) / 2])) {
+            placeOverdue(pos, overdue[(pos - 1) / 2]);
+            pos = (pos - 1) / 2;
         }
-        
-        if (front == -1) front = 0;
-        rear = (rear + 1) % capacity;
-        couriers[rear] = Courier(id, name, zone);
-        size++;
-        cout << "Courier " << name << " (ID: " << id << ") added to queue.\n";
+        placeOverdue(pos, app);
     }
     
-    Courier dequeue() {
-        if (isEmpty()) {
-            return Courier(-1, "", "");
+    void siftOverdueDown(size_t pos) {
+        DeliveryAppointment* app = overdue[pos];
+        while (true) {
+            size_t child = 2 * pos + 1;
+            if (child >= overdue.size()) break;
+            if (child + 1 < overdue.size() && moreUrgent(overdue[child + 1], overdue[child])) child++;
+            if (!moreUrgent(overdue[child], app)) break;
+            placeOverdue(pos, overdue[child]);
+            pos = child;
         }
-        
-        Courier courier = couriers[front];
-        if (front == rear) {
-            front = rear = -1;
+        placeOverdue(pos, app);
+    }
+    
+    void pushOverdue(DeliveryAppointment* app) {
+        app->calendarSlot = OVERDUE_SLOT;
+        overdue.push_back(app);
+        siftOverdueUp(overdue.size() - 1);
+    }
+    
+    void markSlot(int slot, bool busy) {
+        if (busy) occupied[slot / 64] |= 1ULL << (slot % 64);
+        else occupied[slot / 64] &= ~(1ULL << (slot % 64));
+    }
+    
+    void place(DeliveryAppointment* app) {
+        long long offset = app->window.latest - clock;
+        if (offset < 0) {
+            pushOverdue(app);
+        } else if (offset >= SLOT_COUNT) {
+            app->calendarSlot = OVERFLOW_SLOT;
+            overflow.emplace(app->window.latest, app);
         } else {
-            front = (front + 1) % capacity;
+            int slot = (int)((cursor + offset) % SLOT_COUNT);
+            app->calendarSlot = slot;
+            app->calendarNext = nullptr;
+            app->calendarPrev = tails[slot];
+            if (tails[slot]) tails[slot]->calendarNext = app;
+            else heads[slot] = app;
+            tails[slot] = app;
+            markSlot(slot, true);
         }
-        size--;
-        return courier;
     }
     
-    Courier peek() {
-        if (isEmpty()) {
-            return Courier(-1, "", "");
+    // Most urgent entry of a wheel slot; slots hold one deadline, so this is by priority
+    DeliveryAppointment* bestInSlot(int slot) const {
+        DeliveryAppointment* best = heads[slot];
+        uint64_t scanned = 1;
+        for (DeliveryAppointment* app = best->calendarNext; app; app = app->calendarNext) {
+            if (moreUrgent(app, best)) best = app;
+            scanned++;
         }
-        return couriers[front];
+        METRIC_RECORD(HIST_CALENDAR_SLOT_SCAN, scanned);
+        return best;
     }
     
-    // Get next available courier for a zone
-    Courier getAvailableCourierForZone(string targetZone) {
-        if (isEmpty()) return Courier(-1, "", "");
-        
-        int iterations = 0;
-        
-        // Search for courier in same zone or available
-        while (iterations < size) {
-            int index = (front + iterations) % capacity;
-            if (couriers[index].available && 
-                (couriers[index].currentZone == targetZone || couriers[index].currentLoad < couriers[index].maxLoad)) {
-                return couriers[index];
-            }
-            iterations++;
+    // First occupied slot at or after the cursor, -1 when the wheel is empty
+    int firstOccupiedSlot() const {
+        for (int step = 0; step <= WORD_COUNT; step++) {
+            int word = (cursor / 64 + step) % WORD_COUNT;
+            uint64_t bits = occupied[word];
+            if (step == 0) bits &= ~0ULL << (cursor % 64);
+            if (bits) return word * 64 + __builtin_ctzll(bits);
         }
-        
-        // If no preferred courier found, return first available courier
-        for (int i = 0; i < size; i++) {
-            int index = (front + i) % capacity;
-            if (couriers[index].available) {
-                return couriers[index];
+        return -1;
+    }
+    
+public:
+    CalendarQueue() : heads(SLOT_COUNT, nullptr), tails(SLOT_COUNT, nullptr),
+                      clock(serviceDay() * MINUTES_PER_DAY), cursor(0), count(0) {
+        memset(occupied, 0, sizeof(occupied));
+    }
+    
+    void insert(DeliveryAppointment* app) {
+        place(app);
+        count++;
+    }
+    
+    void erase(DeliveryAppointment* app) {
+        if (app->calendarSlot == OVERDUE_SLOT) {
+            size_t pos = app->overdueIndex;
+            DeliveryAppointment* last = overdue.back();
+            overdue.pop_back();
+            if (pos < overdue.size()) {
+                placeOverdue(pos, last);
+                siftOverdueUp(pos);
+                siftOverdueDown(last->overdueIndex);
+            }
+            app->overdueIndex = -1;
+        } else if (app->calendarSlot == OVERFLOW_SLOT) {
+            auto range = overflow.equal_range(app->window.latest);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second == app) {
+                    overflow.erase(it);
+                    break;
+                }
             }
+        } else if (app->calendarSlot >= 0) {
+            int slot = app->calendarSlot;
+            if (app->calendarPrev) app->calendarPrev->calendarNext = app->calendarNext;
+            else heads[slot] = app->calendarNext;
+            if (app->calendarNext) app->calendarNext->calendarPrev = app->calendarPrev;
+            else tails[slot] = app->calendarPrev;
+            if (!heads[slot]) markSlot(slot, false);
+        } else {
+            return;
         }
-        
-        // If no available courier found, return empty courier
-        return Courier(-1, "", "");
+        app->calendarSlot = -1;
+        app->calendarPrev = app->calendarNext = nullptr;
+        count--;
     }
     
-    void assignDelivery(int courierId, string zone) {
-        for (int i = 0; i < size; i++) {
-            int index = (front + i) % capacity;
-            if (couriers[index].courierId == courierId) {
-                couriers[index].available = false;
-                couriers[index].currentZone = zone;
-                couriers[index].currentLoad++;
-                break;
-            }
+    // Move the clock forward; slots it passes empty into the overdue set
+    void advanceTo(long long now) {
+        if (now <= clock) return;
+        long long steps = min(now - clock, (long long)SLOT_COUNT);
+        for (long long i = 0; i < steps; i++) {
+            for (DeliveryAppointment* app = heads[cursor]; app; app = app->calendarNext) pushOverdue(app);
+            heads[cursor] = tails[cursor] = nullptr;
+            markSlot(cursor, false);
+            cursor = (cursor + 1) % SLOT_COUNT;
+        }
+        if (now - clock > SLOT_COUNT) cursor = 0;   // the wheel is empty, any alignment will do
+        clock = now;
+        while (!overflow.empty() && overflow.begin()->first - clock < SLOT_COUNT) {
+            DeliveryAppointment* app = overflow.begin()->second;
+            overflow.erase(overflow.begin());
+            place(app);
         }
     }
     
-    void releaseCourier(int courierId) {
-        for (int i = 0; i < size; i++) {
-            int index = (front + i) % capacity;
-            if (couriers[index].courierId == courierId) {
-                couriers[index].available = true;
-                couriers[index].currentLoad--;
-                if (couriers[index].currentLoad < 0) couriers[index].currentLoad = 0;
-                break;
-            }
+    long long getClock() const { return clock; }
+    
+    int size() const { return count; }
+    
+    // Earliest deadline, ties to the higher priority
+    DeliveryAppointment* mostUrgent() const {
+        if (!overdue.empty()) return overdue[0];
+        int slot = firstOccupiedSlot();
+        if (slot != -1) return bestInSlot(slot);
+        if (overflow.empty()) return nullptr;
+        auto range = overflow.equal_range(overflow.begin()->first);
+        DeliveryAppointment* best = range.first->second;
+        for (auto it = range.first; it != range.second; ++it) {
+            if (moreUrgent(it->second, best)) best = it->second;
         }
+        return best;
     }
     
-    void displayCouriers() {
-        if (isEmpty()) {
-            cout << "No couriers in queue.\n";
-            return;
+    // Everything with a deadline before `horizon`, overdue work included, most urgent first
+    vector<DeliveryAppointment*> dueBefore(long long horizon) const {
+        vector<DeliveryAppointment*> due(overdue.begin(), overdue.end());
+        sort(due.begin(), due.end(), moreUrgent);
+        long long span = min(horizon - clock, (long long)SLOT_COUNT);
+        for (long long offset = 0; offset < span; offset++) {
+            int slot = (int)((cursor + offset) % SLOT_COUNT);
+            uint64_t rest = occupied[slot / 64] >> (slot % 64);
+            if (rest == 0) {
+                // Nothing left in this bitmap word; jump to its last slot
+                offset += min(63 - slot % 64, SLOT_COUNT - 1 - slot);
+                continue;
+            }
+            if (!(rest & 1)) continue;
+            size_t first = due.size();
+            for (DeliveryAppointment* app = heads[slot]; app; app = app->calendarNext) due.push_back(app);
+            sort(due.begin() + first, due.end(), moreUrgent);
         }
-        
-        cout << "\n========== COURIER QUEUE ==========\n";
-        cout << left << setw(10) << "ID" << setw(20) << "Name" 
-             << setw(15) << "Zone" << setw(12) << "Status" 
-             << setw(10) << "Load" << "\n";
-        cout << string(67, '-') << "\n";
-        
-        for (int i = 0; i < size; i++) {
-            int index = (front + i) % capacity;
-            cout << left << setw(10) << couriers[index].courierId
-                 << setw(20) << couriers[index].name
-                 << setw(15) << couriers[index].currentZone
-                 << setw(12) << (couriers[index].available ? "Available" : "Busy")
-                 << setw(10) << (to_string(couriers[index].currentLoad) + "/" + to_string(couriers[index].maxLoad)) << "\n";
+        for (auto it = overflow.begin(); it != overflow.end() && it->first < horizon; ++it) {
+            due.push_back(it->second);
         }
-        cout << "\n";
+        return due;
     }
 };
 
-// ==================== SPARSE MATRIX FOR ROUTING OPTIMIZATION ====================
+// ==================== INDEXED PRIORITY STORE FOR APPOINTMENTS ====================
 
-struct SparseNode {
-    int row;
-    int col;
-    double distance;
-    SparseNode* next;
-    
-    SparseNode(int r, int c, double dist) 
-        : row(r), col(c), distance(dist), next(nullptr) {}
+// One appointment row as handed over by the batch loader; views stay valid during the insert
+struct AppointmentRow {
+    int appointmentId;
+    string_view customerName;
+    string_view address;
+    string_view deliveryTime;
+    int priority;
+    string_view zone;
+    TimeWindow window;        // deliveryTime as resolved when first added, if hasWindow
+    bool hasWindow = false;   // restored rows keep their window instead of re-parsing the text
 };
 
-class SparseMatrix {
+// Which pending appointment is handed out next
+enum DispatchPolicy {
+    DISPATCH_BY_PRIORITY,   // priority, then deadline
+    DISPATCH_BY_DEADLINE    // deadline, then priority
+};
+
+// Binary min-heap of pending appointments ordered by (priority, deadline, insertion order)
+// plus a hash index on appointmentId. Insert, remove and complete are O(log n),
+// next pending is O(1); completed appointments leave the heap and are never scanned again.
+// Pending appointments are also kept in a CalendarQueue by deadline.
+class AppointmentStore {
 private:
-    int numLocations;
-    vector<string> locationNames;
-    SparseNode** rows;
+    vector<DeliveryAppointment*> heap;
+    unordered_map<int, DeliveryAppointment*> index;
+    CalendarQueue calendar;
+    DispatchPolicy policy;
+    long long nextSequence;
+    int appointmentCount;
+    ObjectPool<DeliveryAppointment> pool;
+    StringArena text;   // customer, address and time text; compacted as appointments are removed
     
-public:
-    SparseMatrix(int locations) : numLocations(locations) {
-        rows = new SparseNode*[numLocations];
-        for (int i = 0; i < numLocations; i++) {
-            rows[i] = nullptr;
-        }
-        
-        // Initialize location names
-        locationNames = {
-            "Zone-A-Center", "Zone-A-East", "Zone-A-West",
-            "Zone-B-Center", "Zone-B-North", "Zone-B-South",
-            "Zone-C-Center", "Zone-C-East", "Zone-C-West",
-            "Warehouse"
-        };
+    static bool comesBefore(const DeliveryAppointment* a, const DeliveryAppointment* b) {
+        if (a->priority != b->priority) return a->priority < b->priority;
+        if (a->window.latest != b->window.latest) return a->window.latest < b->window.latest;
+        return a->sequence < b->sequence;
     }
     
-    void addEdge(int from, int to, double distance) {
-        if (from < 0 || from >= numLocations || to < 0 || to >= numLocations) {
-            return;
-        }
-        
-        // Add to sparse matrix
-        SparseNode* newNode = new SparseNode(from, to, distance);
-        newNode->next = rows[from];
-        rows[from] = newNode;
-        
-        // Also add reverse edge (undirected graph)
-        SparseNode* reverseNode = new SparseNode(to, from, distance);
-        reverseNode->next = rows[to];
-        rows[to] = reverseNode;
+    static bool dueBefore(const DeliveryAppointment* a, const DeliveryAppointment* b) {
+        if (a->window.latest != b->window.latest) return a->window.latest < b->window.latest;
+        return comesBefore(a, b);
     }
     
-    double getDistance(int from, int to) {
-        if (from == to) return 0.0;
-        
-        SparseNode* current = rows[from];
-        while (current) {
-            if (current->col == to) {
-                return current->distance;
-            }
-            current = current->next;
-        }
-        return -1.0; // No connection
+    void place(size_t pos, DeliveryAppointment* app) {
+        heap[pos] = app;
+        app->heapIndex = (int)pos;
     }
     
-    // Dijkstra's algorithm for shortest path
-    vector<int> findShortestPath(int start, int end) {
-        vector<double> dist(numLocations, INT_MAX);
-        vector<int> parent(numLocations, -1);
-        vector<bool> visited(numLocations, false);
-        
-        dist[start] = 0;
-        
-        for (int count = 0; count < numLocations - 1; count++) {
-            int u = -1;
-            double minDist = INT_MAX;
-            
-            for (int v = 0; v < numLocations; v++) {
-                if (!visited[v] && dist[v] < minDist) {
-                    minDist = dist[v];
-                    u = v;
-                }
-            }
-            
-            if (u == -1 || u == end) break;
-            visited[u] = true;
-            
-            SparseNode* current = rows[u];
-            while (current) {
-                int v = current->col;
-                if (!visited[v] && dist[u] != INT_MAX && 
-                    dist[u] + current->distance < dist[v]) {
-                    dist[v] = dist[u] + current->distance;
-                    parent[v] = u;
-                }
-                current = current->next;
-            }
-        }
-        
-        // Reconstruct path
-        vector<int> path;
-        if (dist[end] == INT_MAX) {
-            return path; // No path found
-        }
-        
-        int current = end;
-        while (current != -1) {
-            path.push_back(current);
-            current = parent[current];
+    void siftUp(size_t pos) {
+        DeliveryAppointment* app = heap[pos];
+        while (pos > 0) {
+            size_t parent = (pos - 1) / 2;
+            if (!comesBefore(app, heap[parent])) break;
+            place(pos, heap[parent]);
+            pos = parent;
         }
-        reverse(path.begin(), path.end());
-        return path;
+        place(pos, app);
     }
     
-    double calculateRouteCost(const vector<int>& path) {
-        if (path.size() < 2) return 0.0;
-        
-        double totalCost = 0.0;
-        for (size_t i = 0; i < path.size() - 1; i++) {
-            double dist = getDistance(path[i], path[i + 1]);
-            if (dist > 0) {
-                totalCost += dist;
-            }
+    void siftDown(size_t pos) {
+        DeliveryAppointment* app = heap[pos];
+        size_t n = heap.size();
+        while (true) {
+            size_t child = 2 * pos + 1;
+            if (child >= n) break;
+            if (child + 1 < n && comesBefore(heap[child + 1], heap[child])) child++;
+            if (!comesBefore(heap[child], app)) break;
+            place(pos, heap[child]);
+            pos = child;
         }
-        return totalCost;
+        place(pos, app);
     }
     
-    int getLocationIndex(string zone) {
-        for (size_t i = 0; i < locationNames.size(); i++) {
-            if (locationNames[i].find(zone) != string::npos) {
-                return i;
-            }
+    void pushPending(DeliveryAppointment* app) {
+        heap.push_back(app);
+        siftUp(heap.size() - 1);
+        calendar.insert(app);
+    }
+    
+    // Move the text of every remaining appointment into a fresh arena and drop the old blocks
+    void compactText() {
+        StringArena fresh;
+        for (auto& entry : index) {
+            DeliveryAppointment* app = entry.second;
+            app->customerName = fresh.store(app->customerName);
+            app->address = fresh.store(app->address);
+            app->deliveryTime = fresh.store(app->deliveryTime);
         }
-        return -1;
+        text = move(fresh);
     }
     
-    string getLocationName(int index) {
-        if (index >= 0 && index < numLocations) {
-            return locationNames[index];
+    void erasePending(DeliveryAppointment* app) {
+        calendar.erase(app);
+        size_t pos = app->heapIndex;
+        DeliveryAppointment* last = heap.back();
+        heap.pop_back();
+        app->heapIndex = -1;
+        if (pos < heap.size()) {
+            place(pos, last);
+            siftUp(pos);
+            siftDown(last->heapIndex);
         }
-        return "Unknown";
     }
     
-    void displayMatrix() {
-        cout << "\n========== ROUTING MATRIX (SPARSE) ==========\n";
-        cout << "Location Connections:\n";
-        for (int i = 0; i < numLocations; i++) {
-            cout << locationNames[i] << " -> ";
-            SparseNode* current = rows[i];
-            bool hasConnections = false;
-            while (current) {
-                if (hasConnections) cout << ", ";
-                cout << locationNames[current->col] << "(" << current->distance << "km)";
-                hasConnections = true;
-                current = current->next;
-            }
-            if (!hasConnections) cout << "No connections";
-            cout << "\n";
+public:
+    AppointmentStore() : policy(DISPATCH_BY_PRIORITY), nextSequence(0), appointmentCount(0) {}
+    
+    // Add appointment (ordered by priority and time); false on a duplicate ID or bad time
+    bool addAppointment(int id, string_view name, string_view addr, string_view time, int prio, string_view zone) {
+        if (index.count(id)) {
+            cout << "Appointment #" << id << " already exists!\n";
+            return false;
         }
-        cout << "\n";
+        TimeWindow window;
+        if (!parseTimeWindow(time, window)) {
+            cout << "Invalid delivery time '" << time << "'!\n";
+            return false;
+        }
+        DeliveryAppointment* newApp = pool.create(id, text.store(name), text.store(addr), text.store(time),
+                                                  prio, nameTable().intern(zone));
+        newApp->window = window;
+        newApp->sequence = nextSequence++;
+        index[id] = newApp;
+        pushPending(newApp);
+        appointmentCount++;
+        cout << "Appointment #" << id << " added successfully!\n";
+        return true;
     }
     
-    ~SparseMatrix() {
-        for (int i = 0; i < numLocations; i++) {
-            SparseNode* current = rows[i];
-            while (current) {
-                SparseNode* temp = current;
-                current = current->next;
-                delete temp;
+    // Insert many appointments at once. Large batches are appended and the heap is
+    // rebuilt bottom-up in O(n) instead of sifting each row in. Rows with a duplicate
+    // ID or an unparseable time are skipped. Returns rows inserted, also listed in `added`.
+    int addAppointments(const vector<AppointmentRow>& rows, vector<DeliveryAppointment*>* added = nullptr) {
+        // Only grow the index ahead of a bulk insert: reserving for a single row would
+        // rehash the whole table on every call once removals keep its size steady
+        size_t wanted = index.size() + rows.size();
+        if (rows.size() > 1 && wanted > index.bucket_count() * index.max_load_factor()) index.reserve(wanted);
+        bool rebuild = rows.size() > heap.size() / 4;
+        if (rebuild) heap.reserve(heap.size() + rows.size());
+        
+        int inserted = 0;
+        int lastZone = -1;
+        string_view lastZoneName;
+        TimeWindow window;
+        for (const AppointmentRow& row : rows) {
+            if (index.count(row.appointmentId)) continue;
+            if (row.hasWindow) {
+                window = row.window;
+            } else if (!parseTimeWindow(row.deliveryTime, window)) {
+                continue;
+            }
+            if (lastZone == -1 || row.zone != lastZoneName) {
+                lastZone = nameTable().intern(row.zone);
+                lastZoneName = row.zone;
+            }
+            DeliveryAppointment* newApp = pool.create(
+                row.appointmentId, text.store(row.customerName), text.store(row.address),
+                text.store(row.deliveryTime), row.priority, lastZone);
+            newApp->window = window;
+            newApp->sequence = nextSequence++;
+            index[row.appointmentId] = newApp;
+            if (rebuild) {
+                heap.push_back(newApp);
+                calendar.insert(newApp);
+            } else {
+                pushPending(newApp);
             }
+            if (added) added->push_back(newApp);
+            inserted++;
         }
-        delete[] rows;
+        
+        if (rebuild) {
+            for (size_t i = 0; i < heap.size(); i++) heap[i]->heapIndex = (int)i;
+            for (size_t i = heap.size() / 2; i-- > 0;) siftDown(i);
+        }
+        appointmentCount += inserted;
+        return inserted;
     }
-};
-
-// ==================== DELIVERY MANAGEMENT SYSTEM ====================
-
-class DeliveryOptimizer {
-private:
-    AppointmentLinkedList appointments;
-    CircularQueue courierQueue;
-    SparseMatrix routingMatrix;
-    int appointmentIdCounter;
-    int courierIdCounter;
     
-public:
-    DeliveryOptimizer() 
-        : appointments(), courierQueue(10), routingMatrix(10), 
-          appointmentIdCounter(1), courierIdCounter(1) {
-        initializeRoutingMatrix();
+    // Remove appointment by ID
+    bool removeAppointment(int id) {
+        auto it = index.find(id);
+        if (it == index.end()) return false;
+        
+        DeliveryAppointment* app = it->second;
+        if (app->heapIndex != -1) erasePending(app);
+        index.erase(it);
+        text.release(app->customerName);
+        text.release(app->address);
+        text.release(app->deliveryTime);
+        pool.destroy(app);
+        appointmentCount--;
+        if (text.mostlyReleased()) compactText();
+        return true;
     }
     
-    void initializeRoutingMatrix() {
-        // Zone A connections
-        routingMatrix.addEdge(0, 1, 3.5);  // Zone-A-Center -> Zone-A-East
-        routingMatrix.addEdge(0, 2, 4.0);  // Zone-A-Center -> Zone-A-West
-        routingMatrix.addEdge(0, 9, 8.0);  // Zone-A-Center -> Warehouse
-        
-        // Zone B connections
-        routingMatrix.addEdge(3, 4, 5.0);  // Zone-B-Center -> Zone-B-North
-        routingMatrix.addEdge(3, 5, 4.5);  // Zone-B-Center -> Zone-B-South
-        routingMatrix.addEdge(3, 9, 10.0); // Zone-B-Center -> Warehouse
-        
-        // Zone C connections
-        routingMatrix.addEdge(6, 7, 3.0);  // Zone-C-Center -> Zone-C-East
-        routingMatrix.addEdge(6, 8, 3.5);  // Zone-C-Center -> Zone-C-West
-        routingMatrix.addEdge(6, 9, 12.0); // Zone-C-Center -> Warehouse
-        
-        // Inter-zone connections
-        routingMatrix.addEdge(0, 3, 15.0); // Zone-A -> Zone-B
-        routingMatrix.addEdge(3, 6, 18.0); // Zone-B -> Zone-C
-        routingMatrix.addEdge(0, 6, 20.0); // Zone-A -> Zone-C
+    // Get next pending appointment under the current dispatch policy
+    DeliveryAppointment* getNextPendingAppointment() {
+        if (policy == DISPATCH_BY_DEADLINE) return calendar.mostUrgent();
+        return heap.empty() ? nullptr : heap[0];
     }
     
-    void addAppointment() {
-        string name, address, time, zone;
-        int priority;
-        
-        cout << "\nEnter customer name: ";
-        cin.ignore();
-        getline(cin, name);
-        cout << "Enter address: ";
-        getline(cin, address);
-        cout << "Enter delivery time (HH:MM): ";
-        cin >> time;
-        cout << "Enter priority (1-5, 1=highest): ";
-        cin >> priority;
-        if (priority < 1) priority = 1;
-        if (priority > 5) priority = 5;
-        cout << "Enter zone (A, B, or C): ";
-        cin >> zone;
-        
-        string fullZone = "Zone-" + zone;
-        appointments.addAppointment(appointmentIdCounter++, name, address, time, priority, fullZone);
+    void setDispatchPolicy(DispatchPolicy next) { policy = next; }
+    
+    DispatchPolicy getDispatchPolicy() const { return policy; }
+    
+    // Move the calendar clock forward (minutes since epoch); it never runs backwards
+    void advanceClock(long long now) { calendar.advanceTo(now); }
+    
+    long long getClock() const { return calendar.getClock(); }
+    
+    // Pending appointments with a deadline in the next `minutes`, overdue ones included,
+    // earliest deadline first
+    vector<DeliveryAppointment*> getDueWithin(int minutes) const {
+        return calendar.dueBefore(calendar.getClock() + minutes);
     }
     
-    void addCourier() {
-        string name, zone;
-        cout << "\nEnter courier name: ";
-        cin.ignore();
-        getline(cin, name);
-        cout << "Enter initial zone (A, B, or C): ";
-        cin >> zone;
+    // Mark appointment as completed
+    bool completeAppointment(int id) {
+        auto it = index.find(id);
+        if (it == index.end() || it->second->completed) return false;
         
-        string fullZone = "Zone-" + zone;
-        courierQueue.enqueue(courierIdCounter++, name, fullZone);
+        it->second->completed = true;
+        erasePending(it->second);
+        return true;
     }
     
-    void dispatchNextDelivery() {
-        DeliveryAppointment* nextApp = appointments.getNextPendingAppointment();
-        if (!nextApp) {
-            cout << "No pending appointments to dispatch.\n";
-            return;
-        }
-        
-        Courier courier = courierQueue.getAvailableCourierForZone(nextApp->zone);
-        if (courier.courierId == -1) {
-            cout << "No available courier for appointment #" << nextApp->appointmentId << "\n";
-            return;
-        }
-        
-        cout << "\n========== DISPATCH ASSIGNMENT ==========\n";
-        cout << "Appointment #" << nextApp->appointmentId << "\n";
-        cout << "Customer: " << nextApp->customerName << "\n";
-        cout << "Address: " << nextApp->address << "\n";
-        cout << "Zone: " << nextApp->zone << "\n";
-        cout << "Assigned to: " << courier.name << " (ID: " << courier.courierId << ")\n";
-        
-        // Calculate route
-        int warehouseIndex = 9; // Warehouse index
-        int targetZoneIndex = routingMatrix.getLocationIndex(nextApp->zone);
-        
-        if (targetZoneIndex != -1) {
-            vector<int> route = routingMatrix.findShortestPath(warehouseIndex, targetZoneIndex);
-            double cost = routingMatrix.calculateRouteCost(route);
-            
-            cout << "\nOptimized Route:\n";
-            cout << "Warehouse";
-            for (size_t i = 1; i < route.size(); i++) {
-                cout << " -> " << routingMatrix.getLocationName(route[i]);
-            }
-            cout << "\nTotal Distance: " << fixed << setprecision(2) << cost << " km\n";
-            cout << "Estimated Cost: $" << fixed << setprecision(2) << (cost * 1.5) << "\n";
-        }
-        
-        courierQueue.assignDelivery(courier.courierId, nextApp->zone);
-        appointments.completeAppointment(nextApp->appointmentId);
-        cout << "\nDelivery dispatched successfully!\n\n";
+    DeliveryAppointment* findAppointment(int id) {
+        auto it = index.find(id);
+        return it == index.end() ? nullptr : it->second;
     }
     
-    void optimizeMultipleDeliveries() {
-        vector<DeliveryAppointment*> pendingApps;
-        DeliveryAppointment* current = appointments.getNextPendingAppointment();
-        
-        while (current) {
-            pendingApps.push_back(current);
-            // Get next after marking this one temporarily
-            DeliveryAppointment* temp = current;
-            current = nullptr;
-            DeliveryAppointment* search = appointments.getNextPendingAppointment();
-            if (search && search->appointmentId != temp->appointmentId) {
-                current = search;
-            }
-        }
-        
-        if (pendingApps.empty()) {
-            cout << "No pending deliveries to optimize.\n";
+    // Display all appointments
+    void displayAppointments() {
+        if (index.empty()) {
+            cout << "No appointments scheduled.\n";
             return;
         }
         
-        cout << "\n========== BATCH ROUTE OPTIMIZATION ==========\n";
-        cout << "Optimizing " << pendingApps.size() << " deliveries...\n\n";
+        vector<DeliveryAppointment*> ordered;
+        ordered.reserve(index.size());
+        for (auto& entry : index) ordered.push_back(entry.second);
+        sort(ordered.begin(), ordered.end(), comesBefore);
         
-        int warehouseIndex = 9;
-        double totalDistance = 0.0;
+        cout << "\n========== DELIVERY APPOINTMENTS ==========\n";
+        cout << left << setw(5) << "ID" << setw(20) << "Customer" 
+             << setw(25) << "Address" << setw(15) << "Time" 
+             << setw(10) << "Priority" << setw(10) << "Zone" << setw(10) << "Status\n";
+        cout << string(95, '-') << "\n";
         
-        for (size_t i = 0; i < pendingApps.size(); i++) {
-            int targetIndex = routingMatrix.getLocationIndex(pendingApps[i]->zone);
-            if (targetIndex != -1) {
-                vector<int> route = routingMatrix.findShortestPath(warehouseIndex, targetIndex);
-                double cost = routingMatrix.calculateRouteCost(route);
-                totalDistance += cost;
-                
-                cout << "Delivery #" << pendingApps[i]->appointmentId 
-                     << " to " << pendingApps[i]->zone 
-                     << ": " << fixed << setprecision(2) << cost << " km\n";
-            }
+        for (DeliveryAppointment* current : ordered) {
+            cout << left << setw(5) << current->appointmentId
+                 << setw(20) << current->customerName
+                 << setw(25) << current->address
+                 << setw(15) << current->deliveryTime
+                 << setw(10) << current->priority
+                 << setw(10) << current->zoneName()
+                 << setw(10) << (current->completed ? "Done" : "Pending") << "\n";
         }
-        
-        cout << "\nTotal Route Distance: " << fixed << setprecision(2) << totalDistance << " km\n";
-        cout << "Estimated Total Cost: $" << fixed << setprecision(2) << (totalDistance * 1.5) << "\n\n";
+        cout << "Total Appointments: " << appointmentCount << "\n\n";
     }
     
-    void displayMenu() {
+    int getCount() { return appointmentCount; }
+    
+    int getPendingCount() { return (int)heap.size(); }
+    
+    // Pending appointments in dispatch order
+    vector<DeliveryAppointment*> getPendingAppointments() {
+        vector<DeliveryAppointment*> pending(heap.begin(), heap.end());
+        sort(pending.begin(), pending.end(), policy == DISPATCH_BY_DEADLINE ? dueBefore : comesBefore);
+        return pending;
+    }
+    
+    // Every appointment, completed ones included, in insertion order
+    vector<DeliveryAppointment*> getAllAppointments() const {
+        vector<DeliveryAppointment*> all;
+        all.reserve(index.size());
+        for (const auto& entry : index) all.push_back(entry.second);
+        sort(all.begin(), all.end(), [](const DeliveryAppointment* a, const DeliveryAppointment* b) {
+            return a->sequence < b->sequence;
+        });
+        return all;
+    }
+    
+    size_t bytesReserved() const { return pool.bytesReserved() + text.bytesReserved(); }
+    
+    ~AppointmentStore() {
+        for (auto& entry : index) {
+            pool.destroy(entry.second);
+        }
+    }
+};
+
+// ==================== CIRCULAR QUEUE FOR COURIER ASSIGNMENTS ====================
+
+struct Courier {
+    int courierId;
+    string_view name;   // owned by the CircularQueue's arena
+    int zoneId;         // current zone, interned in nameTable()
+    bool available;
+    int currentLoad;
+    int maxLoad;
+    
+    // Default constructor
+    Courier() : courierId(-1), name(), zoneId(-1), available(true), currentLoad(0), maxLoad(5) {}
+    
+    Courier(int id, string_view n, int zone) 
+        : courierId(id), name(n), zoneId(zone), available(true), currentLoad(0), maxLoad(5) {}
+    
+    string_view zoneName() const { return nameTable().name(zoneId); }
+};
+
+class CircularQueue {
+private:
+    // Intrusive FIFO lists threaded through the ring slots
+    enum CourierList {
+        ZONE_SPARE_LIST,   // available with spare load, one list per zone
+        SPARE_LIST,        // available with spare load, any zone
+        AVAILABLE_LIST,    // available regardless of load
+        COURIER_LIST_COUNT
+    };
+    
+    struct SlotList {
+        int head;
+        int tail;
+        SlotList() : head(-1), tail(-1) {}
+    };
+    
+    struct CourierLinks {
+        int prev[COURIER_LIST_COUNT];
+        int next[COURIER_LIST_COUNT];
+        bool linked[COURIER_LIST_COUNT];
+        int linkedZone;  // zone list the slot currently sits in
+        
+        CourierLinks() : linkedZone(-1) {
+            for (int i = 0; i < COURIER_LIST_COUNT; i++) {
+                prev[i] = next[i] = -1;
+                linked[i] = false;
+            }
+        }
+    };
+    
+    vector<Courier> couriers;
+    vector<CourierLinks> links;
+    int front;
+    int rear;
+    int size;
+    int capacity;
+    
+    // The fields fleet-wide scans test, as parallel columns by ring slot padded to whole
+    // blocks of LANES; syncColumns keeps them in step with `couriers`. A rank key is
+    // tier << 24 | currentLoad, lower is better. rankColumn holds the key a courier has for
+    // an order outside its zone: tier 1 with spare load, 3 when full, 4 when unavailable
+    // or an empty slot. In the order's zone the courier is one tier better, so tier 0 is
+    // in the zone with spare load and 2 in the zone but full; from tier 3 on it is ineligible.
+    static constexpr int LANES = 16;
+    static constexpr int32_t TIER = 1 << 24;
+    static constexpr int32_t INELIGIBLE = 3 * TIER;
+    vector<int32_t> zoneColumn;
+    vector<int32_t> availableColumn;   // 1 or 0
+    vector<int32_t> rankColumn;
+    
+    unordered_map<int, int> slotOf;          // courierId -> ring slot
+    vector<SlotList> zoneLists;              // indexed by zone ID
+    SlotList spareList;
+    SlotList availableList;
+    StringArena names;
+    
+    SlotList& listFor(int kind, int zone) {
+        if (kind == ZONE_SPARE_LIST) {
+            if (zone >= (int)zoneLists.size()) zoneLists.resize(zone + 1);
+            return zoneLists[zone];
+        }
+        return kind == SPARE_LIST ? spareList : availableList;
+    }
+    
+    void pushBack(int kind, int slot, int zone) {
+        SlotList& list = listFor(kind, zone);
+        CourierLinks& link = links[slot];
+        link.prev[kind] = list.tail;
+        link.next[kind] = -1;
+        link.linked[kind] = true;
+        if (list.tail != -1) links[list.tail].next[kind] = slot;
+        else list.head = slot;
+        list.tail = slot;
+    }
+    
+    void unlink(int kind, int slot) {
+        CourierLinks& link = links[slot];
+        if (!link.linked[kind]) return;
+        SlotList& list = listFor(kind, link.linkedZone);
+        if (link.prev[kind] != -1) links[link.prev[kind]].next[kind] = link.next[kind];
+        else list.head = link.next[kind];
+        if (link.next[kind] != -1) links[link.next[kind]].prev[kind] = link.prev[kind];
+        else list.tail = link.prev[kind];
+        link.prev[kind] = link.next[kind] = -1;
+        link.linked[kind] = false;
+    }
+    
+    void unlinkAll(int slot) {
+        for (int kind = 0; kind < COURIER_LIST_COUNT; kind++) unlink(kind, slot);
+    }
+    
+    void resizeColumns() {
+        size_t padded = (size_t)(capacity + LANES - 1) / LANES * LANES;
+        zoneColumn.assign(padded, -1);
+        availableColumn.assign(padded, 0);
+        rankColumn.assign(padded, 4 * TIER);
+    }
+    
+    void syncColumns(int slot) {
+        const Courier& courier = couriers[slot];
+        zoneColumn[slot] = courier.zoneId;
+        availableColumn[slot] = courier.available ? 1 : 0;
+        rankColumn[slot] = !courier.available ? 4 * TIER
+                                              : (courier.currentLoad < courier.maxLoad ? TIER : 3 * TIER) |
+                                                    min(courier.currentLoad, TIER - 1);
+    }
+    
+    static int32_t rankFor(int32_t zone, int32_t rank, int32_t target) {
+        return rank - ((zone == target ? -1 : 0) & TIER);
+    }
+    
+    // Whether any of a block of LANES slots ranks at most `limit` for an order in `target`.
+    // Branch-free over a fixed-size block (compare, mask, subtract, or), so the compiler
+    // turns it into SIMD even at the baseline instruction set.
+    static bool anyRankAtMost(const int32_t* zone, const int32_t* rank, int32_t target, int32_t limit) {
+        int32_t any = 0;
+        for (int j = 0; j < LANES; j++) any |= rankFor(zone[j], rank[j], target) <= limit ? -1 : 0;
+        return any != 0;
+    }
+    
+    // Append the courier to the back of every list it now qualifies for
+    void linkAll(int slot) {
+        const Courier& courier = couriers[slot];
+        if (!courier.available) return;
+        links[slot].linkedZone = courier.zoneId;
+        pushBack(AVAILABLE_LIST, slot, courier.zoneId);
+        if (courier.currentLoad < courier.maxLoad) {
+            pushBack(SPARE_LIST, slot, courier.zoneId);
+            pushBack(ZONE_SPARE_LIST, slot, courier.zoneId);
+        }
+    }
+    
+    // Double the ring, moving the queue to slots 0..size-1 and remapping every link
+    void grow() {
+        int newCapacity = max(1, capacity * 2);
+        auto remap = [this](int slot) {
+            return slot == -1 ? -1 : (slot - front + capacity) % capacity;
+        };
+        
+        vector<Courier> grownCouriers(newCapacity);
+        vector<CourierLinks> grownLinks(newCapacity);
+        for (int i = 0; i < size; i++) {
+            int index = (front + i) % capacity;
+            grownCouriers[i] = couriers[index];
+            grownLinks[i] = links[index];
+            for (int kind = 0; kind < COURIER_LIST_COUNT; kind++) {
+                grownLinks[i].prev[kind] = remap(grownLinks[i].prev[kind]);
+                grownLinks[i].next[kind] = remap(grownLinks[i].next[kind]);
+            }
+            slotOf[couriers[index].courierId] = i;
+        }
+        for (SlotList& list : zoneLists) {
+            list.head = remap(list.head);
+            list.tail = remap(list.tail);
+        }
+        for (SlotList* list : {&spareList, &availableList}) {
+            list->head = remap(list->head);
+            list->tail = remap(list->tail);
+        }
+        
+        couriers.swap(grownCouriers);
+        links.swap(grownLinks);
+        front = size > 0 ? 0 : -1;
+        rear = size > 0 ? size - 1 : -1;
+        capacity = newCapacity;
+        resizeColumns();
+        for (int i = 0; i < size; i++) syncColumns(i);
+    }
+    
+public:
+    CircularQueue(int cap) : couriers(max(1, cap)), links(max(1, cap)), front(-1), rear(-1), size(0),
+                             capacity(max(1, cap)) {
+        resizeColumns();
+    }
+    
+    bool isEmpty() {
+        return size == 0;
+    }
+    
+    bool isFull() {
+        return size == capacity;
+    }
+    
+    // Add a courier at the back of the queue; the ring grows when it is full
+    bool push(int id, string_view name, string_view zone, int maxLoad = 5) {
+        if (slotOf.count(id)) return false;
+        if (isFull()) grow();
+        
+        if (front == -1) front = 0;
+        rear = (rear + 1) % capacity;
+        couriers[rear] = Courier(id, names.store(name), nameTable().intern(zone));
+        couriers[rear].maxLoad = maxLoad;
+        links[rear] = CourierLinks();
+        slotOf[id] = rear;
+        linkAll(rear);
+        syncColumns(rear);
+        size++;
+        return true;
+    }
+    
+    void enqueue(int id, string_view name, string_view zone) {
+        if (!push(id, name, zone)) {
+            cout << "Courier ID " << id << " is already registered!\n";
+            return;
+        }
+        cout << "Courier " << name << " (ID: " << id << ") added to queue.\n";
+    }
+    
+    Courier dequeue() {
+        if (isEmpty()) {
+            return Courier();
+        }
+        
+        Courier courier = couriers[front];
+        unlinkAll(front);
+        availableColumn[front] = 0;
+        rankColumn[front] = 4 * TIER;
+        slotOf.erase(courier.courierId);
+        if (front == rear) {
+            front = rear = -1;
+        } else {
+            front = (front + 1) % capacity;
+        }
+        size--;
+        return courier;
+    }
+    
+    Courier peek() {
+        if (isEmpty()) {
+            return Courier();
+        }
+        return couriers[front];
+    }
+    
+    Courier getCourier(int courierId) {
+        auto it = slotOf.find(courierId);
+        if (it == slotOf.end()) return Courier();
+        return couriers[it->second];
+    }
+    
+    // Get next available courier for a zone: a courier already in the zone with spare load,
+    // then any courier with spare load, then any available courier (each list in FIFO order)
+    Courier getAvailableCourierForZone(int targetZone) {
+        METRIC_SAMPLED_TIMER(HIST_COURIER_LOOKUP, 64);
+        if (targetZone >= 0 && targetZone < (int)zoneLists.size() && zoneLists[targetZone].head != -1) {
+            METRIC_COUNT(COUNTER_COURIER_ZONE_HITS, 1);
+            return couriers[zoneLists[targetZone].head];
+        }
+        int fallback = spareList.head != -1 ? spareList.head : availableList.head;
+        if (fallback != -1) {
+            METRIC_COUNT(COUNTER_COURIER_FALLBACKS, 1);
+            return couriers[fallback];
+        }
+        
+        // If no available courier found, return empty courier
+        METRIC_COUNT(COUNTER_COURIER_MISSES, 1);
+        return Courier();
+    }
+    
+    Courier getAvailableCourierForZone(string_view targetZone) {
+        return getAvailableCourierForZone(nameTable().find(targetZone));
+    }
+    
+    void assignDelivery(int courierId, int zone) {
+        auto it = slotOf.find(courierId);
+        if (it == slotOf.end()) return;
+        
+        int index = it->second;
+        unlinkAll(index);
+        couriers[index].available = false;
+        couriers[index].zoneId = zone;
+        couriers[index].currentLoad++;
+        linkAll(index);
+        syncColumns(index);
+    }
+    
+    void assignDelivery(int courierId, string_view zone) {
+        assignDelivery(courierId, nameTable().intern(zone));
+    }
+    
+    // One delivery done; false when no courier has this ID
+    bool releaseCourier(int courierId) {
+        auto it = slotOf.find(courierId);
+        if (it == slotOf.end()) return false;
+        
+        int index = it->second;
+        unlinkAll(index);
+        couriers[index].available = true;
+        couriers[index].currentLoad--;
+        if (couriers[index].currentLoad < 0) couriers[index].currentLoad = 0;
+        linkAll(index);
+        syncColumns(index);
+        return true;
+    }
+    
+    // Overwrite a registered courier's zone and load, e.g. when restoring saved state
+    void restoreCourierState(int courierId, int zone, bool available, int currentLoad) {
+        auto it = slotOf.find(courierId);
+        if (it == slotOf.end()) return;
+        
+        int index = it->second;
+        unlinkAll(index);
+        couriers[index].zoneId = zone;
+        couriers[index].available = available;
+        couriers[index].currentLoad = max(0, currentLoad);
+        linkAll(index);
+        syncColumns(index);
+    }
+    
+    int getSize() { return size; }
+    
+    // Every courier in queue order
+    vector<Courier> getAllCouriers() {
+        vector<Courier> result;
+        result.reserve(size);
+        for (int i = 0; i < size; i++) result.push_back(couriers[(front + i) % capacity]);
+        return result;
+    }
+    
+    // Available couriers in queue order. Blocks of the availability column with nobody
+    // available are skipped without touching the couriers themselves.
+    vector<Courier> getAvailableCouriers() {
+        vector<int> slots;
+        for (size_t base = 0; base < availableColumn.size(); base += LANES) {
+            const int32_t* available = &availableColumn[base];
+            int32_t any = 0;
+            for (int j = 0; j < LANES; j++) any |= available[j];
+            if (!any) continue;
+            for (int j = 0; j < LANES; j++) {
+                if (available[j]) slots.push_back((int)base + j);
+            }
+        }
+        // Slots come in ring order; the queue starts at front
+        if (front > 0) rotate(slots.begin(), lower_bound(slots.begin(), slots.end(), front), slots.end());
+        vector<Courier> result;
+        result.reserve(slots.size());
+        for (int slot : slots) result.push_back(couriers[slot]);
+        return result;
+    }
+    
+    // Available couriers in the order getAvailableCourierForZone hands them out: the order
+    // they last became available in, which every lookup list keeps
+    vector<Courier> getCouriersInDispatchOrder() const {
+        vector<Courier> result;
+        for (int slot = availableList.head; slot != -1; slot = links[slot].next[AVAILABLE_LIST]) {
+            result.push_back(couriers[slot]);
+        }
+        return result;
+    }
+    
+    // Up to `limit` couriers that can take an order in `targetZone`, best first: available
+    // couriers in the zone with spare load, then elsewhere with spare load, then full ones in
+    // the zone. Within a tier fewer deliveries in hand come first, then queue order. Scans the
+    // columns a block at a time and skips blocks that cannot beat the best `limit` so far.
+    vector<Courier> rankCouriersForZone(int targetZone, int limit) {
+        vector<Courier> result;
+        if (limit <= 0) return result;
+        vector<uint64_t> candidates;   // key << 32 | queue position
+        uint64_t cutoff = UINT64_MAX;
+        for (int base = 0; base < (int)zoneColumn.size(); base += LANES) {
+            // Queue positions rise with the slot except in the block holding the queue's start.
+            // A block wholly behind the cutoff in queue order has to beat its key outright.
+            int firstPosition = base >= front ? base - front : base - front + capacity;
+            if (front > base && front < base + LANES) firstPosition = 0;
+            int32_t limitKey = INELIGIBLE - 1;
+            if (cutoff != UINT64_MAX) {
+                limitKey = (int32_t)(cutoff >> 32);
+                if ((uint32_t)firstPosition > (uint32_t)cutoff) limitKey--;
+            }
+            if (!anyRankAtMost(&zoneColumn[base], &rankColumn[base], targetZone, limitKey)) continue;
+            for (int j = 0; j < LANES; j++) {
+                int32_t key = rankFor(zoneColumn[base + j], rankColumn[base + j], targetZone);
+                if (key > limitKey) continue;
+                int position = base + j - front;
+                if (position < 0) position += capacity;
+                uint64_t ranked = (uint64_t)key << 32 | (uint32_t)position;
+                if (ranked <= cutoff) candidates.push_back(ranked);
+            }
+            if (candidates.size() >= 2 * (size_t)limit + LANES) {
+                nth_element(candidates.begin(), candidates.begin() + (limit - 1), candidates.end());
+                candidates.resize(limit);
+                cutoff = candidates[limit - 1];
+            }
+        }
+        size_t keep = min(candidates.size(), (size_t)limit);
+        partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end());
+        result.reserve(keep);
+        for (size_t i = 0; i < keep; i++) {
+            int slot = front + (int)(uint32_t)candidates[i];
+            result.push_back(couriers[slot >= capacity ? slot - capacity : slot]);
+        }
+        return result;
+    }
+    
+    vector<Courier> rankCouriersForZone(string_view targetZone, int limit) {
+        return rankCouriersForZone(nameTable().find(targetZone), limit);
+    }
+    
+    void displayCouriers() {
+        if (isEmpty()) {
+            cout << "No couriers in queue.\n";
+            return;
+        }
+        
+        cout << "\n========== COURIER QUEUE ==========\n";
+        cout << left << setw(10) << "ID" << setw(20) << "Name" 
+             << setw(15) << "Zone" << setw(12) << "Status" 
+             << setw(10) << "Load" << "\n";
+        cout << string(67, '-') << "\n";
+        
+        for (int i = 0; i < size; i++) {
+            int index = (front + i) % capacity;
+            cout << left << setw(10) << couriers[index].courierId
+                 << setw(20) << couriers[index].name
+                 << setw(15) << couriers[index].zoneName()
+                 << setw(12) << (couriers[index].available ? "Available" : "Busy")
+                 << setw(10) << (to_string(couriers[index].currentLoad) + "/" + to_string(couriers[index].maxLoad)) << "\n";
+        }
+        cout << "\n";
+    }
+};
+
+// ==================== LOCK-FREE MPMC RING FOR INCOMING ORDERS ====================
+
+// Bounded multi-producer multi-consumer ring. Every cell carries a sequence number
+// that tells producers and consumers whose turn the cell is, so a push or pop is a
+// single compare-and-swap on the shared cursor and never takes a lock.
+template <typename T>
+class MPMCRingQueue {
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+    
+    vector<Cell> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> enqueuePos;
+    alignas(64) atomic<size_t> dequeuePos;
+    
+public:
+    // Capacity is rounded up to a power of two
+    explicit MPMCRingQueue(size_t capacity) : enqueuePos(0), dequeuePos(0) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        cells = vector<Cell>(size);
+        for (size_t i = 0; i < size; i++) cells[i].sequence.store(i, memory_order_relaxed);
+        mask = size - 1;
+    }
+    
+    MPMCRingQueue(const MPMCRingQueue&) = delete;
+    MPMCRingQueue& operator=(const MPMCRingQueue&) = delete;
+    
+    bool tryPush(const T& value) {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+    
+    bool tryPop(T& value) {
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+    
+    size_t capacity() const { return mask + 1; }
+};
+
+// ==================== SPARSE MATRIX FOR ROUTING OPTIMIZATION ====================
+
+struct SparseNode {
+    int row;
+    int col;
+    double distance;
+    SparseNode* next;
+    
+    SparseNode(int r, int c, double dist) 
+        : row(r), col(c), distance(dist), next(nullptr) {}
+};
+
+// Names, external IDs and zones of routing locations, indexed by node ID. Lookups by
+// name or external ID are exact hash hits. Each zone keeps its locations in registration
+// order; the first one is the zone's hub, where a zone-level request is routed.
+class LocationRegistry {
+private:
+    struct Entry {
+        string_view name;     // interned in nameTable(), empty when the node has no name
+        long long externalId; // -1 when none
+        int zoneId;           // interned in nameTable(), -1 when the node belongs to no zone
+        
+        Entry() : name(), externalId(-1), zoneId(-1) {}
+    };
+    
+    vector<Entry> entries;
+    unordered_map<string_view, int> byName;
+    unordered_map<long long, int> byExternalId;
+    vector<vector<int>> zoneMembers;   // zone ID -> nodes
+    
+    static const vector<int>& noMembers() {
+        static const vector<int> empty;
+        return empty;
+    }
+
+public:
+    // Attach a name (and optionally a zone and external ID) to a node that has none.
+    // Fails if the node is already named or the name or external ID is taken.
+    bool assign(int node, string_view name, string_view zone = string_view(), long long externalId = -1) {
+        if (node < 0 || name.empty()) return false;
+        if (node < (int)entries.size() && !entries[node].name.empty()) return false;
+        string_view stored = nameTable().name(nameTable().intern(name));
+        if (byName.count(stored) || (externalId >= 0 && byExternalId.count(externalId))) return false;
+        
+        if (node >= (int)entries.size()) entries.resize(node + 1);
+        Entry& entry = entries[node];
+        entry.name = stored;
+        entry.externalId = externalId;
+        byName.emplace(stored, node);
+        if (externalId >= 0) byExternalId.emplace(externalId, node);
+        if (!zone.empty()) {
+            entry.zoneId = nameTable().intern(zone);
+            if (entry.zoneId >= (int)zoneMembers.size()) zoneMembers.resize(entry.zoneId + 1);
+            zoneMembers[entry.zoneId].push_back(node);
+        }
+        return true;
+    }
+    
+    // Forget everything known about a node; O(zone size) to keep the zone order
+    void remove(int node) {
+        if (node < 0 || node >= (int)entries.size() || entries[node].name.empty()) return;
+        Entry& entry = entries[node];
+        byName.erase(entry.name);
+        if (entry.externalId >= 0) byExternalId.erase(entry.externalId);
+        if (entry.zoneId >= 0) {
+            vector<int>& members = zoneMembers[entry.zoneId];
+            members.erase(find(members.begin(), members.end(), node));
+        }
+        entry = Entry();
+    }
+    
+    void clear() {
+        entries.clear();
+        byName.clear();
+        byExternalId.clear();
+        zoneMembers.clear();
+    }
+    
+    int findByName(string_view name) const {
+        auto it = byName.find(name);
+        return it == byName.end() ? -1 : it->second;
+    }
+    
+    int findByExternalId(long long externalId) const {
+        auto it = byExternalId.find(externalId);
+        return it == byExternalId.end() ? -1 : it->second;
+    }
+    
+    const vector<int>& locationsInZone(int zoneId) const {
+        if (zoneId < 0 || zoneId >= (int)zoneMembers.size()) return noMembers();
+        return zoneMembers[zoneId];
+    }
+    
+    int zoneHub(int zoneId) const {
+        const vector<int>& members = locationsInZone(zoneId);
+        return members.empty() ? -1 : members.front();
+    }
+    
+    // A location name, or failing that a zone name resolved to the zone's hub
+    int resolve(string_view name) const {
+        int node = findByName(name);
+        return node != -1 ? node : zoneHub(nameTable().find(name));
+    }
+    
+    string_view name(int node) const {
+        return node >= 0 && node < (int)entries.size() ? entries[node].name : string_view();
+    }
+    
+    long long externalId(int node) const {
+        return node >= 0 && node < (int)entries.size() ? entries[node].externalId : -1;
+    }
+    
+    int zoneOf(int node) const {
+        return node >= 0 && node < (int)entries.size() ? entries[node].zoneId : -1;
+    }
+    
+    // One past the highest node that was ever named
+    int extent() const { return (int)entries.size(); }
+    
+    int namedCount() const { return (int)byName.size(); }
+};
+
+// ==================== COMPILE-TIME ROUTING GRAPH TYPES ====================
+
+// Weight types a RoutingGraph can store road lengths in. Each converts from and to km at
+// the graph's edges, has an infinity for closed roads and unreached nodes, and adds with
+// saturation at that infinity.
+template <typename Weight>
+struct WeightTraits;
+
+template <>
+struct WeightTraits<double> {
+    static constexpr bool isInteger = false;
+    static constexpr double infinity() { return numeric_limits<double>::infinity(); }
+    static double fromKm(double km) { return km; }
+    static double toKm(double weight) { return weight; }
+    static double add(double a, double b) { return a + b; }
+};
+
+template <>
+struct WeightTraits<float> {
+    static constexpr bool isInteger = false;
+    static constexpr float infinity() { return numeric_limits<float>::infinity(); }
+    static float fromKm(double km) { return (float)km; }
+    static double toKm(float weight) { return weight; }
+    static float add(float a, float b) { return a + b; }
+};
+
+// Fixed-point decimetres. 32 bits reach about 429,000 km, so only closed roads hit infinity.
+template <>
+struct WeightTraits<uint32_t> {
+    static constexpr bool isInteger = true;
+    static constexpr uint32_t infinity() { return UINT32_MAX; }
+    static uint32_t fromKm(double km) {
+        if (!(km * 10000.0 < (double)UINT32_MAX)) return infinity();
+        return km > 0 ? (uint32_t)llround(km * 10000.0) : 0;
+    }
+    static double toKm(uint32_t weight) {
+        return weight == infinity() ? numeric_limits<double>::infinity() : weight / 10000.0;
+    }
+    static uint32_t add(uint32_t a, uint32_t b) {
+        uint64_t sum = (uint64_t)a + b;
+        return sum >= UINT32_MAX ? infinity() : (uint32_t)sum;
+    }
+};
+
+// Monotone priority queue for integer keys. An entry sits in the bucket numbered by the
+// highest bit where its key differs from the last key popped, and only moves to a lower
+// bucket, so each push costs O(key bits) in all. Keys must never drop below the last key
+// popped, which holds for Dijkstra with non-negative weights.
+template <typename Key, typename Value>
+class RadixHeap {
+private:
+    static constexpr int BUCKETS = numeric_limits<Key>::digits + 1;
+    vector<pair<Key, Value>> buckets[BUCKETS];
+    Key last;
+    size_t count;
+    
+    int bucketOf(Key key) const {
+        Key differing = key ^ last;
+        return differing == 0 ? 0 : 64 - __builtin_clzll((unsigned long long)differing);
+    }
+
+public:
+    RadixHeap() : last(0), count(0) {}
+    
+    bool empty() const { return count == 0; }
+    
+    void push(const pair<Key, Value>& entry) {
+        buckets[bucketOf(entry.first)].push_back(entry);
+        count++;
+    }
+    
+    // The smallest entry; refills bucket 0 from the first non-empty bucket when it runs dry
+    const pair<Key, Value>& top() {
+        if (buckets[0].empty()) {
+            int i = 1;
+            while (buckets[i].empty()) i++;
+            last = buckets[i][0].first;
+            for (const pair<Key, Value>& entry : buckets[i]) last = min(last, entry.first);
+            for (const pair<Key, Value>& entry : buckets[i]) buckets[bucketOf(entry.first)].push_back(entry);
+            buckets[i].clear();
+        }
+        return buckets[0].back();
+    }
+    
+    void pop() {
+        top();
+        buckets[0].pop_back();
+        count--;
+    }
+};
+
+// Dijkstra's queue for a weight type: a radix heap for integer weights, a binary heap otherwise
+template <typename Weight, typename Index>
+using MinHeapFor = typename conditional<WeightTraits<Weight>::isInteger, RadixHeap<Weight, Index>,
+                                        priority_queue<pair<Weight, Index>, vector<pair<Weight, Index>>,
+                                                       greater<pair<Weight, Index>>>>::type;
+
+// Dijkstra over raw CSR arrays from start; stops early once end is settled, and
+// end = Index(-1) builds the full tree. Unreached nodes keep infinity and parent Index(-1).
+template <typename Weight, typename Index>
+void dijkstraOnArrays(size_t numNodes, const Index* offset, const Index* target, const Weight* weight,
+                      Index start, Index end, vector<Weight>& dist, vector<Index>& parent) {
+    typedef WeightTraits<Weight> Traits;
+    dist.assign(numNodes, Traits::infinity());
+    parent.assign(numNodes, Index(-1));
+    MinHeapFor<Weight, Index> heap;
+    
+    dist[start] = 0;
+    heap.push({Weight(0), start});
+    uint64_t pushes = 1, pops = 0, settled = 0;   // reported once, off the inner loop
+    
+    while (!heap.empty()) {
+        pair<Weight, Index> top = heap.top();
+        heap.pop();
+        pops++;
+        Index u = top.second;
+        if (top.first > dist[u]) continue; // Stale entry
+        settled++;
+        if (u == end) break;
+        
+        for (Index e = offset[u]; e < offset[u + 1]; e++) {
+            Index v = target[e];
+            Weight candidate = Traits::add(dist[u], weight[e]);
+            if (candidate < dist[v]) {
+                dist[v] = candidate;
+                parent[v] = u;
+                heap.push({candidate, v});
+                pushes++;
+            }
+        }
+    }
+    METRIC_COUNT(COUNTER_DIJKSTRA_RUNS, 1);
+    METRIC_COUNT(COUNTER_DIJKSTRA_SETTLED, settled);
+    METRIC_COUNT(COUNTER_DIJKSTRA_HEAP_PUSHES, pushes);
+    METRIC_COUNT(COUNTER_DIJKSTRA_HEAP_POPS, pops);
+}
+
+// Bidirectional Dijkstra over raw arrays: a forward search from start over the out-arcs and
+// a backward search from end over the in-arcs, always growing the frontier with the smaller
+// key. mu is the best start-end distance through any node seen by both sides; once the two
+// frontier keys add up to mu no shorter path can exist. Returns the path, empty when end
+// is unreachable.
+template <typename Weight, typename Index>
+vector<Index> bidirectionalOnArrays(size_t numNodes, const Index* offset, const Index* target, const Weight* weight,
+                                    const Index* inOffset, const Index* inSource, const Weight* inWeight,
+                                    Index start, Index end) {
+    typedef WeightTraits<Weight> Traits;
+    const Weight infinity = Traits::infinity();
+    const Index none = Index(-1);
+    vector<Weight> dist[2] = {vector<Weight>(numNodes, infinity), vector<Weight>(numNodes, infinity)};
+    vector<Index> parent[2] = {vector<Index>(numNodes, none), vector<Index>(numNodes, none)};
+    const Index* arcOffset[2] = {offset, inOffset};
+    const Index* arcHead[2] = {target, inSource};
+    const Weight* arcWeight[2] = {weight, inWeight};
+    MinHeapFor<Weight, Index> heap[2];
+    
+    dist[0][start] = 0;
+    dist[1][end] = 0;
+    heap[0].push({Weight(0), start});
+    heap[1].push({Weight(0), end});
+    Weight mu = start == end ? Weight(0) : infinity;
+    Index meeting = start == end ? start : none;
+    uint64_t settled = 0;
+    
+    while (!heap[0].empty() && !heap[1].empty()) {
+        if (Traits::add(heap[0].top().first, heap[1].top().first) >= mu) break;
+        int side = heap[0].top().first <= heap[1].top().first ? 0 : 1;
+        pair<Weight, Index> top = heap[side].top();
+        heap[side].pop();
+        Index u = top.second;
+        if (top.first > dist[side][u]) continue; // Stale entry
+        settled++;
+        
+        for (Index e = arcOffset[side][u]; e < arcOffset[side][u + 1]; e++) {
+            Index v = arcHead[side][e];
+            Weight candidate = Traits::add(dist[side][u], arcWeight[side][e]);
+            if (candidate < dist[side][v]) {
+                dist[side][v] = candidate;
+                parent[side][v] = u;
+                heap[side].push({candidate, v});
+            }
+            if (dist[1 - side][v] != infinity && Traits::add(candidate, dist[1 - side][v]) < mu) {
+                mu = Traits::add(candidate, dist[1 - side][v]);
+                meeting = v;
+            }
+        }
+    }
+    METRIC_COUNT(COUNTER_BIDIRECTIONAL_RUNS, 1);
+    METRIC_COUNT(COUNTER_BIDIRECTIONAL_SETTLED, settled);
+    
+    // Stitch start -> meeting from the forward parents and meeting -> end from the backward ones
+    vector<Index> path;
+    if (meeting == none) return path;
+    for (Index current = meeting; current != none; current = parent[0][current]) path.push_back(current);
+    reverse(path.begin(), path.end());
+    for (Index current = parent[1][meeting]; current != none; current = parent[1][current]) path.push_back(current);
+    return path;
+}
+
+// Immutable CSR road graph specialised at compile time on its weight type (see
+// WeightTraits), its node and arc index width, and whether roads are one-way. An
+// undirected graph stores each road once per direction and its in-arcs are its out-arcs,
+// so only a directed graph keeps reverse arrays for backward searches. Node IDs run from
+// 0 to nodes() - 1; Index(-1) means "no node".
+template <typename Weight, typename Index, bool Directed>
+class RoutingGraph {
+public:
+    typedef WeightTraits<Weight> Traits;
+    static constexpr Index NO_NODE = Index(-1);
+
+private:
+    size_t nodeCount;
+    vector<Index> offset;
+    vector<Index> target;
+    vector<Weight> weight;
+    vector<Index> inOffset;     // directed graphs only
+    vector<Index> inSource;
+    vector<Weight> inWeight;
+    
+    // NO_NODE has to stay out of range for both nodes and arc offsets
+    static bool fits(size_t count) { return count < (size_t)numeric_limits<Index>::max(); }
+    
+    void buildInArcs() {
+        if constexpr (Directed) {
+            inOffset.assign(nodeCount + 1, 0);
+            for (Index head : target) inOffset[head + 1]++;
+            for (size_t i = 0; i < nodeCount; i++) inOffset[i + 1] += inOffset[i];
+            inSource.resize(target.size());
+            inWeight.resize(target.size());
+            vector<Index> slot(inOffset.begin(), inOffset.end() - 1);
+            for (size_t u = 0; u < nodeCount; u++) {
+                for (Index e = offset[u]; e < offset[u + 1]; e++) {
+                    Index at = slot[target[e]]++;
+                    inSource[at] = (Index)u;
+                    inWeight[at] = weight[e];
+                }
+            }
+        }
+    }
+    
+    const Index* inOffsets() const { return Directed ? inOffset.data() : offset.data(); }
+    const Index* inSources() const { return Directed ? inSource.data() : target.data(); }
+    const Weight* inWeights() const { return Directed ? inWeight.data() : weight.data(); }
+    
+    bool inRange(Index node) const { return (size_t)node < nodeCount; }
+
+public:
+    RoutingGraph() : nodeCount(0) {}
+    
+    // Build from road segments with from, to and distance in km, grouped by tail in input
+    // order. Segments with an end out of range are skipped. Fails when the graph is too
+    // big for the index type.
+    template <typename Segment>
+    bool build(size_t numNodes, const vector<Segment>& segments) {
+        auto valid = [&](const Segment& segment) {
+            return segment.from >= 0 && (size_t)segment.from < numNodes && segment.to >= 0 &&
+                   (size_t)segment.to < numNodes;
+        };
+        size_t arcCount = 0;
+        for (const Segment& segment : segments) {
+            if (valid(segment)) arcCount += Directed ? 1 : 2;
+        }
+        if (!fits(numNodes) || !fits(arcCount)) return false;
+        
+        nodeCount = numNodes;
+        offset.assign(nodeCount + 1, 0);
+        for (const Segment& segment : segments) {
+            if (!valid(segment)) continue;
+            offset[segment.from + 1]++;
+            if (!Directed) offset[segment.to + 1]++;
+        }
+        for (size_t i = 0; i < nodeCount; i++) offset[i + 1] += offset[i];
+        target.resize(arcCount);
+        weight.resize(arcCount);
+        vector<Index> slot(offset.begin(), offset.end() - 1);
+        for (const Segment& segment : segments) {
+            if (!valid(segment)) continue;
+            Weight length = Traits::fromKm(segment.distance);
+            Index at = slot[segment.from]++;
+            target[at] = (Index)segment.to;
+            weight[at] = length;
+            if (!Directed) {
+                at = slot[segment.to]++;
+                target[at] = (Index)segment.from;
+                weight[at] = length;
+            }
+        }
+        buildInArcs();
+        return true;
+    }
+    
+    // Copy ready-made CSR arrays in km, converting the weights. An undirected graph takes
+    // the arrays to hold every road in both directions, as SparseMatrix's do.
+    bool assignCSR(size_t numNodes, const vector<int>& csrOffset, const vector<int>& csrTarget,
+                   const vector<double>& csrWeight) {
+        if (!fits(numNodes) || !fits(csrTarget.size()) || csrOffset.size() != numNodes + 1) return false;
+        nodeCount = numNodes;
+        offset.assign(csrOffset.begin(), csrOffset.end());
+        target.assign(csrTarget.begin(), csrTarget.end());
+        weight.resize(csrWeight.size());
+        for (size_t e = 0; e < csrWeight.size(); e++) weight[e] = Traits::fromKm(csrWeight[e]);
+        buildInArcs();
+        return true;
+    }
+    
+    size_t nodes() const { return nodeCount; }
+    
+    size_t arcs() const { return target.size(); }
+    
+    // Bytes held by the adjacency arrays
+    size_t memoryBytes() const {
+        return (offset.capacity() + target.capacity() + inOffset.capacity() + inSource.capacity()) * sizeof(Index) +
+               (weight.capacity() + inWeight.capacity()) * sizeof(Weight);
+    }
+    
+    // Distances and parents from source, in the graph's own weight unit. With end given the
+    // search stops once end is settled.
+    void shortestPathTree(Index source, Index end, vector<Weight>& dist, vector<Index>& parent) const {
+        dijkstraOnArrays<Weight, Index>(nodeCount, offset.data(), target.data(), weight.data(), source, end,
+                                        dist, parent);
+    }
+    
+    vector<Index> shortestPath(Index start, Index end) const {
+        vector<Index> path;
+        if (!inRange(start) || !inRange(end)) return path;
+        vector<Weight> dist;
+        vector<Index> parent;
+        shortestPathTree(start, end, dist, parent);
+        if (dist[end] == Traits::infinity()) return path;
+        for (Index current = end; current != NO_NODE; current = parent[current]) path.push_back(current);
+        reverse(path.begin(), path.end());
+        return path;
+    }
+    
+    vector<Index> bidirectionalPath(Index start, Index end) const {
+        if (!inRange(start) || !inRange(end)) return vector<Index>();
+        return bidirectionalOnArrays<Weight, Index>(nodeCount, offset.data(), target.data(), weight.data(),
+                                                    inOffsets(), inSources(), inWeights(), start, end);
+    }
+    
+    // Length in km of a path of adjacent nodes, taking the shortest arc between each pair;
+    // infinity for an empty path or one that leaves the graph's arcs
+    double pathKm(const vector<Index>& path) const {
+        if (path.empty()) return numeric_limits<double>::infinity();
+        Weight total = 0;
+        for (size_t i = 0; i + 1 < path.size(); i++) {
+            if (!inRange(path[i])) return numeric_limits<double>::infinity();
+            Weight best = Traits::infinity();
+            for (Index e = offset[path[i]]; e < offset[path[i] + 1]; e++) {
+                if (target[e] == path[i + 1]) best = min(best, weight[e]);
+            }
+            total = Traits::add(total, best);
+        }
+        return Traits::toKm(total);
+    }
+    
+    // Shortest distance in km, infinity when end is unreachable
+    double distanceKm(Index start, Index end) const {
+        if (!inRange(start) || !inRange(end)) return numeric_limits<double>::infinity();
+        vector<Weight> dist;
+        vector<Index> parent;
+        shortestPathTree(start, end, dist, parent);
+        return Traits::toKm(dist[end]);
+    }
+};
+
+// The layout SparseMatrix keeps, and compact ones for large road networks: single-precision
+// km, and fixed-point decimetres searched with a radix heap, both with 32-bit indices
+typedef RoutingGraph<double, int32_t, false> RoadGraph;
+typedef RoutingGraph<float, uint32_t, false> CompactRoadGraph;
+typedef RoutingGraph<uint32_t, uint32_t, false> FixedPointRoadGraph;
+
+// ==================== CONTRACTION HIERARCHIES ====================
+
+// Contraction Hierarchies index over a CSR graph. Nodes are contracted in
+// edge-difference order; each contraction adds shortcuts that preserve the
+// shortest distances between the remaining nodes. A query is a bidirectional
+// upward search that settles only a few hundred nodes, and shortcuts are
+// unpacked back into original locations through their middle node.
+class ContractionHierarchy {
+private:
+    struct Arc {
+        int node;
+        double weight;
+    };
+    
+    struct WitnessScratch {
+        vector<double> dist;
+        vector<int> touched;
+    };
+    
+    int numNodes;
+    unsigned long long fingerprint;   // identifies the graph the index was built from
+    vector<int> rank;
+    
+    // Query graphs: upward arcs by source, and arcs into each node from higher-ranked nodes
+    vector<int> upOffset, upTarget;
+    vector<double> upWeight;
+    vector<int> downOffset, downSource;
+    vector<double> downWeight;
+    
+    // Middle node of every shortcut, keyed by (from, to)
+    unordered_map<unsigned long long, int> shortcutMiddle;
+    
+    // Per-query scratch space, reset through the touched lists
+    vector<double> forwardDist, backwardDist;
+    vector<int> forwardParent, backwardParent;
+    vector<int> touchedNodes;
+    
+    // Witness searches stop after this many settled nodes; priority estimates use a tighter budget
+    static const int WITNESS_SETTLE_LIMIT = 500;
+    static const int ESTIMATE_SETTLE_LIMIT = 50;
+    
+    static unsigned long long arcKey(int from, int to) {
+        return ((unsigned long long)(unsigned)from << 32) | (unsigned)to;
+    }
+    
+    static void setArc(vector<Arc>& arcs, int node, double weight) {
+        for (Arc& arc : arcs) {
+            if (arc.node == node) {
+                if (weight < arc.weight) arc.weight = weight;
+                return;
+            }
+        }
+        arcs.push_back({node, weight});
+    }
+    
+    // Bounded Dijkstra from source over the remaining graph, never passing through skip
+    static void witnessSearch(int source, int skip, double limit, int settleLimit,
+                              const vector<vector<Arc>>& out, WitnessScratch& scratch) {
+        for (int node : scratch.touched) scratch.dist[node] = numeric_limits<double>::infinity();
+        scratch.touched.clear();
+        
+        priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> heap;
+        scratch.dist[source] = 0.0;
+        scratch.touched.push_back(source);
+        heap.push({0.0, source});
+        
+        int settled = 0;
+        while (!heap.empty() && settled < settleLimit) {
+            pair<double, int> top = heap.top();
+            heap.pop();
+            int u = top.second;
+            if (top.first > scratch.dist[u]) continue;
+            if (top.first > limit) break;
+            settled++;
+            
+            for (const Arc& arc : out[u]) {
+                if (arc.node == skip) continue;
+                double candidate = top.first + arc.weight;
+                if (candidate < scratch.dist[arc.node]) {
+                    if (scratch.dist[arc.node] == numeric_limits<double>::infinity()) {
+                        scratch.touched.push_back(arc.node);
+                    }
+                    scratch.dist[arc.node] = candidate;
+                    heap.push({candidate, arc.node});
+                }
+            }
+        }
+    }
+    
+    // Shortcuts needed to contract v; collected into shortcuts when it is non-null
+    static int countShortcuts(int v, const vector<vector<Arc>>& out, const vector<vector<Arc>>& in,
+                              WitnessScratch& scratch, vector<pair<pair<int, int>, double>>* shortcuts) {
+        int settleLimit = shortcuts ? WITNESS_SETTLE_LIMIT : ESTIMATE_SETTLE_LIMIT;
+        double maxOut = 0.0;
+        for (const Arc& arc : out[v]) maxOut = max(maxOut, arc.weight);
+        
+        int count = 0;
+        for (const Arc& inArc : in[v]) {
+            int u = inArc.node;
+            witnessSearch(u, v, inArc.weight + maxOut, settleLimit, out, scratch);
+            
+            for (const Arc& outArc : out[v]) {
+                int x = outArc.node;
+                if (x == u) continue;
+                double viaV = inArc.weight + outArc.weight;
+                if (scratch.dist[x] > viaV) {
+                    count++;
+                    if (shortcuts) shortcuts->push_back({{u, x}, viaV});
+                }
+            }
+        }
+        return count;
+    }
+    
+    static void removeArc(vector<Arc>& arcs, int node) {
+        for (size_t i = 0; i < arcs.size(); i++) {
+            if (arcs[i].node == node) {
+                arcs[i] = arcs.back();
+                arcs.pop_back();
+                return;
+            }
+        }
+    }
+    
+    // upArcs[v]: arcs v -> higher-ranked node; downArcs[v]: arcs higher-ranked node -> v
+    void buildQueryGraphs(const vector<vector<Arc>>& upArcs, const vector<vector<Arc>>& downArcs) {
+        upOffset.assign(numNodes + 1, 0);
+        downOffset.assign(numNodes + 1, 0);
+        for (int v = 0; v < numNodes; v++) {
+            upOffset[v + 1] = upOffset[v] + (int)upArcs[v].size();
+            downOffset[v + 1] = downOffset[v] + (int)downArcs[v].size();
+        }
+        
+        upTarget.resize(upOffset[numNodes]);
+        upWeight.resize(upOffset[numNodes]);
+        downSource.resize(downOffset[numNodes]);
+        downWeight.resize(downOffset[numNodes]);
+        for (int v = 0; v < numNodes; v++) {
+            for (size_t i = 0; i < upArcs[v].size(); i++) {
+                upTarget[upOffset[v] + i] = upArcs[v][i].node;
+                upWeight[upOffset[v] + i] = upArcs[v][i].weight;
+            }
+            for (size_t i = 0; i < downArcs[v].size(); i++) {
+                downSource[downOffset[v] + i] = downArcs[v][i].node;
+                downWeight[downOffset[v] + i] = downArcs[v][i].weight;
+            }
+        }
+        
+        forwardDist.assign(numNodes, numeric_limits<double>::infinity());
+        backwardDist.assign(numNodes, numeric_limits<double>::infinity());
+        forwardParent.assign(numNodes, -1);
+        backwardParent.assign(numNodes, -1);
+        touchedNodes.clear();
+    }
+    
+    // Expand arc from -> to into original locations, appending everything after from
+    void unpackArc(int from, int to, vector<int>& path) const {
+        vector<pair<int, int>> stack;
+        stack.push_back({from, to});
+        while (!stack.empty()) {
+            pair<int, int> arc = stack.back();
+            stack.pop_back();
+            auto it = shortcutMiddle.find(arcKey(arc.first, arc.second));
+            if (it == shortcutMiddle.end()) {
+                path.push_back(arc.second);
+            } else {
+                stack.push_back({it->second, arc.second});
+                stack.push_back({arc.first, it->second});
+            }
+        }
+    }
+    
+public:
+    ContractionHierarchy() : numNodes(0), fingerprint(0) {}
+    
+    static unsigned long long computeFingerprint(int n, const vector<int>& offset,
+                                                 const vector<int>& target, const vector<double>& weight) {
+        unsigned long long hash = 1469598103934665603ULL;
+        auto mix = [&hash](unsigned long long value) {
+            hash ^= value;
+            hash *= 1099511628211ULL;
+        };
+        mix((unsigned long long)n);
+        for (int value : offset) mix((unsigned long long)(unsigned)value);
+        for (int value : target) mix((unsigned long long)(unsigned)value);
+        for (double value : weight) {
+            unsigned long long bits;
+            memcpy(&bits, &value, sizeof(bits));
+            mix(bits);
+        }
+        return hash;
+    }
+    
+    // Contract every node of the CSR graph; initial priorities are computed on `threads` workers
+    void build(int n, const vector<int>& offset, const vector<int>& target,
+               const vector<double>& weight, int threads) {
+        numNodes = n;
+        fingerprint = computeFingerprint(n, offset, target, weight);
+        shortcutMiddle.clear();
+        
+        // Working graph of the not-yet-contracted nodes
+        vector<vector<Arc>> out(n), in(n);
+        for (int u = 0; u < n; u++) {
+            for (int e = offset[u]; e < offset[u + 1]; e++) {
+                if (target[e] == u || weight[e] == numeric_limits<double>::infinity()) continue; // Closed roads
+                setArc(out[u], target[e], weight[e]);
+                setArc(in[target[e]], u, weight[e]);
+            }
+        }
+        
+        vector<int> contractedNeighbors(n, 0);
+        vector<int> level(n, 0);
+        vector<int> priority(n, 0);
+        auto evaluate = [&](int v, WitnessScratch& scratch) {
+            int shortcuts = countShortcuts(v, out, in, scratch, nullptr);
+            int edgeDifference = shortcuts - (int)(out[v].size() + in[v].size());
+            return 4 * edgeDifference + 2 * contractedNeighbors[v] + level[v];
+        };
+        
+        // Initial simulated contractions are independent, so split them across threads
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        threads = max(1, min(threads, n));
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                WitnessScratch scratch;
+                scratch.dist.assign(n, numeric_limits<double>::infinity());
+                for (int v = t; v < n; v += threads) priority[v] = evaluate(v, scratch);
+            });
+        }
+        for (thread& worker : workers) worker.join();
+        
+        priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> order;
+        for (int v = 0; v < n; v++) order.push({priority[v], v});
+        
+        WitnessScratch scratch;
+        scratch.dist.assign(n, numeric_limits<double>::infinity());
+        vector<pair<pair<int, int>, double>> shortcuts;
+        vector<vector<Arc>> upArcs(n), downArcs(n);
+        vector<char> contracted(n, 0);
+        rank.assign(n, -1);
+        int nextRank = 0;
+        
+        while (!order.empty()) {
+            pair<int, int> top = order.top();
+            order.pop();
+            int v = top.second;
+            if (contracted[v] || top.first != priority[v]) continue; // Stale entry
+            
+            // Lazy update: re-evaluate and requeue if v is no longer the cheapest
+            int current = evaluate(v, scratch);
+            if (current != priority[v]) {
+                priority[v] = current;
+                if (!order.empty() && current > order.top().first) {
+                    order.push({current, v});
+                    continue;
+                }
+            }
+            
+            shortcuts.clear();
+            countShortcuts(v, out, in, scratch, &shortcuts);
+            
+            // Arcs still attached to v are exactly its hierarchy arcs
+            upArcs[v] = out[v];
+            downArcs[v] = in[v];
+            for (const Arc& arc : out[v]) removeArc(in[arc.node], v);
+            for (const Arc& arc : in[v]) removeArc(out[arc.node], v);
+            
+            for (const auto& shortcut : shortcuts) {
+                int u = shortcut.first.first;
+                int x = shortcut.first.second;
+                double before = numeric_limits<double>::infinity();
+                for (const Arc& arc : out[u]) {
+                    if (arc.node == x) before = arc.weight;
+                }
+                if (shortcut.second < before) {
+                    setArc(out[u], x, shortcut.second);
+                    setArc(in[x], u, shortcut.second);
+                    shortcutMiddle[arcKey(u, x)] = v;
+                }
+            }
+            
+            contracted[v] = 1;
+            rank[v] = nextRank++;
+            
+            // Neighbours lost an arc and may have gained shortcuts, so refresh their priorities
+            vector<int> neighbors;
+            for (const Arc& arc : upArcs[v]) neighbors.push_back(arc.node);
+            for (const Arc& arc : downArcs[v]) neighbors.push_back(arc.node);
+            sort(neighbors.begin(), neighbors.end());
+            neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+            for (int neighbor : neighbors) {
+                contractedNeighbors[neighbor]++;
+                level[neighbor] = max(level[neighbor], level[v] + 1);
+                priority[neighbor] = evaluate(neighbor, scratch);
+                order.push({priority[neighbor], neighbor});
+            }
+        }
+        
+        buildQueryGraphs(upArcs, downArcs);
+    }
+    
+    bool isBuilt() const { return numNodes > 0; }
+    
+    bool matches(unsigned long long graphFingerprint) const {
+        return isBuilt() && fingerprint == graphFingerprint;
+    }
+    
+    int getShortcutCount() const { return (int)shortcutMiddle.size(); }
+    
+    // Bidirectional upward search; returns the original-location path (empty if unreachable)
+    vector<int> query(int start, int end, double* distance = nullptr) {
+        vector<int> path;
+        if (start < 0 || start >= numNodes || end < 0 || end >= numNodes) return path;
+        
+        for (int node : touchedNodes) {
+            forwardDist[node] = backwardDist[node] = numeric_limits<double>::infinity();
+            forwardParent[node] = backwardParent[node] = -1;
+        }
+        touchedNodes.clear();
+        
+        typedef priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> MinHeap;
+        MinHeap forward, backward;
+        forwardDist[start] = 0.0;
+        backwardDist[end] = 0.0;
+        touchedNodes.push_back(start);
+        touchedNodes.push_back(end);
+        forward.push({0.0, start});
+        backward.push({0.0, end});
+        
+        double best = numeric_limits<double>::infinity();
+        int meeting = -1;
+        uint64_t settled = 0;
+        
+        while (!forward.empty() || !backward.empty()) {
+            bool forwardDone = forward.empty() || forward.top().first >= best;
+            bool backwardDone = backward.empty() || backward.top().first >= best;
+            if (forwardDone && backwardDone) break;
+            
+            bool goForward = !forwardDone &&
+                (backwardDone || forward.top().first <= backward.top().first);
+            MinHeap& heap = goForward ? forward : backward;
+            vector<double>& dist = goForward ? forwardDist : backwardDist;
+            vector<double>& otherDist = goForward ? backwardDist : forwardDist;
+            vector<int>& parent = goForward ? forwardParent : backwardParent;
+            const vector<int>& arcOffset = goForward ? upOffset : downOffset;
+            const vector<int>& arcNode = goForward ? upTarget : downSource;
+            const vector<double>& arcWeight = goForward ? upWeight : downWeight;
+            
+            pair<double, int> top = heap.top();
+            heap.pop();
+            int u = top.second;
+            if (top.first > dist[u]) continue;
+            settled++;
+            
+            if (otherDist[u] != numeric_limits<double>::infinity() && top.first + otherDist[u] < best) {
+                best = top.first + otherDist[u];
+                meeting = u;
+            }
+            
+            // Stall-on-demand: u is reached more cheaply through a higher-ranked node, so its
+            // upward arcs cannot lead to a shortest path
+            const vector<int>& stallOffset = goForward ? downOffset : upOffset;
+            const vector<int>& stallNode = goForward ? downSource : upTarget;
+            const vector<double>& stallWeight = goForward ? downWeight : upWeight;
+            bool stalled = false;
+            for (int e = stallOffset[u]; e < stallOffset[u + 1] && !stalled; e++) {
+                stalled = dist[stallNode[e]] + stallWeight[e] < top.first;
+            }
+            if (stalled) continue;
+            
+            for (int e = arcOffset[u]; e < arcOffset[u + 1]; e++) {
+                int v = arcNode[e];
+                double candidate = top.first + arcWeight[e];
+                if (candidate < dist[v]) {
+                    if (forwardDist[v] == numeric_limits<double>::infinity() &&
+                        backwardDist[v] == numeric_limits<double>::infinity()) {
+                        touchedNodes.push_back(v);
+                    }
+                    dist[v] = candidate;
+                    parent[v] = u;
+                    heap.push({candidate, v});
+                }
+            }
+        }
+        
+        METRIC_COUNT(COUNTER_CH_QUERIES, 1);
+        METRIC_COUNT(COUNTER_CH_SETTLED, settled);
+        if (meeting == -1) return path;
+        if (distance) *distance = best;
+        
+        vector<int> upChain;
+        for (int node = meeting; node != -1; node = forwardParent[node]) upChain.push_back(node);
+        reverse(upChain.begin(), upChain.end());
+        
+        path.push_back(start);
+        for (size_t i = 0; i + 1 < upChain.size(); i++) unpackArc(upChain[i], upChain[i + 1], path);
+        for (int node = meeting; backwardParent[node] != -1; node = backwardParent[node]) {
+            unpackArc(node, backwardParent[node], path);
+        }
+        return path;
+    }
+    
+    bool save(const string& filename) const {
+        ofstream file(filename, ios::binary);
+        if (!file) return false;
+        
+        const char magic[8] = {'S', 'D', 'R', 'O', 'C', 'H', '0', '1'};
+        file.write(magic, sizeof(magic));
+        file.write((const char*)&numNodes, sizeof(numNodes));
+        file.write((const char*)&fingerprint, sizeof(fingerprint));
+        file.write((const char*)rank.data(), sizeof(int) * rank.size());
+        
+        auto writeArray = [&file](const auto& values) {
+            unsigned long long count = values.size();
+            file.write((const char*)&count, sizeof(count));
+            file.write((const char*)values.data(), sizeof(values[0]) * count);
+        };
+        writeArray(upOffset);
+        writeArray(upTarget);
+        writeArray(upWeight);
+        writeArray(downOffset);
+        writeArray(downSource);
+        writeArray(downWeight);
+        
+        vector<unsigned long long> keys;
+        vector<int> middles;
+        for (const auto& entry : shortcutMiddle) {
+            keys.push_back(entry.first);
+            middles.push_back(entry.second);
+        }
+        writeArray(keys);
+        writeArray(middles);
+        return (bool)file;
+    }
+    
+    bool load(const string& filename) {
+        ifstream file(filename, ios::binary);
+        if (!file) return false;
+        
+        char magic[8];
+        file.read(magic, sizeof(magic));
+        if (!file || memcmp(magic, "SDROCH01", sizeof(magic)) != 0) return false;
+        
+        int n = 0;
+        unsigned long long savedFingerprint = 0;
+        file.read((char*)&n, sizeof(n));
+        file.read((char*)&savedFingerprint, sizeof(savedFingerprint));
+        if (!file || n <= 0) return false;
+        
+        vector<int> savedRank(n);
+        file.read((char*)savedRank.data(), sizeof(int) * n);
+        
+        auto readArray = [&file](auto& values) {
+            unsigned long long count = 0;
+            file.read((char*)&count, sizeof(count));
+            if (!file || count > (1ULL << 34)) return false;
+            values.resize(count);
+            file.read((char*)values.data(), sizeof(values[0]) * count);
+            return (bool)file;
+        };
+        vector<unsigned long long> keys;
+        vector<int> middles;
+        if (!readArray(upOffset) || !readArray(upTarget) || !readArray(upWeight) ||
+            !readArray(downOffset) || !readArray(downSource) || !readArray(downWeight) ||
+            !readArray(keys) || !readArray(middles) || keys.size() != middles.size() ||
+            upOffset.size() != (size_t)n + 1 || downOffset.size() != (size_t)n + 1) {
+            numNodes = 0;
+            return false;
+        }
+        
+        numNodes = n;
+        fingerprint = savedFingerprint;
+        rank.swap(savedRank);
+        shortcutMiddle.clear();
+        for (size_t i = 0; i < keys.size(); i++) shortcutMiddle[keys[i]] = middles[i];
+        
+        forwardDist.assign(numNodes, numeric_limits<double>::infinity());
+        backwardDist.assign(numNodes, numeric_limits<double>::infinity());
+        forwardParent.assign(numNodes, -1);
+        backwardParent.assign(numNodes, -1);
+        touchedNodes.clear();
+        return true;
+    }
+};
+
+// Single-source shortest-path tree, valid for the graph version it was built against
+struct ShortestPathTree {
+    int source;
+    long long graphVersion;
+    vector<double> dist;
+    vector<int> parent;
+    
+    ShortestPathTree() : source(-1), graphVersion(-1) {}
+};
+
+// Heap Dijkstra over CSR arrays from start; stops early once end is settled (end = -1 builds the full tree)
+void dijkstraOnCSR(int numLocations, const vector<int>& offset, const vector<int>& target,
+                   const vector<double>& weight, int start, int end,
+                   vector<double>& dist, vector<int>& parent) {
+    dijkstraOnArrays<double, int>(numLocations, offset.data(), target.data(), weight.data(), start, end, dist, parent);
+}
+
+// Great-circle distance in km between two points given in degrees
+double haversineKm(double lat1, double lon1, double lat2, double lon2) {
+    const double radians = 3.141592653589793 / 180.0;
+    double dLat = (lat2 - lat1) * radians;
+    double dLon = (lon2 - lon1) * radians;
+    double a = sin(dLat / 2) * sin(dLat / 2) +
+               cos(lat1 * radians) * cos(lat2 * radians) * sin(dLon / 2) * sin(dLon / 2);
+    return 2.0 * 6371.0 * asin(min(1.0, sqrt(a)));
+}
+
+// A* over CSR arrays from start to end. lowerBound(v) must never overestimate the distance
+// from v to end. Nodes are reopened when a shorter path turns up, so a bound that is
+// admissible but not consistent still gives exact paths.
+template <typename LowerBound>
+void astarOnCSR(int numLocations, const vector<int>& offset, const vector<int>& target,
+                const vector<double>& weight, int start, int end, LowerBound lowerBound,
+                vector<double>& dist, vector<int>& parent) {
+    dist.assign(numLocations, numeric_limits<double>::infinity());
+    parent.assign(numLocations, -1);
+    vector<double> bound(numLocations, -1.0);   // lowerBound per node, evaluated once
+    auto boundOf = [&](int node) {
+        if (bound[node] < 0) bound[node] = lowerBound(node);
+        return bound[node];
+    };
+    priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> heap;
+    
+    dist[start] = 0;
+    heap.push({boundOf(start), start});
+    uint64_t settled = 0;
+    
+    while (!heap.empty()) {
+        pair<double, int> top = heap.top();
+        heap.pop();
+        int u = top.second;
+        if (top.first > dist[u] + boundOf(u)) continue; // Stale entry
+        settled++;
+        if (u == end) break;
+        
+        for (int e = offset[u]; e < offset[u + 1]; e++) {
+            int v = target[e];
+            double candidate = dist[u] + weight[e];
+            if (candidate < dist[v]) {
+                dist[v] = candidate;
+                parent[v] = u;
+                heap.push({candidate + boundOf(v), v});
+            }
+        }
+    }
+    METRIC_COUNT(COUNTER_ASTAR_RUNS, 1);
+    METRIC_COUNT(COUNTER_ASTAR_SETTLED, settled);
+}
+
+// Bidirectional Dijkstra over CSR arrays, with the in-arcs (reverse CSR) for the backward search
+vector<int> bidirectionalDijkstraOnCSR(int numLocations, const vector<int>& offset, const vector<int>& target,
+                                       const vector<double>& weight, const vector<int>& reverseOffset,
+                                       const vector<int>& reverseSource, const vector<double>& reverseWeight,
+                                       int start, int end) {
+    return bidirectionalOnArrays<double, int>(numLocations, offset.data(), target.data(), weight.data(),
+                                              reverseOffset.data(), reverseSource.data(), reverseWeight.data(),
+                                              start, end);
+}
+
+// ALT preprocessing (A*, landmarks, triangle inequality): exact distances from a few
+// landmarks on the rim of the graph. In an undirected graph |d(L,t) - d(L,v)| never
+// exceeds d(v,t), so the largest gap over all landmarks is an admissible A* bound.
+class LandmarkTable {
+private:
+    int numNodes;
+    vector<int> landmarks;
+    vector<double> distances;   // landmark-major: distances[l * numNodes + v]
+    
+    // Landmark l's row, filled by one full Dijkstra
+    void fillRow(int l, const vector<int>& offset, const vector<int>& target, const vector<double>& weight) {
+        vector<double> dist;
+        vector<int> parent;
+        dijkstraOnCSR(numNodes, offset, target, weight, landmarks[l], -1, dist, parent);
+        copy(dist.begin(), dist.end(), distances.begin() + (size_t)l * numNodes);
+    }
+    
+public:
+    LandmarkTable() : numNodes(0) {}
+    
+    // Pick up to `count` landmarks and compute their rows. With coordinates for most nodes,
+    // the farthest node from the centroid in each of `count` angular sectors is taken and
+    // the rows are computed in parallel. Otherwise landmarks are chosen by farthest-point
+    // selection, which needs each row before picking the next.
+    void build(int n, const vector<int>& offset, const vector<int>& target, const vector<double>& weight,
+               const vector<double>& latitude, const vector<double>& longitude, int count, int threads) {
+        numNodes = n;
+        landmarks.clear();
+        distances.clear();
+        if (n == 0 || count <= 0) return;
+        
+        int located = 0;
+        double centerLat = 0.0, centerLon = 0.0;
+        for (int v = 0; v < (int)latitude.size() && v < n; v++) {
+            if (isnan(latitude[v])) continue;
+            located++;
+            centerLat += latitude[v];
+            centerLon += longitude[v];
+        }
+        
+        if (located * 2 >= n) {
+            centerLat /= located;
+            centerLon /= located;
+            vector<int> farthest(count, -1);
+            vector<double> reach(count, -1.0);
+            for (int v = 0; v < (int)latitude.size() && v < n; v++) {
+                if (isnan(latitude[v])) continue;
+                double dy = latitude[v] - centerLat, dx = longitude[v] - centerLon;
+                int sector = min(count - 1, (int)((atan2(dy, dx) + 3.141592653589793) / (2 * 3.141592653589793) * count));
+                double radius = dx * dx + dy * dy;
+                if (radius > reach[sector]) {
+                    reach[sector] = radius;
+                    farthest[sector] = v;
+                }
+            }
+            for (int v : farthest) {
+                if (v != -1) landmarks.push_back(v);
+            }
+            distances.assign((size_t)landmarks.size() * n, numeric_limits<double>::infinity());
+            
+            if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+            threads = max(1, min(threads, (int)landmarks.size()));
+            atomic<int> nextRow(0);
+            vector<thread> workers;
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&]() {
+                    for (int l = nextRow++; l < (int)landmarks.size(); l = nextRow++) fillRow(l, offset, target, weight);
+                });
+            }
+            for (thread& worker : workers) worker.join();
+            return;
+        }
+        
+        // Farthest-point: start from the node farthest from node 0, then repeatedly take the
+        // reachable node whose nearest landmark is farthest away
+        vector<double> dist;
+        vector<int> parent;
+        dijkstraOnCSR(n, offset, target, weight, 0, -1, dist, parent);
+        vector<double> nearest(n, numeric_limits<double>::infinity());
+        int next = 0;
+        for (int v = 0; v < n; v++) {
+            if (dist[v] != numeric_limits<double>::infinity() && dist[v] > dist[next]) next = v;
+        }
+        distances.reserve((size_t)count * n);
+        while ((int)landmarks.size() < count && next != -1) {
+            landmarks.push_back(next);
+            distances.resize((size_t)landmarks.size() * n);
+            fillRow((int)landmarks.size() - 1, offset, target, weight);
+            
+            const double* row = &distances[(size_t)(landmarks.size() - 1) * n];
+            next = -1;
+            double best = 0.0;
+            for (int v = 0; v < n; v++) {
+                nearest[v] = min(nearest[v], row[v]);
+                if (row[v] != numeric_limits<double>::infinity() && nearest[v] > best) {
+                    best = nearest[v];
+                    next = v;
+                }
+            }
+        }
+    }
+    
+    // Admissible bound on the distance from v to t
+    double lowerBound(int v, int t) const {
+        double best = 0.0;
+        for (size_t l = 0; l < landmarks.size(); l++) {
+            const double* row = &distances[l * numNodes];
+            if (row[v] == numeric_limits<double>::infinity() || row[t] == numeric_limits<double>::infinity()) continue;
+            best = max(best, fabs(row[t] - row[v]));
+        }
+        return best;
+    }
+    
+    const vector<int>& getLandmarks() const { return landmarks; }
+};
+
+// One changed arc: weight is already updated in the CSR arrays, oldWeight is what it replaced
+struct ArcChange {
+    int from;
+    int to;
+    double oldWeight;
+    double newWeight;
+};
+
+// Bring a shortest-path tree up to date after arc weight changes instead of rebuilding it.
+// Raised tree arcs detach the subtree below them; those nodes are re-seeded from their
+// intact neighbours. Lowered arcs seed their heads. One Dijkstra pass from the seeds then
+// settles only nodes whose distance actually moves. Assumes an undirected graph, where a
+// node's in-arcs mirror its out-arcs. Returns the number of nodes settled.
+uint64_t repairShortestPathTree(const vector<int>& offset, const vector<int>& target,
+                                const vector<double>& weight, const vector<ArcChange>& changes,
+                                ShortestPathTree& tree) {
+    const double infinity = numeric_limits<double>::infinity();
+    const int DETACHED = -2;
+    vector<double>& dist = tree.dist;
+    vector<int>& parent = tree.parent;
+    priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> heap;
+    
+    // Detach every subtree hanging off a raised tree arc; children are found through the
+    // adjacency, so only the detached nodes and their neighbours are touched
+    vector<int> detached;
+    for (const ArcChange& change : changes) {
+        if (change.newWeight <= change.oldWeight || parent[change.to] != change.from) continue;
+        parent[change.to] = DETACHED;
+        detached.push_back(change.to);
+    }
+    for (size_t i = 0; i < detached.size(); i++) {
+        int node = detached[i];
+        for (int e = offset[node]; e < offset[node + 1]; e++) {
+            int child = target[e];
+            if (parent[child] == node) {
+                parent[child] = DETACHED;
+                detached.push_back(child);
+            }
+        }
+    }
+    for (int node : detached) dist[node] = infinity;
+    
+    // Best entry into each detached node from the intact part of the tree
+    vector<pair<double, int>> seeds(detached.size(), make_pair(infinity, -1));
+    for (size_t i = 0; i < detached.size(); i++) {
+        int node = detached[i];
+        for (int e = offset[node]; e < offset[node + 1]; e++) {
+            int neighbour = target[e];
+            if (parent[neighbour] == DETACHED || dist[neighbour] == infinity) continue;
+            double candidate = dist[neighbour] + weight[e];
+            if (candidate < seeds[i].first) seeds[i] = make_pair(candidate, neighbour);
+        }
+    }
+    for (size_t i = 0; i < detached.size(); i++) {
+        dist[detached[i]] = seeds[i].first;
+        parent[detached[i]] = seeds[i].second;
+        if (seeds[i].second != -1) heap.push({seeds[i].first, detached[i]});
+    }
+    
+    for (const ArcChange& change : changes) {
+        if (change.newWeight >= change.oldWeight || dist[change.from] == infinity) continue;
+        double candidate = dist[change.from] + change.newWeight;
+        if (candidate < dist[change.to]) {
+            dist[change.to] = candidate;
+            parent[change.to] = change.from;
+            heap.push({candidate, change.to});
+        }
+    }
+    
+    uint64_t settled = 0;
+    while (!heap.empty()) {
+        pair<double, int> top = heap.top();
+        heap.pop();
+        int u = top.second;
+        if (top.first > dist[u]) continue; // Stale entry
+        settled++;
+        for (int e = offset[u]; e < offset[u + 1]; e++) {
+            int v = target[e];
+            double candidate = dist[u] + weight[e];
+            if (candidate < dist[v]) {
+                dist[v] = candidate;
+                parent[v] = u;
+                heap.push({candidate, v});
+            }
+        }
+    }
+    METRIC_COUNT(COUNTER_TREE_REPAIRS, 1);
+    METRIC_COUNT(COUNTER_TREE_REPAIR_SETTLED, settled);
+    return settled;
+}
+
+// Immutable copy of the routing graph that any number of threads can query at once.
+// Trees for the sources named at creation are precomputed; other queries run a
+// private Dijkstra on the calling thread.
+class RoutingSnapshot {
+private:
+    int numLocations;
+    LocationRegistry locations;   // interned text, valid for the whole run
+    vector<int> offset;
+    vector<int> target;
+    vector<double> weight;
+    unordered_map<int, ShortestPathTree> trees;
+    
+public:
+    RoutingSnapshot(int count, const LocationRegistry& registry, const vector<int>& csrOffset,
+                    const vector<int>& csrTarget, const vector<double>& csrWeight,
+                    const vector<int>& treeSources)
+        : numLocations(count), locations(registry), offset(csrOffset), target(csrTarget),
+          weight(csrWeight) {
+        for (int source : treeSources) {
+            if (source < 0 || source >= numLocations) continue;
+            ShortestPathTree& tree = trees[source];
+            tree.source = source;
+            dijkstraOnCSR(numLocations, offset, target, weight, source, -1, tree.dist, tree.parent);
+        }
+    }
+    
+    // Shortest distance from start to end, -1 when unreachable
+    double routeDistance(int start, int end) const {
+        if (start < 0 || start >= numLocations || end < 0 || end >= numLocations) return -1.0;
+        
+        auto tree = trees.find(start);
+        if (tree != trees.end()) {
+            double d = tree->second.dist[end];
+            return d == numeric_limits<double>::infinity() ? -1.0 : d;
+        }
+        
+        vector<double> dist;
+        vector<int> parent;
+        dijkstraOnCSR(numLocations, offset, target, weight, start, end, dist, parent);
+        return dist[end] == numeric_limits<double>::infinity() ? -1.0 : dist[end];
+    }
+    
+    // Exact location name, or a zone name resolved to the zone's hub
+    int getLocationIndex(string_view name) const { return locations.resolve(name); }
+    
+    int getZoneHub(int zoneId) const { return locations.zoneHub(zoneId); }
+    
+    string getLocationName(int index) const {
+        if (!locations.name(index).empty()) return string(locations.name(index));
+        if (index >= 0 && index < numLocations) return "Location-" + to_string(index);
+        return "Unknown";
+    }
+};
+
+// Routing graph split into regions. Each region keeps its own renumbered CSR arrays over
+// its nodes and internal roads (forward and reverse), so a search inside a region touches
+// only that region's memory. Boundary nodes, those with a road to another region, form a
+// small overlay graph: the roads that cross regions, plus an edge between every two
+// boundary nodes of a region weighted by their shortest distance inside it. A query
+// searches locally around both ends and crosses the overlay only when a route through
+// another region could be shorter, so answers are exact. Batches of distance queries run
+// on one worker per region, each with its own scratch arrays.
+class RegionRouter {
+private:
+    struct Region {
+        vector<int> nodes;            // local -> global
+        vector<int> offset;           // local CSR over roads inside the region
+        vector<int> target;
+        vector<double> weight;
+        vector<int> reverseOffset;    // the same roads, reversed
+        vector<int> reverseSource;
+        vector<double> reverseWeight;
+        vector<int> boundary;         // local IDs of boundary nodes
+    };
+    
+    // Dijkstra state for one region at a time; reset through the touched list
+    struct LocalSearch {
+        vector<double> dist;
+        vector<int> parent;           // local predecessor, or successor for backward searches
+        vector<char> settled;
+        vector<int> touched;
+        
+        void reset() {
+            for (int node : touched) {
+                dist[node] = numeric_limits<double>::infinity();
+                parent[node] = -1;
+                settled[node] = 0;
+            }
+            touched.clear();
+        }
+    };
+    
+    int numNodes;
+    vector<int> regionOf;             // global -> region
+    vector<int> localOf;              // global -> index inside its region
+    vector<Region> regions;
+    int largestRegion;
+    
+    vector<int> overlayOf;            // global -> overlay node, -1 for interior nodes
+    vector<int> overlayNode;          // overlay -> global
+    vector<int> overlayOffset;
+    vector<int> overlayTarget;
+    vector<double> overlayWeight;
+    
+    // Search inside `region` from local node `source` over its forward or reversed roads
+    // until `stop(node, distance)` returns true for a settled node, or the region runs out
+    template <typename Stop>
+    void searchRegion(const Region& region, int source, bool backward, LocalSearch& search, Stop stop) const {
+        search.reset();
+        const vector<int>& offset = backward ? region.reverseOffset : region.offset;
+        const vector<int>& target = backward ? region.reverseSource : region.target;
+        const vector<double>& weight = backward ? region.reverseWeight : region.weight;
+        priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> heap;
+        search.dist[source] = 0.0;
+        search.touched.push_back(source);
+        heap.push({0.0, source});
+        while (!heap.empty()) {
+            pair<double, int> top = heap.top();
+            heap.pop();
+            int u = top.second;
+            if (search.settled[u]) continue;
+            search.settled[u] = 1;
+            if (stop(u, top.first)) return;
+            for (int e = offset[u]; e < offset[u + 1]; e++) {
+                int v = target[e];
+                double candidate = top.first + weight[e];
+                if (candidate < search.dist[v]) {
+                    if (search.dist[v] == numeric_limits<double>::infinity()) search.touched.push_back(v);
+                    search.dist[v] = candidate;
+                    search.parent[v] = u;
+                    heap.push({candidate, v});
+                }
+            }
+        }
+    }
+    
+    void prepare(LocalSearch& search) const {
+        search.dist.assign(largestRegion, numeric_limits<double>::infinity());
+        search.parent.assign(largestRegion, -1);
+        search.settled.assign(largestRegion, 0);
+        search.touched.clear();
+    }
+    
+    // Global nodes from `from` to `to` inside one region, both ends included
+    void appendLocalPath(const Region& region, int from, int to, LocalSearch& search, vector<int>& path) const {
+        searchRegion(region, from, false, search, [to](int node, double) { return node == to; });
+        vector<int> piece;
+        for (int node = to; node != -1; node = search.parent[node]) piece.push_back(region.nodes[node]);
+        path.insert(path.end(), piece.rbegin(), piece.rend());
+    }
+    
+    bool isBoundary(const Region& region, int local) const { return overlayOf[region.nodes[local]] != -1; }
+    
+    // Shortest distance from start to end; fills `path` (global nodes) when given
+    double query(int start, int end, LocalSearch& forward, LocalSearch& backward, vector<int>* path) const {
+        const double INF = numeric_limits<double>::infinity();
+        int startRegion = regionOf[start], endRegion = regionOf[end];
+        const Region& from = regions[startRegion];
+        const Region& to = regions[endRegion];
+        int source = localOf[start], sink = localOf[end];
+        auto localPath = [&]() {
+            path->clear();
+            for (int node = sink; node != -1; node = forward.parent[node]) path->push_back(from.nodes[node]);
+            reverse(path->begin(), path->end());
+        };
+        
+        // Same region: the local route wins unless leaving the region could beat it. Any
+        // route out costs at least the nearest boundary from start plus the nearest to end.
+        if (startRegion == endRegion) {
+            searchRegion(from, source, false, forward, [sink](int node, double) { return node == sink; });
+            double local = forward.dist[sink];
+            double nearestOut = local;
+            for (int b : from.boundary) {
+                if (forward.settled[b]) nearestOut = min(nearestOut, forward.dist[b]);
+            }
+            double nearestIn = INF;
+            if (!from.boundary.empty() && nearestOut < local) {
+                searchRegion(from, sink, true, backward, [&](int node, double distance) {
+                    if (distance >= local - nearestOut) return true;
+                    if (!isBoundary(from, node)) return false;
+                    nearestIn = distance;
+                    return true;
+                });
+            }
+            if (local <= nearestOut + nearestIn) {
+                if (path && local != INF) localPath();
+                return local;
+            }
+        }
+        
+        // Local searches around both ends, then the overlay between their boundaries. Nodes
+        // no closer than the local route cannot improve it, so within one region the forward
+        // search above already settled everything needed and the backward one stops there too.
+        double best = startRegion == endRegion ? forward.dist[sink] : INF;
+        if (startRegion != endRegion) searchRegion(from, source, false, forward, [](int, double) { return false; });
+        searchRegion(to, sink, true, backward, [best](int, double distance) { return distance >= best; });
+        int bestExit = -1;
+        
+        vector<double> dist(overlayNode.size(), INF);
+        vector<int> parent(overlayNode.size(), -1);
+        priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> heap;
+        for (int b : from.boundary) {
+            if (forward.dist[b] == INF) continue;
+            int node = overlayOf[from.nodes[b]];
+            dist[node] = forward.dist[b];
+            heap.push({dist[node], node});
+        }
+        while (!heap.empty() && heap.top().first < best) {
+            pair<double, int> top = heap.top();
+            heap.pop();
+            int u = top.second;
+            if (top.first > dist[u]) continue;
+            int global = overlayNode[u];
+            if (regionOf[global] == endRegion && backward.dist[localOf[global]] != INF &&
+                top.first + backward.dist[localOf[global]] < best) {
+                best = top.first + backward.dist[localOf[global]];
+                bestExit = u;
+            }
+            for (int e = overlayOffset[u]; e < overlayOffset[u + 1]; e++) {
+                int v = overlayTarget[e];
+                double candidate = top.first + overlayWeight[e];
+                if (candidate < dist[v]) {
+                    dist[v] = candidate;
+                    parent[v] = u;
+                    heap.push({candidate, v});
+                }
+            }
+        }
+        if (!path || best == INF) return best;
+        if (bestExit == -1) {
+            localPath();
+            return best;
+        }
+        
+        // Start -> first boundary, overlay hops (unpacking in-region edges), last boundary -> end
+        vector<int> hops;
+        for (int node = bestExit; node != -1; node = parent[node]) hops.push_back(overlayNode[node]);
+        reverse(hops.begin(), hops.end());
+        vector<int> tail;
+        for (int node = localOf[hops.back()]; node != -1; node = backward.parent[node]) tail.push_back(to.nodes[node]);
+        path->clear();
+        for (int node = localOf[hops[0]]; node != -1; node = forward.parent[node]) path->push_back(from.nodes[node]);
+        reverse(path->begin(), path->end());
+        for (size_t i = 1; i < hops.size(); i++) {
+            if (regionOf[hops[i - 1]] != regionOf[hops[i]]) {
+                path->push_back(hops[i]);
+                continue;
+            }
+            path->pop_back();
+            appendLocalPath(regions[regionOf[hops[i]]], localOf[hops[i - 1]], localOf[hops[i]], forward, *path);
+        }
+        path->insert(path->end(), tail.begin() + 1, tail.end());
+        return best;
+    }
+    
+public:
+    RegionRouter() : numNodes(0), largestRegion(0) {}
+    
+    // Split the graph along `regionAssignment` (node -> region, 0-based) and build the
+    // overlay; each region's overlay edges are computed on its own thread (threads = 0
+    // uses one per region). Closed roads are left out.
+    void build(int n, const vector<int>& offset, const vector<int>& target, const vector<double>& weight,
+               const vector<int>& regionAssignment, int threads = 0) {
+        const double INF = numeric_limits<double>::infinity();
+        numNodes = n;
+        regionOf = regionAssignment;
+        int count = n == 0 ? 0 : *max_element(regionOf.begin(), regionOf.end()) + 1;
+        regions.assign(count, Region());
+        localOf.assign(n, -1);
+        for (int v = 0; v < n; v++) {
+            localOf[v] = (int)regions[regionOf[v]].nodes.size();
+            regions[regionOf[v]].nodes.push_back(v);
+        }
+        largestRegion = 0;
+        for (const Region& region : regions) largestRegion = max(largestRegion, (int)region.nodes.size());
+        
+        overlayOf.assign(n, -1);
+        overlayNode.clear();
+        for (int u = 0; u < n; u++) {
+            for (int e = offset[u]; e < offset[u + 1]; e++) {
+                int v = target[e];
+                if (weight[e] == INF || regionOf[u] == regionOf[v]) continue;
+                for (int end : {u, v}) {
+                    if (overlayOf[end] != -1) continue;
+                    overlayOf[end] = (int)overlayNode.size();
+                    overlayNode.push_back(end);
+                }
+            }
+        }
+        
+        // Local CSR arrays, boundary lists and in-region overlay edges, one region per worker
+        vector<vector<pair<int, double>>> overlayEdges(overlayNode.size());
+        if (threads <= 0) threads = max(1, count);
+        threads = max(1, min(threads, count));
+        atomic<int> nextRegion(0);
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&]() {
+                LocalSearch search;
+                prepare(search);
+                for (int r = nextRegion++; r < count; r = nextRegion++) {
+                    Region& region = regions[r];
+                    int size = (int)region.nodes.size();
+                    region.offset.assign(size + 1, 0);
+                    region.reverseOffset.assign(size + 1, 0);
+                    for (int local = 0; local < size; local++) {
+                        int u = region.nodes[local];
+                        if (overlayOf[u] != -1) region.boundary.push_back(local);
+                        for (int e = offset[u]; e < offset[u + 1]; e++) {
+                            if (weight[e] == INF || regionOf[target[e]] != r) continue;
+                            region.offset[local + 1]++;
+                            region.reverseOffset[localOf[target[e]] + 1]++;
+                        }
+                    }
+                    for (int local = 0; local < size; local++) {
+                        region.offset[local + 1] += region.offset[local];
+                        region.reverseOffset[local + 1] += region.reverseOffset[local];
+                    }
+                    region.target.resize(region.offset[size]);
+                    region.weight.resize(region.offset[size]);
+                    region.reverseSource.resize(region.offset[size]);
+                    region.reverseWeight.resize(region.offset[size]);
+                    vector<int> slot(region.reverseOffset.begin(), region.reverseOffset.end() - 1);
+                    for (int local = 0, at = 0; local < size; local++) {
+                        int u = region.nodes[local];
+                        for (int e = offset[u]; e < offset[u + 1]; e++) {
+                            if (weight[e] == INF || regionOf[target[e]] != r) continue;
+                            int head = localOf[target[e]];
+                            region.target[at] = head;
+                            region.weight[at++] = weight[e];
+                            region.reverseSource[slot[head]] = local;
+                            region.reverseWeight[slot[head]++] = weight[e];
+                        }
+                    }
+                    
+                    // Shortest in-region distance between boundary nodes, skipping pairs whose
+                    // shortest path already runs through a third boundary node: the two shorter
+                    // overlay edges cover it, which keeps the overlay far below a full clique
+                    for (int b : region.boundary) {
+                        searchRegion(region, b, false, search, [](int, double) { return false; });
+                        vector<pair<int, double>>& edges = overlayEdges[overlayOf[region.nodes[b]]];
+                        for (int other : region.boundary) {
+                            double distance = search.dist[other];
+                            if (other == b || distance == INF) continue;
+                            bool covered = false;
+                            for (int node = search.parent[other]; node != b && !covered; node = search.parent[node]) {
+                                covered = isBoundary(region, node) && search.dist[node] > 0 && search.dist[node] < distance;
+                            }
+                            if (!covered) edges.push_back({overlayOf[region.nodes[other]], distance});
+                        }
+                    }
+                }
+            });
+        }
+        for (thread& worker : workers) worker.join();
+        
+        // Roads between regions join the overlay as they are
+        for (int u : overlayNode) {
+            for (int e = offset[u]; e < offset[u + 1]; e++) {
+                int v = target[e];
+                if (weight[e] != INF && regionOf[u] != regionOf[v]) {
+                    overlayEdges[overlayOf[u]].push_back({overlayOf[v], weight[e]});
+                }
+            }
+        }
+        overlayOffset.assign(overlayNode.size() + 1, 0);
+        overlayTarget.clear();
+        overlayWeight.clear();
+        for (size_t node = 0; node < overlayNode.size(); node++) {
+            for (const pair<int, double>& edge : overlayEdges[node]) {
+                overlayTarget.push_back(edge.first);
+                overlayWeight.push_back(edge.second);
+            }
+            overlayOffset[node + 1] = (int)overlayTarget.size();
+        }
+    }
+    
+    // Node IDs from start to end, empty when unreachable
+    vector<int> findPath(int start, int end) const {
+        vector<int> path;
+        if (start < 0 || start >= numNodes || end < 0 || end >= numNodes) return path;
+        LocalSearch forward, backward;
+        prepare(forward);
+        prepare(backward);
+        query(start, end, forward, backward, &path);
+        return path;
+    }
+    
+    // Distance for every (start, end) query, infinity when unreachable. Queries are bucketed
+    // by their start's region and each region's bucket runs on one worker with its own
+    // scratch (threads = 0 gives every region its own worker).
+    vector<double> distances(const vector<pair<int, int>>& queries, int threads = 0) const {
+        vector<double> result(queries.size(), numeric_limits<double>::infinity());
+        vector<vector<int>> bucket(regions.size());
+        for (size_t q = 0; q < queries.size(); q++) {
+            int start = queries[q].first, end = queries[q].second;
+            if (start < 0 || start >= numNodes || end < 0 || end >= numNodes) continue;
+            bucket[regionOf[start]].push_back((int)q);
+        }
+        
+        int count = (int)regions.size();
+        if (threads <= 0) threads = count;
+        threads = max(1, min(threads, count));
+        atomic<int> nextRegion(0);
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&]() {
+                LocalSearch forward, backward;
+                prepare(forward);
+                prepare(backward);
+                for (int r = nextRegion++; r < count; r = nextRegion++) {
+                    for (int q : bucket[r]) result[q] = query(queries[q].first, queries[q].second, forward, backward, nullptr);
+                }
+            });
+        }
+        for (thread& worker : workers) worker.join();
+        return result;
+    }
+    
+    int getRegionCount() const { return (int)regions.size(); }
+    
+    int getRegionOf(int node) const { return node >= 0 && node < numNodes ? regionOf[node] : -1; }
+    
+    int getOverlayNodeCount() const { return (int)overlayNode.size(); }
+    
+    int getOverlayEdgeCount() const { return (int)overlayTarget.size(); }
+};
+
+enum RoutingBackend {
+    ROUTE_DIJKSTRA,
+    ROUTE_CONTRACTION_HIERARCHY,
+    ROUTE_ASTAR,   // A* with a great-circle bound from node coordinates
+    ROUTE_ALT,     // A* with landmark bounds
+    ROUTE_BIDIRECTIONAL,
+    ROUTE_REGIONS,      // per-region searches joined by the boundary overlay
+    ROUTE_FIXED_POINT   // radix-heap Dijkstra on a decimetre copy of the graph
+};
+
+// Backend named on the command line: dijkstra, ch, astar, alt, bidirectional, regions or fixed
+bool parseRoutingBackend(const string& name, RoutingBackend& mode) {
+    static const pair<const char*, RoutingBackend> names[] = {
+        {"dijkstra", ROUTE_DIJKSTRA}, {"ch", ROUTE_CONTRACTION_HIERARCHY}, {"astar", ROUTE_ASTAR},
+        {"alt", ROUTE_ALT}, {"bidirectional", ROUTE_BIDIRECTIONAL}, {"regions", ROUTE_REGIONS},
+        {"fixed", ROUTE_FIXED_POINT}};
+    for (const auto& entry : names) {
+        if (name == entry.first) {
+            mode = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct RouteCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stale;         // misses on an entry from an older graph version or another backend
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+    size_t capacity;        // bytes; 0 when disabled
+};
+
+// Bounded LRU cache of shortest paths and their costs, keyed by (from, to) and tagged with
+// a version: SparseMatrix passes the graph version and the backend they were found with. A
+// lookup only hits an entry of the current version, so any graph change or backend switch
+// invalidates the whole cache in O(1); stale entries are overwritten
+// or age out. Keys are spread over shards, each with its own lock, LRU list and share of
+// the byte budget, so concurrent readers rarely contend.
+class RouteCache {
+private:
+    static constexpr int SHARD_COUNT = 16;
+    static constexpr size_t ENTRY_OVERHEAD = 48;    // hash node and bucket per entry, roughly
+    
+    struct Entry {
+        uint64_t key;
+        long long version;
+        double cost;
+        vector<int> path;
+        size_t bytes;
+        int prev;       // towards the most recently used entry, -1 at the head
+        int next;
+    };
+    
+    struct Shard {
+        mutex lock;
+        unordered_map<uint64_t, int> slotOf;
+        vector<Entry> entries;
+        vector<int> freeSlots;
+        int head;       // most recently used
+        int tail;       // evicted first
+        size_t bytes;
+        uint64_t hits, misses, stale, evictions;
+        
+        Shard() : head(-1), tail(-1), bytes(0), hits(0), misses(0), stale(0), evictions(0) {}
+    };
+    
+    Shard shards[SHARD_COUNT];
+    atomic<size_t> shardBudget;     // bytes per shard
+    
+    static uint64_t keyOf(int from, int to) { return (uint64_t)(uint32_t)from << 32 | (uint32_t)to; }
+    
+    Shard& shardOf(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return shards[key % SHARD_COUNT];
+    }
+    
+    static void unlink(Shard& shard, int slot) {
+        Entry& entry = shard.entries[slot];
+        if (entry.prev != -1) shard.entries[entry.prev].next = entry.next;
+        else shard.head = entry.next;
+        if (entry.next != -1) shard.entries[entry.next].prev = entry.prev;
+        else shard.tail = entry.prev;
+    }
+    
+    static void pushFront(Shard& shard, int slot) {
+        Entry& entry = shard.entries[slot];
+        entry.prev = -1;
+        entry.next = shard.head;
+        if (shard.head != -1) shard.entries[shard.head].prev = slot;
+        shard.head = slot;
+        if (shard.tail == -1) shard.tail = slot;
+    }
+    
+    static void trim(Shard& shard, size_t budget) {
+        while (shard.bytes > budget && shard.tail != -1) {
+            int slot = shard.tail;
+            Entry& entry = shard.entries[slot];
+            unlink(shard, slot);
+            shard.slotOf.erase(entry.key);
+            shard.bytes -= entry.bytes;
+            vector<int>().swap(entry.path);
+            shard.freeSlots.push_back(slot);
+            shard.evictions++;
+            METRIC_COUNT(COUNTER_ROUTE_CACHE_EVICTIONS, 1);
+        }
+    }
+    
+    // Entry for key at the current version, moved to the front; nullptr (counted as a miss) if none
+    Entry* find(Shard& shard, uint64_t key, long long version) {
+        auto it = shard.slotOf.find(key);
+        if (it == shard.slotOf.end() || shard.entries[it->second].version != version) {
+            if (it != shard.slotOf.end()) shard.stale++;
+            shard.misses++;
+            METRIC_COUNT(COUNTER_ROUTE_CACHE_MISSES, 1);
+            return nullptr;
+        }
+        shard.hits++;
+        METRIC_COUNT(COUNTER_ROUTE_CACHE_HITS, 1);
+        unlink(shard, it->second);
+        pushFront(shard, it->second);
+        return &shard.entries[it->second];
+    }
+    
+public:
+    explicit RouteCache(size_t capacityBytes) : shardBudget(capacityBytes / SHARD_COUNT) {}
+    
+    RouteCache(const RouteCache&) = delete;
+    RouteCache& operator=(const RouteCache&) = delete;
+    
+    // Shortest path and cost from `from` to `to` on graph `version`, if cached
+    bool lookup(int from, int to, long long version, vector<int>& path, double& cost) {
+        if (shardBudget.load(memory_order_relaxed) == 0) return false;
+        uint64_t key = keyOf(from, to);
+        Shard& shard = shardOf(key);
+        lock_guard<mutex> guard(shard.lock);
+        Entry* entry = find(shard, key, version);
+        if (!entry) return false;
+        path = entry->path;
+        cost = entry->cost;
+        return true;
+    }
+    
+    // Cost of `path` if it is exactly the cached shortest path between its ends
+    bool lookupCost(const vector<int>& path, long long version, double& cost) {
+        if (path.size() < 2 || shardBudget.load(memory_order_relaxed) == 0) return false;
+        uint64_t key = keyOf(path.front(), path.back());
+        Shard& shard = shardOf(key);
+        lock_guard<mutex> guard(shard.lock);
+        Entry* entry = find(shard, key, version);
+        if (!entry || entry->path != path) return false;
+        cost = entry->cost;
+        return true;
+    }
+    
+    // Cache a path (empty when unreachable) and its cost, evicting least recently used entries
+    void store(int from, int to, long long version, const vector<int>& path, double cost) {
+        size_t budget = shardBudget.load(memory_order_relaxed);
+        size_t bytes = sizeof(Entry) + ENTRY_OVERHEAD + path.size() * sizeof(int);
+        if (bytes > budget) return;
+        uint64_t key = keyOf(from, to);
+        Shard& shard = shardOf(key);
+        lock_guard<mutex> guard(shard.lock);
+        
+        int slot;
+        auto it = shard.slotOf.find(key);
+        if (it != shard.slotOf.end()) {
+            slot = it->second;
+            unlink(shard, slot);
+            shard.bytes -= shard.entries[slot].bytes;
+        } else {
+            if (shard.freeSlots.empty()) {
+                slot = (int)shard.entries.size();
+                shard.entries.emplace_back();
+            } else {
+                slot = shard.freeSlots.back();
+                shard.freeSlots.pop_back();
+            }
+            shard.slotOf[key] = slot;
+        }
+        Entry& entry = shard.entries[slot];
+        entry.key = key;
+        entry.version = version;
+        entry.cost = cost;
+        entry.path = path;
+        entry.bytes = bytes;
+        pushFront(shard, slot);
+        shard.bytes += bytes;
+        trim(shard, budget);
+    }
+    
+    // Change the byte budget, evicting down to it at once; 0 empties and disables the cache
+    void setCapacity(size_t capacityBytes) {
+        size_t budget = capacityBytes / SHARD_COUNT;
+        shardBudget.store(budget, memory_order_relaxed);
+        for (Shard& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            trim(shard, budget);
+        }
+    }
+    
+    RouteCacheStats getStats() {
+        RouteCacheStats stats = {0, 0, 0, 0, 0, 0, shardBudget.load(memory_order_relaxed) * SHARD_COUNT};
+        for (Shard& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            stats.hits += shard.hits;
+            stats.misses += shard.misses;
+            stats.stale += shard.stale;
+            stats.evictions += shard.evictions;
+            stats.entries += shard.slotOf.size();
+            stats.bytes += shard.bytes;
+        }
+        return stats;
+    }
+};
+
+// One change from a traffic feed: the road between from and to now takes `distance` km
+// in both directions. Infinity closes the road; a finite distance on a missing road opens it.
+struct EdgeUpdate {
+    int from;
+    int to;
+    double distance;
+};
+
+class SparseMatrix {
+private:
+    int numLocations;
+    LocationRegistry locations;
+    vector<int> freeLocations;     // removed nodes, reused by addLocation
+    SparseNode** rows;
+    ObjectPool<SparseNode> nodePool;
+    
+    // Compressed sparse row adjacency. Edges from addEdge wait in the per-row lists
+    // until the next query, then get merged into the contiguous arrays and freed.
+    vector<int> csrOffset;
+    vector<int> csrTarget;
+    vector<double> csrWeight;
+    bool csrDirty;
+    long long graphVersion;
+    
+    // Shortest-path trees per source, dropped whenever the graph changes
+    unordered_map<int, ShortestPathTree> treeCache;
+    
+    // Point-to-point paths and costs, valid for the graph version they were found on
+    RouteCache routeCache;
+    
+    RoutingBackend backend;
+    ContractionHierarchy hierarchy;
+    long long hierarchyVersion;  // graph version the hierarchy matches, -1 if none
+    
+    // Optional coordinates in degrees, NaN when unknown
+    vector<double> latitude;
+    vector<double> longitude;
+    double geoScale;             // km of road per great-circle km, at most; 0 disables the bound
+    long long geoScaleVersion;   // graph version geoScale was computed for, -1 if none
+    
+    LandmarkTable landmarks;
+    long long landmarkVersion;   // graph version the landmark rows match, -1 if none
+    
+    RegionRouter regionRouter;
+    long long regionVersion;     // graph version the region split matches, -1 if none
+    
+    // In-arcs per node (reverse CSR) for backward searches, rebuilt when the graph changes.
+    // Every edge is stored in both directions today, but the backward search never relies on it.
+    vector<int> reverseOffset;
+    vector<int> reverseSource;
+    vector<double> reverseWeight;
+    long long reverseVersion;    // graph version the reverse arrays match, -1 if none
+    
+    // Read-only decimetre copy for ROUTE_FIXED_POINT, exported once per graph version
+    FixedPointRoadGraph fixedPointGraph;
+    long long fixedPointVersion; // graph version the copy matches, -1 if none
+    
+    bool hasCoordinates(int node) {
+        return node < (int)latitude.size() && !isnan(latitude[node]);
+    }
+    
+    // The largest factor that keeps the great-circle bound below every road's length,
+    // so A* stays exact whatever the units and detours of the weights. A path through a
+    // node without coordinates can be shorter than any scaled bound, so the bound is
+    // disabled (0) unless every node on an open road is located.
+    double ensureGeoScale() {
+        ensureCSR();
+        if (geoScaleVersion == graphVersion) return geoScale;
+        geoScale = numeric_limits<double>::infinity();
+        for (int u = 0; u < numLocations && geoScale > 0; u++) {
+            if (!hasCoordinates(u)) {
+                for (int e = csrOffset[u]; e < csrOffset[u + 1]; e++) {
+                    if (csrWeight[e] != numeric_limits<double>::infinity()) geoScale = 0.0;
+                }
+                continue;
+            }
+            for (int e = csrOffset[u]; e < csrOffset[u + 1]; e++) {
+                int v = csrTarget[e];
+                if (!hasCoordinates(v) || csrWeight[e] == numeric_limits<double>::infinity()) continue;
+                double crow = haversineKm(latitude[u], longitude[u], latitude[v], longitude[v]);
+                if (crow > 0) geoScale = min(geoScale, csrWeight[e] / crow);
+            }
+        }
+        // Shave a little off so rounding never pushes the bound above the true distance
+        geoScale = geoScale == numeric_limits<double>::infinity() ? 0.0 : geoScale * (1.0 - 1e-9);
+        geoScaleVersion = graphVersion;
+        return geoScale;
+    }
+    
+    void ensureCSR() {
+        if (!csrDirty) return;
+        
+        vector<int> offset(numLocations + 1, 0);
+        for (int i = 0; i < numLocations; i++) {
+            int degree = csrOffset.empty() ? 0 : csrOffset[i + 1] - csrOffset[i];
+            for (SparseNode* current = rows[i]; current; current = current->next) degree++;
+            offset[i + 1] = offset[i] + degree;
+        }
+        
+        // Newest edges first, matching the order of the adjacency lists
+        vector<int> target(offset[numLocations]);
+        vector<double> weight(offset[numLocations]);
+        for (int i = 0; i < numLocations; i++) {
+            int slot = offset[i];
+            SparseNode* current = rows[i];
+            while (current) {
+                target[slot] = current->col;
+                weight[slot] = current->distance;
+                slot++;
+                SparseNode* temp = current;
+                current = current->next;
+                nodePool.destroy(temp);
+            }
+            rows[i] = nullptr;
+            if (!csrOffset.empty()) {
+                for (int e = csrOffset[i]; e < csrOffset[i + 1]; e++) {
+                    target[slot] = csrTarget[e];
+                    weight[slot] = csrWeight[e];
+                    slot++;
+                }
+            }
+        }
+        
+        csrOffset.swap(offset);
+        csrTarget.swap(target);
+        csrWeight.swap(weight);
+        csrDirty = false;
+    }
+    
+    void ensureReverseCSR() {
+        ensureCSR();
+        if (reverseVersion == graphVersion) return;
+        reverseOffset.assign(numLocations + 1, 0);
+        for (int target : csrTarget) reverseOffset[target + 1]++;
+        for (int i = 0; i < numLocations; i++) reverseOffset[i + 1] += reverseOffset[i];
+        reverseSource.resize(csrTarget.size());
+        reverseWeight.resize(csrTarget.size());
+        vector<int> slot(reverseOffset.begin(), reverseOffset.end() - 1);
+        for (int u = 0; u < numLocations; u++) {
+            for (int e = csrOffset[u]; e < csrOffset[u + 1]; e++) {
+                int at = slot[csrTarget[e]]++;
+                reverseSource[at] = u;
+                reverseWeight[at] = csrWeight[e];
+            }
+        }
+        reverseVersion = graphVersion;
+    }
+    
+    // False when the graph is too big for 32-bit indices; queries then fall back to Dijkstra
+    bool ensureFixedPointGraph() {
+        ensureCSR();
+        if (fixedPointVersion != graphVersion && exportGraph(fixedPointGraph)) fixedPointVersion = graphVersion;
+        return fixedPointVersion == graphVersion;
+    }
+    
+    void runDijkstra(int start, int end, vector<double>& dist, vector<int>& parent) {
+        ensureCSR();
+        dijkstraOnCSR(numLocations, csrOffset, csrTarget, csrWeight, start, end, dist, parent);
+    }
+    
+    // Hop-count BFS over open roads from every node with label[node] != -1, labelling the
+    // rest with the region of whichever source reaches them first; returns hops per node
+    vector<int> growRegions(vector<int>& label) {
+        vector<int> hops(numLocations, -1);
+        vector<int> frontier;
+        for (int v = 0; v < numLocations; v++) {
+            if (label[v] != -1) {
+                hops[v] = 0;
+                frontier.push_back(v);
+            }
+        }
+        for (size_t head = 0; head < frontier.size(); head++) {
+            int u = frontier[head];
+            for (int e = csrOffset[u]; e < csrOffset[u + 1]; e++) {
+                int v = csrTarget[e];
+                if (hops[v] != -1 || csrWeight[e] == numeric_limits<double>::infinity()) continue;
+                hops[v] = hops[u] + 1;
+                label[v] = label[u];
+                frontier.push_back(v);
+            }
+        }
+        return hops;
+    }
+    
+    // Region per node: one per zone when count is 0 and zones exist (unzoned nodes join the
+    // nearest zone by hops), otherwise `count` regions grown from spread-out seed nodes
+    vector<int> partitionRegions(int count) {
+        vector<int> label(numLocations, -1);
+        if (count <= 0) {
+            unordered_map<int, int> regionOfZone;
+            for (int v = 0; v < numLocations; v++) {
+                int zone = locations.zoneOf(v);
+                if (zone == -1) continue;
+                auto it = regionOfZone.emplace(zone, (int)regionOfZone.size()).first;
+                label[v] = it->second;
+            }
+            if (regionOfZone.empty()) count = 8;
+        }
+        if (count > 0) {
+            // Each seed is the node farthest in hops from the seeds so far; another component
+            // gets a seed only once every node reachable from the existing seeds is one
+            count = max(1, min(count, numLocations));
+            vector<int> seeds = {0};
+            while ((int)seeds.size() < count) {
+                vector<int> mark(numLocations, -1);
+                for (int seed : seeds) mark[seed] = 0;
+                vector<int> hops = growRegions(mark);
+                int farthest = -1, unreached = -1;
+                for (int v = 0; v < numLocations; v++) {
+                    if (hops[v] > 0 && (farthest == -1 || hops[v] > hops[farthest])) farthest = v;
+                    if (hops[v] == -1 && unreached == -1) unreached = v;
+                }
+                seeds.push_back(farthest != -1 ? farthest : unreached);
+            }
+            label.assign(numLocations, -1);
+            for (int r = 0; r < count; r++) label[seeds[r]] = r;
+        }
+        growRegions(label);
+        for (int& region : label) {
+            if (region == -1) region = 0;   // islands no seed reaches
+        }
+        return label;
+    }
+    
+public:
+    static constexpr size_t DEFAULT_ROUTE_CACHE_BYTES = 16 << 20;
+    
+    SparseMatrix(int count) : numLocations(count), csrDirty(true), graphVersion(0),
+          routeCache(DEFAULT_ROUTE_CACHE_BYTES), backend(ROUTE_DIJKSTRA), hierarchyVersion(-1), geoScale(0.0), geoScaleVersion(-1),
+          landmarkVersion(-1), regionVersion(-1), reverseVersion(-1), fixedPointVersion(-1) {
+        rows = new SparseNode*[numLocations];
+        for (int i = 0; i < numLocations; i++) {
+            rows[i] = nullptr;
+        }
+        
+        // Initialize location names; each zone's center comes first and becomes its hub
+        static const char* const defaults[][2] = {
+            {"Zone-A-Center", "Zone-A"}, {"Zone-A-East", "Zone-A"}, {"Zone-A-West", "Zone-A"},
+            {"Zone-B-Center", "Zone-B"}, {"Zone-B-North", "Zone-B"}, {"Zone-B-South", "Zone-B"},
+            {"Zone-C-Center", "Zone-C"}, {"Zone-C-East", "Zone-C"}, {"Zone-C-West", "Zone-C"},
+            {"Warehouse", ""}
+        };
+        for (int i = 0; i < 10 && i < numLocations; i++) {
+            locations.assign(i, defaults[i][0], defaults[i][1]);
+        }
+    }
+    
+    // Register a new location and return its node ID, or -1 if the name or external ID
+    // is taken. Nodes freed by removeLocation are reused before the graph grows.
+    int addLocation(string_view name, string_view zone = string_view(), long long externalId = -1) {
+        if (name.empty() || locations.findByName(name) != -1 ||
+            (externalId >= 0 && locations.findByExternalId(externalId) != -1)) {
+            return -1;
+        }
+        
+        int node;
+        if (!freeLocations.empty()) {
+            node = freeLocations.back();
+            freeLocations.pop_back();
+        } else {
+            node = numLocations++;
+            SparseNode** grown = new SparseNode*[numLocations];
+            for (int i = 0; i < node; i++) grown[i] = rows[i];
+            grown[node] = nullptr;
+            delete[] rows;
+            rows = grown;
+            if (!csrOffset.empty()) csrOffset.push_back(csrOffset.back());
+            graphVersion++;
+            treeCache.clear();
+        }
+        locations.assign(node, name, zone, externalId);
+        return node;
+    }
+    
+    // Name an existing node that has no name yet (e.g. one of a generated graph)
+    bool nameLocation(int node, string_view name, string_view zone = string_view(), long long externalId = -1) {
+        return node >= 0 && node < numLocations && locations.assign(node, name, zone, externalId);
+    }
+    
+    // Unregister a location and drop every edge into or out of it. The node ID is kept
+    // as an isolated node until addLocation hands it out again.
+    bool removeLocation(int node) {
+        if (node < 0 || node >= numLocations || locations.name(node).empty()) return false;
+        locations.remove(node);
+        
+        ensureCSR();
+        size_t kept = 0;
+        vector<int> offset(numLocations + 1, 0);
+        for (int i = 0; i < numLocations; i++) {
+            for (int e = csrOffset[i]; e < csrOffset[i + 1]; e++) {
+                if (i == node || csrTarget[e] == node) continue;
+                csrTarget[kept] = csrTarget[e];
+                csrWeight[kept] = csrWeight[e];
+                kept++;
+            }
+            offset[i + 1] = (int)kept;
+        }
+        csrTarget.resize(kept);
+        csrWeight.resize(kept);
+        csrOffset.swap(offset);
+        
+        freeLocations.push_back(node);
+        graphVersion++;
+        treeCache.clear();
+        return true;
+    }
+    
+    void addEdge(int from, int to, double distance) {
+        if (from < 0 || from >= numLocations || to < 0 || to >= numLocations) {
+            return;
+        }
+        
+        // Add to sparse matrix
+        SparseNode* newNode = nodePool.create(from, to, distance);
+        newNode->next = rows[from];
+        rows[from] = newNode;
+        
+        // Also add reverse edge (undirected graph)
+        SparseNode* reverseNode = nodePool.create(to, from, distance);
+        reverseNode->next = rows[to];
+        rows[to] = reverseNode;
+        
+        csrDirty = true;
+        graphVersion++;
+        treeCache.clear();
+    }
+    
+    // Apply a batch of road changes. Cached shortest-path trees are repaired in place,
+    // touching only the nodes whose distance changes, instead of being recomputed; a
+    // Contraction Hierarchies index goes stale and queries fall back to Dijkstra. When a
+    // batch touches one road more than once the last update wins. Returns how many roads changed.
+    int updateEdges(const vector<EdgeUpdate>& updates) {
+        ensureCSR();
+        const double infinity = numeric_limits<double>::infinity();
+        // One update per road, the last one in the batch winning, so a road opened earlier in
+        // the batch is never searched for in the CSR before it has been merged
+        vector<EdgeUpdate> roads;
+        unordered_map<uint64_t, size_t> roadIndex;
+        for (const EdgeUpdate& update : updates) {
+            if (update.from < 0 || update.from >= numLocations || update.to < 0 ||
+                update.to >= numLocations || update.from == update.to || !(update.distance >= 0)) {
+                continue;
+            }
+            uint64_t key = (uint64_t)min(update.from, update.to) << 32 | (uint32_t)max(update.from, update.to);
+            auto inserted = roadIndex.emplace(key, roads.size());
+            if (inserted.second) roads.push_back(update);
+            else roads[inserted.first->second].distance = update.distance;
+        }
+        
+        vector<ArcChange> changes;
+        int changedRoads = 0;
+        bool opened = false;
+        for (const EdgeUpdate& update : roads) {
+            size_t before = changes.size();
+            bool found = false;
+            for (int direction = 0; direction < 2; direction++) {
+                int u = direction == 0 ? update.from : update.to;
+                int v = direction == 0 ? update.to : update.from;
+                for (int e = csrOffset[u]; e < csrOffset[u + 1]; e++) {
+                    if (csrTarget[e] != v) continue;
+                    found = true;
+                    if (csrWeight[e] != update.distance) {
+                        changes.push_back({u, v, csrWeight[e], update.distance});
+                        csrWeight[e] = update.distance;
+                    }
+                }
+            }
+            if (!found && update.distance != infinity) {
+                // New road: queue both arcs for the CSR merge, like addEdge
+                for (int direction = 0; direction < 2; direction++) {
+                    int u = direction == 0 ? update.from : update.to;
+                    int v = direction == 0 ? update.to : update.from;
+                    SparseNode* node = nodePool.create(u, v, update.distance);
+                    node->next = rows[u];
+                    rows[u] = node;
+                    changes.push_back({u, v, infinity, update.distance});
+                }
+                csrDirty = true;
+                opened = true;
+            }
+            if (changes.size() > before) changedRoads++;
+        }
+        if (changes.empty()) return 0;
+        if (opened) ensureCSR();
+        
+        // Trees built for the previous version are repaired; older ones are rebuilt on demand
+        graphVersion++;
+        for (auto& entry : treeCache) {
+            ShortestPathTree& tree = entry.second;
+            if (tree.graphVersion != graphVersion - 1) continue;
+            repairShortestPathTree(csrOffset, csrTarget, csrWeight, changes, tree);
+            tree.graphVersion = graphVersion;
+        }
+        return changedRoads;
+    }
+    
+    double getDistance(int from, int to) {
+        if (from == to) return 0.0;
+        if (from < 0 || from >= numLocations) return -1.0;
+        
+        ensureCSR();
+        for (int e = csrOffset[from]; e < csrOffset[from + 1]; e++) {
+            if (csrTarget[e] == to && csrWeight[e] != numeric_limits<double>::infinity()) {
+                return csrWeight[e];
+            }
+        }
+        return -1.0; // No connection, or the road is closed
+    }
+    
+    // Route cache entries are tagged with the graph version and the backend that found them,
+    // so neither a graph change nor a backend switch hands back another search's path
+    long long routeCacheTag() const { return graphVersion << 4 | (long long)backend; }
+    
+    // Shortest path through the selected backend (binary-heap Dijkstra over the CSR arrays by
+    // default), answered from the route cache when this backend searched this pair on the
+    // current graph
+    vector<int> findShortestPath(int start, int end) {
+        METRIC_TIMER(HIST_FIND_SHORTEST_PATH);
+        vector<int> path;
+        if (start < 0 || start >= numLocations || end < 0 || end >= numLocations) {
+            return path;
+        }
+        double cost;
+        if (routeCache.lookup(start, end, routeCacheTag(), path, cost)) return path;
+        path = searchShortestPath(start, end);
+        routeCache.store(start, end, routeCacheTag(), path, path.empty() ? -1.0 : sumRouteCost(path));
+        return path;
+    }
+    
+    // The search behind findShortestPath, bypassing the route cache
+    vector<int> searchShortestPath(int start, int end) {
+        vector<int> path;
+        
+        // A hierarchy, landmark table or region split built for an older graph version falls back to Dijkstra
+        if (backend == ROUTE_CONTRACTION_HIERARCHY && hierarchyVersion == graphVersion) {
+            return hierarchy.query(start, end);
+        }
+        if (backend == ROUTE_REGIONS && regionVersion == graphVersion) {
+            return regionRouter.findPath(start, end);
+        }
+        if (backend == ROUTE_BIDIRECTIONAL) {
+            ensureReverseCSR();
+            return bidirectionalDijkstraOnCSR(numLocations, csrOffset, csrTarget, csrWeight, reverseOffset,
+                                              reverseSource, reverseWeight, start, end);
+        }
+        if (backend == ROUTE_FIXED_POINT && ensureFixedPointGraph()) {
+            vector<uint32_t> found = fixedPointGraph.shortestPath((uint32_t)start, (uint32_t)end);
+            return vector<int>(found.begin(), found.end());
+        }
+        
+        vector<double> dist;
+        vector<int> parent;
+        ensureCSR();
+        if (backend == ROUTE_ASTAR) {
+            double scale = ensureGeoScale();
+            bool located = hasCoordinates(end);
+            astarOnCSR(numLocations, csrOffset, csrTarget, csrWeight, start, end, [&](int node) {
+                if (!located || !hasCoordinates(node)) return 0.0;
+                return scale * haversineKm(latitude[node], longitude[node], latitude[end], longitude[end]);
+            }, dist, parent);
+        } else if (backend == ROUTE_ALT && landmarkVersion == graphVersion) {
+            astarOnCSR(numLocations, csrOffset, csrTarget, csrWeight, start, end,
+                       [&](int node) { return landmarks.lowerBound(node, end); }, dist, parent);
+        } else {
+            runDijkstra(start, end, dist, parent);
+        }
+        
+        // Reconstruct path
+        if (dist[end] == numeric_limits<double>::infinity()) {
+            return path; // No path found
+        }
+        
+        int current = end;
+        while (current != -1) {
+            path.push_back(current);
+            current = parent[current];
+        }
+        reverse(path.begin(), path.end());
+        return path;
+    }
+    
+    // Adjacency as CSR arrays, with pending edges merged in first
+    const vector<int>& getCSROffset() { ensureCSR(); return csrOffset; }
+    const vector<int>& getCSRTarget() { ensureCSR(); return csrTarget; }
+    const vector<double>& getCSRWeight() { ensureCSR(); return csrWeight; }
+    
+    // Bytes held by the CSR arrays, comparable with RoutingGraph::memoryBytes
+    size_t getGraphBytes() {
+        ensureCSR();
+        return (csrOffset.capacity() + csrTarget.capacity()) * sizeof(int) + csrWeight.capacity() * sizeof(double);
+    }
+    
+    // Copy the current graph into a compile-time specialised one, e.g. a FixedPointRoadGraph
+    // for fast read-only routing over a large network. Fails if it is too big for the index type.
+    template <typename Graph>
+    bool exportGraph(Graph& graph) {
+        ensureCSR();
+        return graph.assignCSR(numLocations, csrOffset, csrTarget, csrWeight);
+    }
+    
+    // Hash of the current CSR arrays; indexes built elsewhere are only reused when it matches
+    unsigned long long getFingerprint() {
+        ensureCSR();
+        return ContractionHierarchy::computeFingerprint(numLocations, csrOffset, csrTarget, csrWeight);
+    }
+    
+    // Replace the whole graph with ready-made CSR arrays (a restored snapshot). `named`
+    // is (node, name, zone, external ID) per named location; others show as "Location-<n>".
+    void restoreGraph(int n, const int* offset, const int* target, const double* weight,
+                      const vector<tuple<int, string_view, string_view, long long>>& named) {
+        for (int i = 0; i < numLocations; i++) {
+            while (rows[i]) {
+                SparseNode* temp = rows[i];
+                rows[i] = temp->next;
+                nodePool.destroy(temp);
+            }
+        }
+        delete[] rows;
+        numLocations = n;
+        rows = new SparseNode*[numLocations];
+        for (int i = 0; i < numLocations; i++) rows[i] = nullptr;
+        
+        csrOffset.assign(offset, offset + n + 1);
+        csrTarget.assign(target, target + offset[n]);
+        csrWeight.assign(weight, weight + offset[n]);
+        csrDirty = false;
+        
+        locations.clear();
+        freeLocations.clear();
+        latitude.clear();
+        longitude.clear();
+        for (const auto& location : named) {
+            locations.assign(get<0>(location), get<1>(location), get<2>(location), get<3>(location));
+        }
+        graphVersion++;
+        treeCache.clear();
+    }
+    
+    void setRoutingBackend(RoutingBackend mode) { backend = mode; }
+    
+    // Route cache memory ceiling in bytes; 0 turns the cache off
+    void setRouteCacheCapacity(size_t bytes) { routeCache.setCapacity(bytes); }
+    
+    RouteCacheStats getRouteCacheStats() { return routeCache.getStats(); }
+    
+    // Place a node on the map (degrees); used by the A* bound and landmark selection
+    void setCoordinates(int node, double lat, double lon) {
+        if (node < 0 || node >= numLocations) return;
+        if ((int)latitude.size() < numLocations) {
+            latitude.resize(numLocations, numeric_limits<double>::quiet_NaN());
+            longitude.resize(numLocations, numeric_limits<double>::quiet_NaN());
+        }
+        latitude[node] = lat;
+        longitude[node] = lon;
+        geoScaleVersion = -1;
+    }
+    
+    bool getCoordinates(int node, double& lat, double& lon) {
+        if (node < 0 || !hasCoordinates(node)) return false;
+        lat = latitude[node];
+        lon = longitude[node];
+        return true;
+    }
+    
+    // Precompute ALT landmark rows for the current graph (threads = 0 uses all cores)
+    void buildLandmarks(int count = 8, int threads = 0) {
+        ensureCSR();
+        landmarks.build(numLocations, csrOffset, csrTarget, csrWeight, latitude, longitude, count, threads);
+        landmarkVersion = graphVersion;
+    }
+    
+    bool hasCurrentLandmarks() { return landmarkVersion == graphVersion; }
+    
+    const vector<int>& getLandmarks() { return landmarks.getLandmarks(); }
+    
+    RoutingBackend getRoutingBackend() { return backend; }
+    
+    // Build the hierarchy, landmark table, region split or fixed-point copy the current
+    // backend needs, unless one for this graph version already exists
+    void prepareRoutingBackend(int threads = 0) {
+        if (backend == ROUTE_CONTRACTION_HIERARCHY && !hasCurrentHierarchy()) buildContractionHierarchy(threads);
+        if (backend == ROUTE_ALT && !hasCurrentLandmarks()) buildLandmarks(8, threads);
+        if (backend == ROUTE_REGIONS && !hasCurrentRegions()) buildRegionRouter(0, threads);
+        if (backend == ROUTE_FIXED_POINT) ensureFixedPointGraph();
+    }
+    
+    // Split the current graph into regions for ROUTE_REGIONS: one per zone when regions is 0
+    // and zones are defined, otherwise that many regions grown by hop distance. Each region's
+    // overlay edges are built on its own thread unless `threads` caps them.
+    void buildRegionRouter(int regions = 0, int threads = 0) {
+        ensureCSR();
+        regionRouter.build(numLocations, csrOffset, csrTarget, csrWeight, partitionRegions(regions), threads);
+        regionVersion = graphVersion;
+    }
+    
+    bool hasCurrentRegions() { return regionVersion == graphVersion; }
+    
+    const RegionRouter& getRegionRouter() { return regionRouter; }
+    
+    // Distances for a batch of (start, end) pairs, infinity when unreachable. With a current
+    // region split each region's queries run on their own worker; otherwise one thread runs
+    // plain Dijkstra for every query.
+    vector<double> routeDistances(const vector<pair<int, int>>& queries, int threads = 0) {
+        if (hasCurrentRegions()) return regionRouter.distances(queries, threads);
+        vector<double> result(queries.size(), numeric_limits<double>::infinity());
+        vector<double> dist;
+        vector<int> parent;
+        for (size_t q = 0; q < queries.size(); q++) {
+            int start = queries[q].first, end = queries[q].second;
+            if (start < 0 || start >= numLocations || end < 0 || end >= numLocations) continue;
+            runDijkstra(start, end, dist, parent);
+            result[q] = dist[end];
+        }
+        return result;
+    }
+    
+    // Preprocess the current graph into a Contraction Hierarchies index (threads = 0 uses all cores)
+    void buildContractionHierarchy(int threads = 0) {
+        ensureCSR();
+        hierarchy.build(numLocations, csrOffset, csrTarget, csrWeight, threads);
+        hierarchyVersion = graphVersion;
+    }
+    
+    bool hasCurrentHierarchy() { return hierarchyVersion == graphVersion; }
+    
+    int getHierarchyShortcutCount() { return hierarchy.getShortcutCount(); }
+    
+    bool saveContractionHierarchy(const string& filename) {
+        return hasCurrentHierarchy() && hierarchy.save(filename);
+    }
+    
+    // Load an index from disk; rejected unless it was built from exactly this graph
+    bool loadContractionHierarchy(const string& filename) {
+        ensureCSR();
+        ContractionHierarchy loaded;
+        if (!loaded.load(filename) ||
+            !loaded.matches(ContractionHierarchy::computeFingerprint(numLocations, csrOffset, csrTarget, csrWeight))) {
+            return false;
+        }
+        hierarchy = loaded;
+        hierarchyVersion = graphVersion;
+        return true;
+    }
+    
+    // Read-only copy for concurrent readers, with trees precomputed for treeSources
+    shared_ptr<const RoutingSnapshot> createSnapshot(const vector<int>& treeSources) {
+        ensureCSR();
+        return make_shared<RoutingSnapshot>(numLocations, locations, csrOffset, csrTarget, csrWeight,
+                                            treeSources);
+    }
+    
+    // Full shortest-path tree from source, computed once per graph version.
+    // The returned reference stays valid until the next addEdge.
+    const ShortestPathTree& getShortestPathTree(int source) {
+        ShortestPathTree& tree = treeCache[source];
+        if (tree.graphVersion != graphVersion) {
+            METRIC_COUNT(COUNTER_TREE_CACHE_MISSES, 1);
+            tree.source = source;
+            tree.graphVersion = graphVersion;
+            runDijkstra(source, -1, tree.dist, tree.parent);
+        } else {
+            METRIC_COUNT(COUNTER_TREE_CACHE_HITS, 1);
+        }
+        return tree;
+    }
+    
+    // Walk the parent chain of a cached tree back to its source
+    vector<int> getPathFromTree(const ShortestPathTree& tree, int target) {
+        vector<int> path;
+        if (target < 0 || target >= (int)tree.dist.size() ||
+            tree.dist[target] == numeric_limits<double>::infinity()) {
+            return path;
+        }
+        
+        for (int current = target; current != -1; current = tree.parent[current]) {
+            path.push_back(current);
+        }
+        reverse(path.begin(), path.end());
+        return path;
+    }
+    
+    double getTreeDistance(const ShortestPathTree& tree, int target) {
+        if (target < 0 || target >= (int)tree.dist.size() ||
+            tree.dist[target] == numeric_limits<double>::infinity()) {
+            return -1.0;
+        }
+        return tree.dist[target];
+    }
+    
+    // Original O(V^2) array-scan Dijkstra, kept as a reference for comparisons
+    vector<int> findShortestPathArrayScan(int start, int end) {
+        ensureCSR();
+        const double infinity = numeric_limits<double>::infinity();
+        vector<double> dist(numLocations, infinity);
+        vector<int> parent(numLocations, -1);
+        vector<bool> visited(numLocations, false);
+        
+        dist[start] = 0;
+        
+        for (int count = 0; count < numLocations - 1; count++) {
+            int u = -1;
+            double minDist = infinity;
+            
+            for (int v = 0; v < numLocations; v++) {
+                if (!visited[v] && dist[v] < minDist) {
+                    minDist = dist[v];
+                    u = v;
+                }
+            }
+            
+            if (u == -1 || u == end) break;
+            visited[u] = true;
+            
+            for (int e = csrOffset[u]; e < csrOffset[u + 1]; e++) {
+                int v = csrTarget[e];
+                if (!visited[v] && dist[u] + csrWeight[e] < dist[v]) {
+                    dist[v] = dist[u] + csrWeight[e];
+                    parent[v] = u;
+                }
+            }
+        }
+        
+        // Reconstruct path
+        vector<int> path;
+        if (dist[end] == infinity) {
+            return path; // No path found
+        }
+        
+        int current = end;
+        while (current != -1) {
+            path.push_back(current);
+            current = parent[current];
+        }
+        reverse(path.begin(), path.end());
+        return path;
+    }
+    
+    // Sum of the road lengths along path; a cached shortest path's cost is looked up instead
+    double calculateRouteCost(const vector<int>& path) {
+        double cost;
+        if (routeCache.lookupCost(path, routeCacheTag(), cost)) return cost;
+        return sumRouteCost(path);
+    }
+    
+    double sumRouteCost(const vector<int>& path) {
+        if (path.size() < 2) return 0.0;
+        
+        double totalCost = 0.0;
+        for (size_t i = 0; i < path.size() - 1; i++) {
+            double dist = getDistance(path[i], path[i + 1]);
+            if (dist > 0) {
+                totalCost += dist;
+            }
+        }
+        return totalCost;
+    }
+    
+    // Exact location name, or a zone name ("Zone-A") resolved to the zone's hub
+    int getLocationIndex(string_view name) { return locations.resolve(name); }
+    
+    int findLocationByExternalId(long long externalId) { return locations.findByExternalId(externalId); }
+    
+    int getZoneHub(int zoneId) { return locations.zoneHub(zoneId); }
+    
+    const vector<int>& getZoneLocations(int zoneId) { return locations.locationsInZone(zoneId); }
+    
+    const LocationRegistry& getLocations() { return locations; }
+    
+    string getLocationName(int index) {
+        if (!locations.name(index).empty()) {
+            return string(locations.name(index));
+        }
+        if (index >= 0 && index < numLocations) {
+            return "Location-" + to_string(index);
+        }
+        return "Unknown";
+    }
+    
+    int getLocationCount() { return numLocations; }
+    
+    int getNamedLocationCount() { return locations.namedCount(); }
+    
+    int getEdgeCount() {
+        ensureCSR();
+        return (int)csrTarget.size();
+    }
+    
+    void displayMatrix() {
+        ensureCSR();
+        cout << "\n========== ROUTING MATRIX (SPARSE) ==========\n";
+        cout << "Location Connections:\n";
+        for (int i = 0; i < numLocations; i++) {
+            cout << getLocationName(i) << " -> ";
+            bool hasConnections = false;
+            for (int e = csrOffset[i]; e < csrOffset[i + 1]; e++) {
+                if (hasConnections) cout << ", ";
+                cout << getLocationName(csrTarget[e]);
+                if (csrWeight[e] == numeric_limits<double>::infinity()) cout << "(closed)";
+                else cout << "(" << csrWeight[e] << "km)";
+                hasConnections = true;
+            }
+            if (!hasConnections) cout << "No connections";
+            cout << "\n";
+        }
+        cout << "\n";
+    }
+    
+    ~SparseMatrix() {
+        for (int i = 0; i < numLocations; i++) {
+            SparseNode* current = rows[i];
+            while (current) {
+                SparseNode* temp = current;
+                current = current->next;
+                nodePool.destroy(temp);
+            }
+        }
+        delete[] rows;
+    }
+};
+
+// ==================== MULTI-STOP ROUTE OPTIMIZER (TSP/VRP) ====================
+
+struct CourierTour {
+    int courierId;
+    vector<int> stops;   // indices into the batch stop list, in visiting order
+    int load;
+    double distance;     // depot -> stops -> depot
+    
+    CourierTour() : courierId(-1), load(0), distance(0.0) {}
+};
+
+// Plans one closed tour per courier from a precomputed location distance table.
+// Tours are seeded by a capacity-aware nearest-neighbour construction and then
+// improved with 2-opt and Or-opt moves, one courier per worker thread, until no
+// move helps or the time budget runs out. Distances are assumed symmetric.
+class BatchRouteEngine {
+private:
+    int numLocations;
+    vector<double> table;        // numLocations x numLocations, infinity when unreachable
+    int depot;
+    vector<int> stopLocation;    // location index of every stop
+    int timeBudgetMs;
+    int threadCount;
+    
+    double distance(int fromLocation, int toLocation) const {
+        return table[(size_t)fromLocation * numLocations + toLocation];
+    }
+    
+    // Location of a route entry; -1 marks the depot at either end of a route
+    int locationOf(int entry) const {
+        return entry < 0 ? depot : stopLocation[entry];
+    }
+    
+    double leg(int fromEntry, int toEntry) const {
+        return distance(locationOf(fromEntry), locationOf(toEntry));
+    }
+    
+    double routeLength(const vector<int>& route) const {
+        double total = 0.0;
+        for (size_t i = 0; i + 1 < route.size(); i++) total += leg(route[i], route[i + 1]);
+        return total;
+    }
+    
+    // Reverse route[i..j] whenever that shortens the tour
+    bool improveTwoOpt(vector<int>& route, chrono::steady_clock::time_point deadline) const {
+        bool improved = false;
+        size_t last = route.size() - 2;
+        for (size_t i = 1; i < last; i++) {
+            if (chrono::steady_clock::now() >= deadline) break;
+            for (size_t j = i + 1; j <= last; j++) {
+                double delta = leg(route[i - 1], route[j]) + leg(route[i], route[j + 1])
+                             - leg(route[i - 1], route[i]) - leg(route[j], route[j + 1]);
+                if (delta < -1e-9) {
+                    reverse(route.begin() + i, route.begin() + j + 1);
+                    improved = true;
+                }
+            }
+        }
+        return improved;
+    }
+    
+    // Move a run of 1-3 consecutive stops to a cheaper position in the same tour
+    bool improveOrOpt(vector<int>& route, chrono::steady_clock::time_point deadline) const {
+        bool improved = false;
+        for (size_t length = 1; length <= 3; length++) {
+            for (size_t i = 1; i + length < route.size(); i++) {
+                if (chrono::steady_clock::now() >= deadline) return improved;
+                size_t end = i + length - 1;
+                double removeGain = leg(route[i - 1], route[i]) + leg(route[end], route[end + 1])
+                                  - leg(route[i - 1], route[end + 1]);
+                
+                for (size_t j = 0; j + 1 < route.size(); j++) {
+                    if (j + 1 >= i && j <= end) continue; // Edge touches the segment itself
+                    double insertCost = leg(route[j], route[i]) + leg(route[end], route[j + 1])
+                                      - leg(route[j], route[j + 1]);
+                    if (insertCost - removeGain < -1e-9) {
+                        vector<int> segment(route.begin() + i, route.begin() + end + 1);
+                        route.erase(route.begin() + i, route.begin() + end + 1);
+                        size_t insertAt = j < i ? j + 1 : j + 1 - length;
+                        route.insert(route.begin() + insertAt, segment.begin(), segment.end());
+                        improved = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return improved;
+    }
+    
+public:
+    BatchRouteEngine(int locations, const vector<double>& distances, int depotLocation,
+                     const vector<int>& stops)
+        : numLocations(locations), table(distances), depot(depotLocation), stopLocation(stops),
+          timeBudgetMs(200), threadCount(0) {}
+    
+    void setTimeBudget(int milliseconds) { timeBudgetMs = max(0, milliseconds); }
+    
+    void setThreadCount(int threads) { threadCount = threads; }
+    
+    // vehicles: (courierId, spare capacity). Stops that fit no tour are reported in unserved.
+    vector<CourierTour> plan(const vector<pair<int, int>>& vehicles, vector<int>& unserved) {
+        chrono::steady_clock::time_point deadline =
+            chrono::steady_clock::now() + chrono::milliseconds(timeBudgetMs);
+        vector<CourierTour> tours;
+        vector<char> assigned(stopLocation.size(), 0);
+        size_t remaining = stopLocation.size();
+        
+        // Nearest-neighbour construction, filling each courier up to its capacity
+        for (const pair<int, int>& vehicle : vehicles) {
+            if (remaining == 0) break;
+            CourierTour tour;
+            tour.courierId = vehicle.first;
+            int at = depot;
+            while (tour.load < vehicle.second) {
+                int best = -1;
+                double bestDistance = numeric_limits<double>::infinity();
+                for (size_t s = 0; s < stopLocation.size(); s++) {
+                    double candidate = distance(at, stopLocation[s]);
+                    if (!assigned[s] && candidate < bestDistance &&
+                        distance(stopLocation[s], depot) < numeric_limits<double>::infinity()) {
+                        bestDistance = candidate;
+                        best = (int)s;
+                    }
+                }
+                if (best == -1) break;
+                assigned[best] = 1;
+                remaining--;
+                tour.stops.push_back(best);
+                tour.load++;
+                at = stopLocation[best];
+            }
+            if (!tour.stops.empty()) tours.push_back(tour);
+        }
+        
+        for (size_t s = 0; s < stopLocation.size(); s++) {
+            if (!assigned[s]) unserved.push_back((int)s);
+        }
+        
+        // Local search, one tour at a time per worker
+        int threads = threadCount > 0 ? threadCount : (int)max(1u, thread::hardware_concurrency());
+        threads = max(1, min(threads, (int)tours.size()));
+        atomic<size_t> nextTour(0);
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&]() {
+                for (size_t k = nextTour++; k < tours.size(); k = nextTour++) {
+                    vector<int> route;
+                    route.push_back(-1);
+                    route.insert(route.end(), tours[k].stops.begin(), tours[k].stops.end());
+                    route.push_back(-1);
+                    
+                    while (chrono::steady_clock::now() < deadline) {
+                        bool improved = improveTwoOpt(route, deadline);
+                        improved = improveOrOpt(route, deadline) || improved;
+                        if (!improved) break;
+                    }
+                    
+                    tours[k].stops.assign(route.begin() + 1, route.end() - 1);
+                    tours[k].distance = routeLength(route);
+                }
+            });
+        }
+        for (thread& worker : workers) worker.join();
+        return tours;
+    }
+};
+
+// ==================== BATCH COURIER ASSIGNMENT (HUNGARIAN / AUCTION) ====================
+
+// Maximum-benefit matching between the rows and columns of a dense benefit matrix.
+// Benefits are non-negative integers and a pair worth 0 counts as unmatched, so any row
+// may stay unmatched. Small problems go to the Hungarian method; larger ones to an
+// epsilon-scaling auction whose bidding rounds are spread over threads. Both are exact.
+class AssignmentSolver {
+private:
+    static const long long HUNGARIAN_WORK = 1LL << 24;   // smaller side^2 * larger side
+    static const size_t PARALLEL_WORK = 1 << 14;        // bid work (bidders * classes) per thread
+    
+    // Shortest augmenting paths with row and column potentials, O(rows^2 * columns).
+    // Minimises -benefit; rows must not outnumber columns.
+    static vector<int> hungarian(const vector<long long>& benefit, int rows, int columns) {
+        METRIC_COUNT(COUNTER_ASSIGNMENT_HUNGARIAN, 1);
+        const long long INF = numeric_limits<long long>::max() / 4;
+        // 1-based; column 0 is the virtual start of every augmenting path
+        vector<long long> rowPotential(rows + 1, 0), columnPotential(columns + 1, 0);
+        vector<int> rowOfColumn(columns + 1, 0), way(columns + 1, 0);
+        vector<long long> slack(columns + 1);
+        vector<char> used(columns + 1);
+        for (int i = 1; i <= rows; i++) {
+            rowOfColumn[0] = i;
+            int column = 0;
+            fill(slack.begin(), slack.end(), INF);
+            fill(used.begin(), used.end(), 0);
+            do {
+                used[column] = 1;
+                int row = rowOfColumn[column], nextColumn = 0;
+                const long long* values = benefit.data() + (size_t)(row - 1) * columns;
+                long long delta = INF;
+                for (int j = 1; j <= columns; j++) {
+                    if (used[j]) continue;
+                    long long reduced = -values[j - 1] - rowPotential[row] - columnPotential[j];
+                    if (reduced < slack[j]) {
+                        slack[j] = reduced;
+                        way[j] = column;
+                    }
+                    if (slack[j] < delta) {
+                        delta = slack[j];
+                        nextColumn = j;
+                    }
+                }
+                for (int j = 0; j <= columns; j++) {
+                    if (used[j]) {
+                        rowPotential[rowOfColumn[j]] += delta;
+                        columnPotential[j] -= delta;
+                    } else {
+                        slack[j] -= delta;
+                    }
+                }
+                column = nextColumn;
+            } while (rowOfColumn[column] != 0);
+            // Flip the augmenting path back to its start
+            do {
+                int previous = way[column];
+                rowOfColumn[column] = rowOfColumn[previous];
+                column = previous;
+            } while (column != 0);
+        }
+        
+        vector<int> columnOf(rows, -1);
+        for (int j = 1; j <= columns; j++) {
+            if (rowOfColumn[j] != 0) columnOf[rowOfColumn[j] - 1] = j - 1;
+        }
+        return columnOf;
+    }
+    
+    // Jacobi auction over column classes. Identical columns (couriers in one zone with the
+    // same load) merge into one class of interchangeable copies, each with its own price, so
+    // a bid costs O(classes) instead of O(columns) and one round can hand several copies of a
+    // class to its highest bidders. Dummy rows or dummy copies worth 0 make the problem
+    // square, so every epsilon phase can restart from the previous prices. Benefits are
+    // scaled by n + 1, which makes the last phase (epsilon = 1) exactly optimal.
+    static vector<int> auction(const vector<long long>& benefit, int rows, int columns, int threads) {
+        METRIC_COUNT(COUNTER_ASSIGNMENT_AUCTIONS, 1);
+        int n = max(rows, columns);
+        long long scale = n + 1;
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        
+        // Group identical columns by hash, confirmed against the class representative
+        vector<uint64_t> columnHash(columns, 1469598103934665603ULL);
+        for (int i = 0; i < rows; i++) {
+            const long long* values = benefit.data() + (size_t)i * columns;
+            for (int c = 0; c < columns; c++) columnHash[c] = (columnHash[c] ^ (uint64_t)values[c]) * 1099511628211ULL;
+        }
+        vector<int> representative;
+        vector<vector<int>> copiesOf;   // class -> copies, kept sorted by price
+        unordered_map<uint64_t, vector<int>> classesByHash;
+        for (int c = 0; c < columns; c++) {
+            vector<int>& candidates = classesByHash[columnHash[c]];
+            int found = -1;
+            for (int k : candidates) {
+                bool same = true;
+                for (int i = 0; i < rows && same; i++) {
+                    same = benefit[(size_t)i * columns + c] == benefit[(size_t)i * columns + representative[k]];
+                }
+                if (same) {
+                    found = k;
+                    break;
+                }
+            }
+            if (found == -1) {
+                found = (int)representative.size();
+                representative.push_back(c);
+                copiesOf.emplace_back();
+                candidates.push_back(found);
+            }
+            copiesOf[found].push_back(c);
+        }
+        int realClasses = (int)representative.size();
+        if (rows > columns) {
+            // Dummy copies columns..n-1: the row is left unmatched
+            copiesOf.emplace_back();
+            for (int copy = columns; copy < n; copy++) copiesOf.back().push_back(copy);
+        }
+        int classes = (int)copiesOf.size();
+        
+        // Scaled benefit of every row for every class; rows past `rows` are dummies worth 0
+        vector<long long> value((size_t)n * classes, 0);
+        for (int i = 0; i < rows; i++) {
+            for (int k = 0; k < realClasses; k++) {
+                value[(size_t)i * classes + k] = benefit[(size_t)i * columns + representative[k]] * scale;
+            }
+        }
+        long long maxValue = *max_element(value.begin(), value.end());
+        
+        struct Bid {
+            int bidder;
+            int target;   // class
+            long long price;
+        };
+        vector<long long> price(n, 0);
+        vector<int> owner(n), copyOf(n);
+        vector<int> bidders, outbid;
+        vector<Bid> bids;
+        long long epsilon = max(1LL, maxValue / 8);
+        
+        // Each bidder bids for the cheapest copy of its best class, raising its price by the
+        // margin over the next best option (another class or the class's next copy) plus epsilon
+        auto placeBids = [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                int bidder = bidders[b];
+                const long long* values = value.data() + (size_t)bidder * classes;
+                long long best = numeric_limits<long long>::min(), second = best;
+                int bestClass = 0;
+                for (int k = 0; k < classes; k++) {
+                    long long net = values[k] - price[copiesOf[k][0]];
+                    if (net > best) {
+                        second = best;
+                        best = net;
+                        bestClass = k;
+                    } else if (net > second) {
+                        second = net;
+                    }
+                }
+                const vector<int>& copies = copiesOf[bestClass];
+                if (copies.size() > 1) second = max(second, values[bestClass] - price[copies[1]]);
+                if (second == numeric_limits<long long>::min()) second = best;
+                bids[b] = {bidder, bestClass, price[copies[0]] + (best - second) + epsilon};
+            }
+        };
+        
+        uint64_t bidCount = 0;
+        auto byPrice = [&price](int a, int b) { return price[a] < price[b]; };
+        while (true) {
+            fill(owner.begin(), owner.end(), -1);
+            fill(copyOf.begin(), copyOf.end(), -1);
+            bidders.resize(n);
+            for (int i = 0; i < n; i++) bidders[i] = i;
+            
+            while (!bidders.empty()) {
+                bidCount += bidders.size();
+                bids.resize(bidders.size());
+                int workers = (int)min<size_t>(threads, bidders.size() * classes / PARALLEL_WORK);
+                if (workers <= 1) {
+                    placeBids(0, bidders.size());
+                } else {
+                    vector<thread> pool;
+                    size_t chunk = (bidders.size() + workers - 1) / workers;
+                    for (int w = 0; w < workers; w++) {
+                        size_t begin = w * chunk, end = min(bidders.size(), begin + chunk);
+                        pool.emplace_back(placeBids, begin, end);
+                    }
+                    for (thread& worker : pool) worker.join();
+                }
+                
+                // Per class, the highest bids take the cheapest copies they outbid; the
+                // displaced owners and the losing bidders bid again next round
+                sort(bids.begin(), bids.end(), [](const Bid& a, const Bid& b) {
+                    return a.target != b.target ? a.target < b.target : a.price > b.price;
+                });
+                for (size_t first = 0; first < bids.size();) {
+                    int target = bids[first].target;
+                    vector<int>& copies = copiesOf[target];
+                    size_t taken = 0, b = first;
+                    for (; b < bids.size() && bids[b].target == target; b++) {
+                        const Bid& bid = bids[b];
+                        if (taken == copies.size() || bid.price <= price[copies[taken]]) {
+                            outbid.push_back(bid.bidder);
+                            continue;
+                        }
+                        int copy = copies[taken++];
+                        if (owner[copy] != -1) {
+                            copyOf[owner[copy]] = -1;
+                            outbid.push_back(owner[copy]);
+                        }
+                        owner[copy] = bid.bidder;
+                        copyOf[bid.bidder] = copy;
+                        price[copy] = bid.price;
+                    }
+                    sort(copies.begin(), copies.begin() + taken, byPrice);
+                    inplace_merge(copies.begin(), copies.begin() + taken, copies.end(), byPrice);
+                    first = b;
+                }
+                bidders.swap(outbid);
+                outbid.clear();
+            }
+            if (epsilon == 1) break;
+            epsilon = max(1LL, epsilon / 8);
+        }
+        METRIC_COUNT(COUNTER_ASSIGNMENT_AUCTION_BIDS, bidCount);
+        
+        vector<int> columnOf(rows, -1);
+        for (int i = 0; i < rows; i++) {
+            if (copyOf[i] < columns) columnOf[i] = copyOf[i];
+        }
+        return columnOf;
+    }
+    
+public:
+    // Column matched to every row, -1 when the row is left unmatched (threads = 0 uses all
+    // cores). The Hungarian method takes problems up to HUNGARIAN_WORK steps, the auction
+    // everything larger.
+    static vector<int> solve(const vector<long long>& benefit, int rows, int columns, int threads = 0) {
+        METRIC_TIMER(HIST_ASSIGNMENT_SOLVE);
+        vector<int> columnOf(rows, -1);
+        if (rows == 0 || columns == 0) return columnOf;
+        
+        // The Hungarian method wants the smaller side as rows, the auction the larger one
+        // (padding columns with one class of dummy copies is cheap, dummy bidders are not)
+        long long small = min(rows, columns), large = max(rows, columns);
+        bool useAuction = small * small * large > HUNGARIAN_WORK;
+        if (useAuction ? rows >= columns : rows <= columns) {
+            columnOf = useAuction ? auction(benefit, rows, columns, threads) : hungarian(benefit, rows, columns);
+        } else {
+            vector<long long> transposed((size_t)rows * columns);
+            for (int i = 0; i < rows; i++) {
+                for (int j = 0; j < columns; j++) {
+                    transposed[(size_t)j * rows + i] = benefit[(size_t)i * columns + j];
+                }
+            }
+            vector<int> rowOf = useAuction ? auction(transposed, columns, rows, threads)
+                                           : hungarian(transposed, columns, rows);
+            for (int j = 0; j < columns; j++) {
+                if (rowOf[j] != -1) columnOf[rowOf[j]] = j;
+            }
+        }
+        
+        for (int i = 0; i < rows; i++) {
+            if (columnOf[i] != -1 && benefit[(size_t)i * columns + columnOf[i]] <= 0) columnOf[i] = -1;
+        }
+        return columnOf;
+    }
+};
+
+// ==================== CONCURRENT DISPATCH ENGINE ====================
+
+struct DispatchOrder {
+    int rank;        // position in dispatch order; couriers are claimed in rank order
+    int appointmentId;
+    int zoneQueue;   // courier queue of the appointment's zone, -1 if no courier starts there
+    int location;    // routing location of the appointment's zone, -1 if unknown
+};
+
+struct DispatchResult {
+    int appointmentId;
+    int courierId;       // -1 when no courier was free
+    int location;
+    double distance;
+};
+
+// Intake threads push orders into a lock-free ring; a pool of workers pops them and
+// prices the route against a read-only RoutingSnapshot. Priced orders land in a reorder
+// buffer by rank, and whichever worker holds the commit lock claims couriers for the
+// ready prefix of the buffer. Couriers therefore go out in dispatch order whatever the
+// thread timing, and the same input always gives the same assignments. A claim follows
+// the sequential dispatcher: a courier in the order's zone with spare load, else any
+// courier with spare load, else any available courier even at full load.
+class ConcurrentDispatchEngine {
+private:
+    struct EngineCourier {
+        int courierId;
+        int currentLoad;
+        int maxLoad;
+    };
+    
+    shared_ptr<const RoutingSnapshot> routing;
+    int warehouse;
+    vector<EngineCourier> fleet;      // in the order the courier queue hands them out
+    vector<char> claimed;
+    vector<deque<int>> zoneQueues;    // per starting zone: fleet indices with spare load, FIFO
+    vector<int> queueOfZone;          // zone ID -> zone queue, -1 when no courier starts there
+    vector<int> locationOfZone;       // zone ID -> routing location, resolved up front
+    size_t spareCursor;               // no fleet index below it has spare load unclaimed
+    size_t availableCursor;           // no fleet index below it is unclaimed
+    
+    MPMCRingQueue<DispatchOrder> orders;
+    atomic<bool> closing;
+    atomic<long long> pending;
+    vector<thread> workers;
+    
+    mutex commitLock;                 // guards the buffer, the cursors and every claim
+    vector<DispatchResult> ordered;   // reorder buffer, by rank
+    vector<int> zoneQueueOf;          // by rank
+    vector<char> priced;              // by rank
+    size_t committed;                 // ranks below it have been given their courier
+    
+    int take(size_t index) {
+        claimed[index] = 1;
+        fleet[index].currentLoad++;
+        return (int)index;
+    }
+    
+    int claimCourier(int zoneQueue) {
+        if (zoneQueue >= 0) {
+            deque<int>& queue = zoneQueues[zoneQueue];
+            while (!queue.empty() && claimed[queue.front()]) queue.pop_front();
+            if (!queue.empty()) return take(queue.front());
+        }
+        while (spareCursor < fleet.size() &&
+               (claimed[spareCursor] || fleet[spareCursor].currentLoad >= fleet[spareCursor].maxLoad)) {
+            spareCursor++;
+        }
+        if (spareCursor < fleet.size()) return take(spareCursor);
+        while (availableCursor < fleet.size() && claimed[availableCursor]) availableCursor++;
+        if (availableCursor < fleet.size()) return take(availableCursor);
+        return -1;
+    }
+    
+    // File a priced order under its rank, then claim couriers for every priced order at
+    // the front of the buffer
+    void commit(const DispatchOrder& order, const DispatchResult& result) {
+        lock_guard<mutex> guard(commitLock);
+        ordered[order.rank] = result;
+        zoneQueueOf[order.rank] = order.zoneQueue;
+        priced[order.rank] = 1;
+        for (; committed < ordered.size() && priced[committed]; committed++) {
+            int index = claimCourier(zoneQueueOf[committed]);
+            if (index == -1) METRIC_COUNT(COUNTER_COURIER_MISSES, 1);
+            ordered[committed].courierId = index == -1 ? -1 : fleet[index].courierId;
+        }
+    }
+    
+    void workerLoop() {
+        DispatchOrder order;
+        while (true) {
+            if (!orders.tryPop(order)) {
+                if (closing.load(memory_order_acquire) && pending.load(memory_order_acquire) == 0) return;
+                this_thread::yield();
+                continue;
+            }
+            
+            {
+                METRIC_TIMER(HIST_DISPATCH_ORDER);
+                DispatchResult result;
+                result.appointmentId = order.appointmentId;
+                result.courierId = -1;
+                result.location = order.location;
+                result.distance = order.location == -1 ? -1.0 : routing->routeDistance(warehouse, order.location);
+                commit(order, result);
+            }
+            pending.fetch_sub(1, memory_order_acq_rel);
+        }
+    }
+    
+public:
+    // `couriers` in the order the courier queue hands them out (getCouriersInDispatchOrder)
+    ConcurrentDispatchEngine(shared_ptr<const RoutingSnapshot> snapshot, int warehouseLocation,
+                             const vector<Courier>& couriers, size_t queueCapacity = 1 << 16)
+        : routing(snapshot), warehouse(warehouseLocation), spareCursor(0), availableCursor(0),
+          orders(queueCapacity), closing(false), pending(0), committed(0) {
+        int zones = nameTable().size();
+        queueOfZone.assign(zones, -1);
+        locationOfZone.assign(zones, -1);
+        for (int zone = 0; zone < zones; zone++) {
+            locationOfZone[zone] = routing->getZoneHub(zone);
+        }
+        
+        for (const Courier& courier : couriers) {
+            if (courier.zoneId < 0 || courier.zoneId >= zones) continue;
+            int& queue = queueOfZone[courier.zoneId];
+            if (queue == -1) {
+                queue = (int)zoneQueues.size();
+                zoneQueues.emplace_back();
+            }
+            if (courier.currentLoad < courier.maxLoad) zoneQueues[queue].push_back((int)fleet.size());
+            fleet.push_back({courier.courierId, courier.currentLoad, courier.maxLoad});
+        }
+        claimed.assign(fleet.size(), 0);
+    }
+    
+    ~ConcurrentDispatchEngine() {
+        if (!workers.empty()) finish();
+    }
+    
+    // Ranks 0 to orderCount - 1 must each be submitted once before finish()
+    void start(int workerCount, size_t orderCount) {
+        ordered.assign(orderCount, DispatchResult());
+        zoneQueueOf.assign(orderCount, -1);
+        priced.assign(orderCount, 0);
+        committed = 0;
+        workerCount = max(1, workerCount);
+        for (int w = 0; w < workerCount; w++) {
+            workers.emplace_back(&ConcurrentDispatchEngine::workerLoop, this);
+        }
+    }
+    
+    // Safe from any number of intake threads; blocks while the ring is full. `rank` is the
+    // order's position in dispatch order. location -1 routes the order to its zone's hub.
+    void submit(int rank, int appointmentId, int zoneId, int location = -1) {
+        DispatchOrder order;
+        order.rank = rank;
+        order.appointmentId = appointmentId;
+        bool known = zoneId >= 0 && zoneId < (int)queueOfZone.size();
+        order.zoneQueue = known ? queueOfZone[zoneId] : -1;
+        order.location = location != -1 ? location : known ? locationOfZone[zoneId] : -1;
+        
+        pending.fetch_add(1, memory_order_acq_rel);
+        while (!orders.tryPush(order)) this_thread::yield();
+    }
+    
+    // Wait for every submitted order, stop the workers and return the results in rank order
+    vector<DispatchResult> finish() {
+        closing.store(true, memory_order_release);
+        for (thread& worker : workers) worker.join();
+        workers.clear();
+        
+        vector<DispatchResult> all;
+        all.swap(ordered);
+        return all;
+    }
+};
+
+// ==================== BATCH INPUT (CSV / JSONL) ====================
+
+// Reads a whole CSV or JSON Lines file into one buffer and hands out fields as
+// string_views into it. Quotes and escapes are undone in place, so no field is
+// copied until a record is actually stored.
+class RecordReader {
+private:
+    string buffer;
+    size_t position;
+    size_t lineNumber;
+    bool jsonLines;
+    vector<string> columns;        // CSV header, or the default column order
+    vector<string_view> keys;      // JSONL keys of the current row
+    vector<string_view> values;
+    
+    static string_view trim(string_view text) {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+    
+    bool nextLine(char*& begin, char*& end) {
+        while (position < buffer.size()) {
+            begin = &buffer[position];
+            size_t newline = buffer.find('\n', position);
+            if (newline == string::npos) newline = buffer.size();
+            end = &buffer[0] + newline;
+            position = newline + 1;
+            lineNumber++;
+            if (!trim(string_view(begin, end - begin)).empty()) return true;
+        }
+        return false;
+    }
+    
+    // Split one CSV line; "quoted, fields" lose their quotes and "" becomes "
+    void splitCSV(char* begin, char* end) {
+        values.clear();
+        char* cursor = begin;
+        while (true) {
+            while (cursor < end && (*cursor == ' ' || *cursor == '\t')) cursor++;
+            if (cursor < end && *cursor == '"') {
+                char* write = ++cursor;
+                char* start = write;
+                while (cursor < end) {
+                    if (*cursor == '"') {
+                        if (cursor + 1 < end && cursor[1] == '"') {
+                            *write++ = '"';
+                            cursor += 2;
+                            continue;
+                        }
+                        cursor++;
+                        break;
+                    }
+                    *write++ = *cursor++;
+                }
+                values.push_back(string_view(start, write - start));
+                while (cursor < end && *cursor != ',') cursor++;
+            } else {
+                char* start = cursor;
+                while (cursor < end && *cursor != ',') cursor++;
+                values.push_back(trim(string_view(start, cursor - start)));
+            }
+            if (cursor >= end) break;
+            cursor++; // Skip the comma
+        }
+    }
+    
+    // Four hex digits of a \u escape, or -1
+    static int parseHex4(const char* cursor, const char* end) {
+        if (end - cursor < 4) return -1;
+        int value = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = cursor[i];
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                        c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) return -1;
+            value = value * 16 + digit;
+        }
+        return value;
+    }
+    
+    // Decode the \uXXXX escape (or surrogate pair) whose u is at cursor as UTF-8, moving past it.
+    // The UTF-8 form is never longer than the escape, so writing in place stays behind cursor.
+    static bool decodeUnicodeEscape(char*& cursor, char* end, char*& write) {
+        int code = parseHex4(cursor + 1, end);
+        if (code < 0 || (code >= 0xDC00 && code <= 0xDFFF)) return false;
+        cursor += 5;
+        if (code >= 0xD800 && code <= 0xDBFF) {
+            if (end - cursor < 2 || cursor[0] != '\\' || cursor[1] != 'u') return false;
+            int low = parseHex4(cursor + 2, end);
+            if (low < 0xDC00 || low > 0xDFFF) return false;
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            cursor += 6;
+        }
+        if (code < 0x80) {
+            *write++ = (char)code;
+        } else if (code < 0x800) {
+            *write++ = (char)(0xC0 | code >> 6);
+            *write++ = (char)(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            *write++ = (char)(0xE0 | code >> 12);
+            *write++ = (char)(0x80 | (code >> 6 & 0x3F));
+            *write++ = (char)(0x80 | (code & 0x3F));
+        } else {
+            *write++ = (char)(0xF0 | code >> 18);
+            *write++ = (char)(0x80 | (code >> 12 & 0x3F));
+            *write++ = (char)(0x80 | (code >> 6 & 0x3F));
+            *write++ = (char)(0x80 | (code & 0x3F));
+        }
+        return true;
+    }
+    
+    // Parse a JSON string starting at the opening quote, unescaping in place. An unknown or
+    // malformed escape fails the string rather than loading altered text.
+    static bool parseJSONString(char*& cursor, char* end, string_view& out) {
+        char* write = ++cursor;
+        char* start = write;
+        while (cursor < end && *cursor != '"') {
+            if (*cursor == '\\' && cursor + 1 < end) {
+                cursor++;
+                switch (*cursor) {
+                    case 'n': *write++ = '\n'; break;
+                    case 't': *write++ = '\t'; break;
+                    case 'r': *write++ = '\r'; break;
+                    case 'b': *write++ = '\b'; break;
+                    case 'f': *write++ = '\f'; break;
+                    case '"': case '\\': case '/': *write++ = *cursor; break;
+                    case 'u':
+                        if (!decodeUnicodeEscape(cursor, end, write)) return false;
+                        continue;
+                    default: return false;
+                }
+                cursor++;
+            } else {
+                *write++ = *cursor++;
+            }
+        }
+        if (cursor >= end) return false;
+        cursor++; // Closing quote
+        out = string_view(start, write - start);
+        return true;
+    }
+    
+    // Parse one flat JSON object of string and number values
+    bool splitJSON(char* begin, char* end) {
+        keys.clear();
+        values.clear();
+        char* cursor = begin;
+        while (cursor < end && *cursor != '{') cursor++;
+        if (cursor >= end) return false;
+        cursor++;
+        
+        while (cursor < end) {
+            while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == ',')) cursor++;
+            if (cursor >= end || *cursor == '}') return true;
+            
+            string_view key, value;
+            if (*cursor != '"' || !parseJSONString(cursor, end, key)) return false;
+            while (cursor < end && (*cursor == ' ' || *cursor == ':')) cursor++;
+            if (cursor < end && *cursor == '"') {
+                if (!parseJSONString(cursor, end, value)) return false;
+            } else {
+                char* start = cursor;
+                while (cursor < end && *cursor != ',' && *cursor != '}') cursor++;
+                value = trim(string_view(start, cursor - start));
+            }
+            keys.push_back(key);
+            values.push_back(value);
+        }
+        return false;
+    }
+    
+public:
+    RecordReader() : position(0), lineNumber(0), jsonLines(false) {}
+    
+    // Load the file; CSV files may start with a header naming their columns
+    bool open(const string& filename, const vector<string>& defaultColumns, string& error) {
+        FILE* file = fopen(filename.c_str(), "rb");
+        if (!file) {
+            error = "cannot open " + filename;
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long length = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        buffer.resize(length > 0 ? length : 0);
+        size_t got = length > 0 ? fread(&buffer[0], 1, length, file) : 0;
+        fclose(file);
+        if (got != buffer.size()) {
+            error = "failed to read " + filename;
+            return false;
+        }
+        
+        position = 0;
+        lineNumber = 0;
+        columns = defaultColumns;
+        size_t firstChar = buffer.find_first_not_of(" \t\r\n");
+        jsonLines = firstChar != string::npos && buffer[firstChar] == '{';
+        if (jsonLines) return true;
+        
+        // A first line naming any known column is a header
+        size_t savedPosition = position, savedLine = lineNumber;
+        char* begin;
+        char* end;
+        if (nextLine(begin, end)) {
+            splitCSV(begin, end);
+            bool header = false;
+            for (string_view field : values) {
+                for (const string& column : defaultColumns) {
+                    if (field == column) header = true;
+                }
+            }
+            if (header) {
+                columns.assign(values.begin(), values.end());
+                return true;
+            }
+        }
+        position = savedPosition;
+        lineNumber = savedLine;
+        return true;
+    }
+    
+    // Advance to the next record; returns false at end of file. Malformed lines are reported by valid().
+    bool next(bool& valid) {
+        char* begin;
+        char* end;
+        if (!nextLine(begin, end)) return false;
+        if (jsonLines) {
+            valid = splitJSON(begin, end);
+        } else {
+            splitCSV(begin, end);
+            valid = true;
+        }
+        return true;
+    }
+    
+    // Value of a field in the current record, empty when absent
+    string_view get(const string& key) const {
+        if (jsonLines) {
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (keys[i] == key) return values[i];
+            }
+            return string_view();
+        }
+        for (size_t i = 0; i < columns.size() && i < values.size(); i++) {
+            if (columns[i] == key) return values[i];
+        }
+        return string_view();
+    }
+    
+    bool has(const string& key) const {
+        if (jsonLines) {
+            for (string_view candidate : keys) {
+                if (candidate == key) return true;
+            }
+            return false;
+        }
+        for (size_t i = 0; i < columns.size() && i < values.size(); i++) {
+            if (columns[i] == key) return true;
+        }
+        return false;
+    }
+    
+    size_t getLineNumber() const { return lineNumber; }
+    
+    template <typename Integer>
+    static bool parseInt(string_view text, Integer& value) {
+        text = trim(text);
+        if (text.empty()) return false;
+        from_chars_result result = from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == errc() && result.ptr == text.data() + text.size();
+    }
+    
+    static bool parseDouble(string_view text, double& value) {
+        text = trim(text);
+        if (text.empty()) return false;
+        from_chars_result result = from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == errc() && result.ptr == text.data() + text.size();
+    }
+};
+
+// ==================== PERSISTENCE: SNAPSHOT AND WRITE-AHEAD LOG ====================
+
+// Read-only memory map of a whole file; an empty file maps to no bytes
+class MappedFile {
+private:
+    int fd;
+    const char* bytes;
+    size_t length;
+    
+public:
+    MappedFile() : fd(-1), bytes(nullptr), length(0) {}
+    
+    bool open(const string& filename, string& error) {
+        fd = ::open(filename.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            error = "cannot open " + filename;
+            return false;
+        }
+        length = (size_t)info.st_size;
+        if (length == 0) return true;
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            error = "cannot map " + filename;
+            length = 0;
+            return false;
+        }
+        bytes = (const char*)mapped;
+        madvise(mapped, length, MADV_SEQUENTIAL);
+        return true;
+    }
+    
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    
+    ~MappedFile() {
+        if (bytes) munmap((void*)bytes, length);
+        if (fd >= 0) close(fd);
+    }
+};
+
+// FNV-1a over 8-byte words, then the tail bytes; guards snapshots and log records
+unsigned long long persistenceChecksum(const char* data, size_t size) {
+    unsigned long long hash = 1469598103934665603ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        unsigned long long word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < size; i++) hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+    return hash;
+}
+
+// fsync the directory holding `filename`, so a rename into it survives a crash
+bool syncParentDirectory(const string& filename) {
+    size_t slash = filename.rfind('/');
+    string directory = slash == string::npos ? "." : slash == 0 ? "/" : filename.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
+
+// Snapshot layout: a fixed header followed by 8-byte aligned sections of plain records,
+// so a mapped file is read in place. All text lives in one blob referenced by offset.
+const uint32_t SNAPSHOT_VERSION = 4;
+
+enum SnapshotSectionId {
+    SECTION_TEXT,             // char blob
+    SECTION_ZONES,            // SnapshotText per zone name
+    SECTION_APPOINTMENTS,     // SnapshotAppointment, insertion order
+    SECTION_COURIERS,         // SnapshotCourier, queue order
+    SECTION_GRAPH_OFFSET,     // int32 CSR offsets, locations + 1
+    SECTION_GRAPH_TARGET,     // int32 CSR targets
+    SECTION_GRAPH_WEIGHT,     // double CSR weights
+    SECTION_LOCATIONS,        // SnapshotLocation per named location
+    SECTION_COORDINATES,      // SnapshotCoordinate per location, or none at all
+    SNAPSHOT_SECTION_COUNT
+};
+
+struct SnapshotSection {
+    uint64_t offset;   // from the start of the file
+    uint64_t count;    // elements, not bytes
+};
+
+struct SnapshotHeader {
+    char magic[8];         // "SDROSN01"
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t lastLsn;      // last log record the snapshot already contains
+    uint64_t fileSize;
+    uint64_t checksum;     // over every byte after the header
+    int32_t nextAppointmentId;
+    int32_t nextCourierId;
+    SnapshotSection sections[SNAPSHOT_SECTION_COUNT];
+};
+
+struct SnapshotText {
+    uint64_t offset;   // into SECTION_TEXT
+    uint64_t length;
+};
+
+struct SnapshotAppointment {
+    int32_t appointmentId;
+    int32_t priority;
+    int32_t zone;        // index into SECTION_ZONES
+    uint32_t completed;
+    SnapshotText customerName;
+    SnapshotText address;
+    SnapshotText deliveryTime;
+    int64_t earliest;    // the window deliveryTime resolved to, in minutes since the epoch
+    int64_t latest;
+};
+
+struct SnapshotCourier {
+    int32_t courierId;
+    int32_t zone;        // index into SECTION_ZONES
+    int32_t currentLoad;
+    int32_t maxLoad;
+    uint32_t available;
+    uint32_t reserved;
+    SnapshotText name;
+};
+
+struct SnapshotCoordinate {
+    double latitude;     // degrees, NaN when unknown
+    double longitude;
+};
+
+struct SnapshotLocation {
+    int32_t node;
+    int32_t zone;        // index into SECTION_ZONES, -1 for none
+    int64_t externalId;  // -1 for none
+    SnapshotText name;
+};
+
+enum LogRecordType {
+    LOG_ADD_APPOINTMENT = 1,    // id, priority, customer, address, time, zone, earliest, latest
+    LOG_REMOVE_APPOINTMENT,     // id
+    LOG_COMPLETE_APPOINTMENT,   // id
+    LOG_ADD_COURIER,            // id, maxLoad, name, zone
+    LOG_ASSIGN_COURIER,         // courier id, zone
+    LOG_ASSIGN_BATCH,           // count, then courier id, appointment id, zone per assignment
+    LOG_RELEASE_COURIER         // courier id
+};
+
+// One courier-to-appointment pair of a batch assignment
+struct BatchAssignment {
+    int courierId;
+    int appointmentId;
+    string_view zone;
+};
+
+// One intact log record; fields are read back in the order they were written
+struct LogRecord {
+    uint64_t lsn;
+    int type;
+    const char* position;
+    const char* end;
+    
+    bool readInt(int& value) {
+        if (end - position < 4) return false;
+        int32_t raw;
+        memcpy(&raw, position, sizeof(raw));
+        position += 4;
+        value = raw;
+        return true;
+    }
+    
+    bool readLong(long long& value) {
+        if (end - position < 8) return false;
+        int64_t raw;
+        memcpy(&raw, position, sizeof(raw));
+        position += 8;
+        value = raw;
+        return true;
+    }
+    
+    bool readText(string_view& value) {
+        int length;
+        if (!readInt(length) || length < 0 || end - position < length) return false;
+        value = string_view(position, length);
+        position += length;
+        return true;
+    }
+};
+
+// Append-only operation log. Each record is framed as
+//   uint32 body size | uint32 checksum | body = uint64 lsn, uint8 type, fields
+// and buffered until flush(). Replay stops at the first torn or corrupt record, and
+// reopening the log cuts that tail off before new records are appended.
+class WriteAheadLog {
+private:
+    static constexpr size_t FRAME_HEADER = 8;
+    static constexpr size_t FLUSH_THRESHOLD = 1 << 20;
+    
+    int fd;
+    vector<char> buffer;
+    size_t recordStart;
+    uint64_t lastLsn;
+    bool syncOnFlush;
+    
+    void putInt(int value) {
+        int32_t raw = value;
+        buffer.insert(buffer.end(), (const char*)&raw, (const char*)&raw + sizeof(raw));
+    }
+    
+    void putLong(long long value) {
+        int64_t raw = value;
+        buffer.insert(buffer.end(), (const char*)&raw, (const char*)&raw + sizeof(raw));
+    }
+    
+    void putText(string_view text) {
+        putInt((int)text.size());
+        buffer.insert(buffer.end(), text.begin(), text.end());
+    }
+    
+    void beginRecord(LogRecordType type) {
+        recordStart = buffer.size();
+        buffer.resize(buffer.size() + FRAME_HEADER);
+        uint64_t lsn = ++lastLsn;
+        buffer.insert(buffer.end(), (const char*)&lsn, (const char*)&lsn + sizeof(lsn));
+        buffer.push_back((char)type);
+    }
+    
+    void endRecord() {
+        const char* body = buffer.data() + recordStart + FRAME_HEADER;
+        uint32_t size = (uint32_t)(buffer.size() - recordStart - FRAME_HEADER);
+        uint32_t checksum = (uint32_t)persistenceChecksum(body, size);
+        memcpy(buffer.data() + recordStart, &size, sizeof(size));
+        memcpy(buffer.data() + recordStart + 4, &checksum, sizeof(checksum));
+        if (buffer.size() >= FLUSH_THRESHOLD) flush();
+    }
+    
+public:
+    WriteAheadLog() : fd(-1), recordStart(0), lastLsn(0), syncOnFlush(false) {}
+    
+    // Hand every intact record with an LSN above afterLsn to apply(), then call finish()
+    // while the records' text is still mapped. validBytes is the length of the intact
+    // prefix; a missing file is an empty log.
+    static bool replay(const string& filename, uint64_t afterLsn, const function<void(LogRecord&)>& apply,
+                       const function<void()>& finish, uint64_t& lastLsn, uint64_t& validBytes,
+                       string& error) {
+        lastLsn = afterLsn;
+        validBytes = 0;
+        if (access(filename.c_str(), F_OK) != 0) return true;
+        
+        MappedFile file;
+        if (!file.open(filename, error)) return false;
+        const char* data = file.data();
+        size_t size = file.size();
+        size_t pos = 0;
+        while (size - pos >= FRAME_HEADER) {
+            uint32_t bodySize, checksum;
+            memcpy(&bodySize, data + pos, sizeof(bodySize));
+            memcpy(&checksum, data + pos + 4, sizeof(checksum));
+            const char* body = data + pos + FRAME_HEADER;
+            if (bodySize < 9 || bodySize > size - pos - FRAME_HEADER ||
+                (uint32_t)persistenceChecksum(body, bodySize) != checksum) {
+                break;
+            }
+            
+            LogRecord record;
+            memcpy(&record.lsn, body, sizeof(record.lsn));
+            record.type = (unsigned char)body[8];
+            record.position = body + 9;
+            record.end = body + bodySize;
+            if (record.lsn > lastLsn) {
+                apply(record);
+                lastLsn = record.lsn;
+            }
+            pos += FRAME_HEADER + bodySize;
+        }
+        finish();
+        validBytes = pos;
+        return true;
+    }
+    
+    // Open for appending after the intact prefix; new records continue from lastLsn
+    bool open(const string& filename, uint64_t lsn, uint64_t validBytes, string& error) {
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd < 0 || ftruncate(fd, (off_t)validBytes) != 0 || lseek(fd, 0, SEEK_END) < 0) {
+            error = "cannot open log " + filename;
+            return false;
+        }
+        lastLsn = lsn;
+        return true;
+    }
+    
+    // fdatasync on every flush, not just hand the bytes to the OS
+    void setSyncOnFlush(bool sync) { syncOnFlush = sync; }
+    
+    uint64_t getLastLsn() const { return lastLsn; }
+    
+    // The resolved window goes with the text, so replay on another day keeps the deadline
+    void logAddAppointment(int id, string_view name, string_view addr, string_view time, int prio,
+                           string_view zone, const TimeWindow& window) {
+        beginRecord(LOG_ADD_APPOINTMENT);
+        putInt(id);
+        putInt(prio);
+        putText(name);
+        putText(addr);
+        putText(time);
+        putText(zone);
+        putLong(window.earliest);
+        putLong(window.latest);
+        endRecord();
+    }
+    
+    void logRemoveAppointment(int id) {
+        beginRecord(LOG_REMOVE_APPOINTMENT);
+        putInt(id);
+        endRecord();
+    }
+    
+    void logCompleteAppointment(int id) {
+        beginRecord(LOG_COMPLETE_APPOINTMENT);
+        putInt(id);
+        endRecord();
+    }
+    
+    void logAddCourier(int id, string_view name, string_view zone, int maxLoad) {
+        beginRecord(LOG_ADD_COURIER);
+        putInt(id);
+        putInt(maxLoad);
+        putText(name);
+        putText(zone);
+        endRecord();
+    }
+    
+    void logAssignCourier(int courierId, string_view zone) {
+        beginRecord(LOG_ASSIGN_COURIER);
+        putInt(courierId);
+        putText(zone);
+        endRecord();
+    }
+    
+    void logReleaseCourier(int courierId) {
+        beginRecord(LOG_RELEASE_COURIER);
+        putInt(courierId);
+        endRecord();
+    }
+    
+    // A whole batch in one record, so replay applies every assignment or none
+    void logAssignBatch(const vector<BatchAssignment>& batch) {
+        beginRecord(LOG_ASSIGN_BATCH);
+        putInt((int)batch.size());
+        for (const BatchAssignment& assignment : batch) {
+            putInt(assignment.courierId);
+            putInt(assignment.appointmentId);
+            putText(assignment.zone);
+        }
+        endRecord();
+    }
+    
+    bool flush() {
+        size_t written = 0;
+        while (written < buffer.size()) {
+            ssize_t result = write(fd, buffer.data() + written, buffer.size() - written);
+            if (result < 0) return false;
+            written += (size_t)result;
+        }
+        buffer.clear();
+        return !syncOnFlush || fdatasync(fd) == 0;
+    }
+    
+    // Drop every record once a snapshot holds them; LSNs keep counting up
+    bool reset() {
+        buffer.clear();
+        return ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0;
+    }
+    
+    ~WriteAheadLog() {
+        if (fd < 0) return;
+        flush();
+        close(fd);
+    }
+};
+
+// ==================== ALL-PAIRS DISTANCE TABLES ====================
+
+const uint32_t DISTANCE_TABLE_VERSION = 1;
+
+struct DistanceTableHeader {
+    char magic[8];           // "SDRODT01"
+    uint32_t version;
+    uint32_t count;          // selected locations
+    uint32_t stride;         // floats per row
+    uint32_t reserved;
+    uint64_t fingerprint;    // graph the table was built from
+    uint64_t checksum;       // over every byte after the header
+};
+
+// Dense float32 distances between selected locations, infinity when unreachable.
+// Rows come from one Dijkstra per location on a thread pool; each search stops once it
+// has settled every selected location or passed `radius`. A cache-blocked min-plus
+// (Floyd-Warshall) closure then routes pairs the searches cut short through the other
+// selected locations. Saved tables are mapped back and read in place.
+class DistanceTable {
+private:
+    static constexpr int BLOCK = 64;   // 64 x 64 floats = 16 KB, one tile fits in L1
+    
+    int count;
+    int stride;                        // row length: count rounded up to BLOCK
+    vector<int> locations;
+    unordered_map<int, int> indexOf;   // location -> row
+    unsigned long long fingerprint;
+    vector<float> owned;
+    unique_ptr<MappedFile> mapped;
+    const float* cells;                // owned.data(), or the rows inside the mapped file
+    
+    // c[i][j] = min(c[i][j], a[i][k] + b[k][j]) for k across one tile. k runs outermost, so
+    // c may alias a or b as Floyd-Warshall requires. Row k of b is copied to the stack first,
+    // which lets the compiler prove the branch-free j loop alias-free and emit SIMD add/min.
+    static void relaxTile(float* c, const float* a, const float* b, int stride) {
+        alignas(64) float bRow[BLOCK];
+        for (int k = 0; k < BLOCK; k++) {
+            memcpy(bRow, b + (size_t)k * stride, sizeof(bRow));
+            for (int i = 0; i < BLOCK; i++) {
+                float aik = a[(size_t)i * stride + k];
+                if (aik == numeric_limits<float>::infinity()) continue;
+                float* cRow = c + (size_t)i * stride;
+                for (int j = 0; j < BLOCK; j++) {
+                    float via = aik + bRow[j];
+                    cRow[j] = via < cRow[j] ? via : cRow[j];
+                }
+            }
+        }
+    }
+    
+    // Bytes of location IDs after the header, padded so the rows start 64-byte aligned
+    static size_t idBytes(uint32_t count) {
+        return ((sizeof(DistanceTableHeader) + (size_t)count * sizeof(int32_t) + 63) & ~(size_t)63) -
+               sizeof(DistanceTableHeader);
+    }
+    
+    float* tile(int rowBlock, int columnBlock) {
+        return owned.data() + (size_t)rowBlock * BLOCK * stride + (size_t)columnBlock * BLOCK;
+    }
+    
+    void reset() {
+        count = stride = 0;
+        locations.clear();
+        indexOf.clear();
+        fingerprint = 0;
+        owned.clear();
+        mapped.reset();
+        cells = nullptr;
+    }
+    
+public:
+    DistanceTable() : count(0), stride(0), fingerprint(0), cells(nullptr) {}
+    
+    // Distances between every pair of `selected` locations (threads = 0 uses all cores)
+    void build(SparseMatrix& graph, const vector<int>& selected, int threads = 0,
+               double radius = numeric_limits<double>::infinity()) {
+        reset();
+        int n = graph.getLocationCount();
+        const vector<int>& offset = graph.getCSROffset();
+        const vector<int>& target = graph.getCSRTarget();
+        const vector<double>& weight = graph.getCSRWeight();
+        fingerprint = graph.getFingerprint();
+        
+        vector<int> rowOfNode(n, -1);
+        for (int location : selected) {
+            if (location < 0 || location >= n || rowOfNode[location] != -1) continue;
+            rowOfNode[location] = (int)locations.size();
+            indexOf[location] = (int)locations.size();
+            locations.push_back(location);
+        }
+        count = (int)locations.size();
+        stride = (count + BLOCK - 1) / BLOCK * BLOCK;
+        owned.assign((size_t)stride * stride, numeric_limits<float>::infinity());
+        cells = owned.data();
+        if (count == 0) return;
+        
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        threads = max(1, min(threads, count));
+        atomic<int> nextRow(0);
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&]() {
+                vector<double> dist(n, numeric_limits<double>::infinity());
+                vector<int> touched;
+                priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> heap;
+                for (int row = nextRow++; row < count; row = nextRow++) {
+                    float* out = owned.data() + (size_t)row * stride;
+                    int remaining = count;
+                    uint64_t settled = 0;
+                    dist[locations[row]] = 0.0;
+                    touched.push_back(locations[row]);
+                    heap.push({0.0, locations[row]});
+                    while (!heap.empty()) {
+                        pair<double, int> top = heap.top();
+                        heap.pop();
+                        int u = top.second;
+                        if (top.first > dist[u]) continue; // Stale entry
+                        if (top.first > radius) break;
+                        settled++;
+                        if (rowOfNode[u] != -1) {
+                            out[rowOfNode[u]] = (float)top.first;
+                            if (--remaining == 0) break;
+                        }
+                        for (int e = offset[u]; e < offset[u + 1]; e++) {
+                            int v = target[e];
+                            double candidate = top.first + weight[e];
+                            if (candidate < dist[v]) {
+                                if (dist[v] == numeric_limits<double>::infinity()) touched.push_back(v);
+                                dist[v] = candidate;
+                                heap.push({candidate, v});
+                            }
+                        }
+                    }
+                    for (int node : touched) dist[node] = numeric_limits<double>::infinity();
+                    touched.clear();
+                    heap = decltype(heap)();
+                    METRIC_COUNT(COUNTER_DIJKSTRA_RUNS, 1);
+                    METRIC_COUNT(COUNTER_DIJKSTRA_SETTLED, settled);
+                }
+            });
+        }
+        for (thread& worker : workers) worker.join();
+        
+        if (radius != numeric_limits<double>::infinity()) close(threads);
+    }
+    
+    // Blocked Floyd-Warshall over the table: per diagonal tile, close the tile itself, then
+    // its tile row and column, then every other tile, the last step split across threads
+    void close(int threads = 0) {
+        if (owned.empty()) return;
+        int blocks = stride / BLOCK;
+        if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+        threads = max(1, min(threads, blocks));
+        
+        for (int kb = 0; kb < blocks; kb++) {
+            relaxTile(tile(kb, kb), tile(kb, kb), tile(kb, kb), stride);
+            for (int b = 0; b < blocks; b++) {
+                if (b == kb) continue;
+                relaxTile(tile(kb, b), tile(kb, kb), tile(kb, b), stride);
+                relaxTile(tile(b, kb), tile(b, kb), tile(kb, kb), stride);
+            }
+            
+            atomic<int> nextBlock(0);
+            vector<thread> workers;
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&]() {
+                    for (int ib = nextBlock++; ib < blocks; ib = nextBlock++) {
+                        if (ib == kb) continue;
+                        for (int jb = 0; jb < blocks; jb++) {
+                            if (jb != kb) relaxTile(tile(ib, jb), tile(ib, kb), tile(kb, jb), stride);
+                        }
+                    }
+                });
+            }
+            for (thread& worker : workers) worker.join();
+        }
+    }
+    
+    // Distance between rows i and j, infinity when unreachable
+    float at(int i, int j) const { return cells[(size_t)i * stride + j]; }
+    
+    // Row of a location, -1 when the table does not cover it
+    int rowOf(int location) const {
+        auto it = indexOf.find(location);
+        return it == indexOf.end() ? -1 : it->second;
+    }
+    
+    int size() const { return count; }
+    
+    const vector<int>& getLocations() const { return locations; }
+    
+    bool builtFrom(unsigned long long graphFingerprint) const { return cells && fingerprint == graphFingerprint; }
+    
+    bool covers(const vector<int>& wanted) const {
+        for (int location : wanted) {
+            if (!indexOf.count(location)) return false;
+        }
+        return true;
+    }
+    
+    bool save(const string& filename, string& error) const {
+        DistanceTableHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "SDRODT01", sizeof(header.magic));
+        header.version = DISTANCE_TABLE_VERSION;
+        header.count = count;
+        header.stride = stride;
+        header.fingerprint = fingerprint;
+        
+        vector<char> body(idBytes(count), 0);
+        for (int i = 0; i < count; i++) {
+            int32_t location = locations[i];
+            memcpy(&body[i * sizeof(int32_t)], &location, sizeof(location));
+        }
+        body.insert(body.end(), (const char*)cells, (const char*)(cells + (size_t)stride * count));
+        header.checksum = persistenceChecksum(body.data(), body.size());
+        
+        string temporary = filename + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "wb");
+        bool written = file && fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(body.data(), 1, body.size(), file) == body.size() && fflush(file) == 0;
+        if (file) fclose(file);
+        if (!written || rename(temporary.c_str(), filename.c_str()) != 0) {
+            error = "cannot write distance table " + filename;
+            remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+    
+    // Map a saved table; its rows are read straight from the mapping
+    bool load(const string& filename, string& error) {
+        reset();
+        unique_ptr<MappedFile> file(new MappedFile());
+        if (!file->open(filename, error)) return false;
+        DistanceTableHeader header;
+        if (file->size() < sizeof(header)) {
+            error = filename + " is not a distance table";
+            return false;
+        }
+        memcpy(&header, file->data(), sizeof(header));
+        if (memcmp(header.magic, "SDRODT01", sizeof(header.magic)) != 0 ||
+            header.version != DISTANCE_TABLE_VERSION || header.stride < header.count ||
+            file->size() != sizeof(header) + idBytes(header.count) + (size_t)header.stride * header.count * sizeof(float) ||
+            persistenceChecksum(file->data() + sizeof(header), file->size() - sizeof(header)) != header.checksum) {
+            error = filename + " is not a valid distance table";
+            return false;
+        }
+        
+        count = header.count;
+        stride = header.stride;
+        fingerprint = header.fingerprint;
+        for (int i = 0; i < count; i++) {
+            int32_t location;
+            memcpy(&location, file->data() + sizeof(header) + i * sizeof(int32_t), sizeof(location));
+            indexOf[location] = i;
+            locations.push_back(location);
+        }
+        cells = (const float*)(file->data() + sizeof(header) + idBytes(header.count));
+        mapped = move(file);
+        return true;
+    }
+};
+
+// ==================== DISCRETE-EVENT SIMULATION ====================
+
+// Settings for a DeliverySimulation run
+struct SimulationOptions {
+    double speedKmh;        // courier speed on every road
+    int leadMinutes;        // how long before its delivery window opens an order comes in
+    DispatchPolicy policy;
+    
+    SimulationOptions() : speedKmh(30.0), leadMinutes(120), policy(DISPATCH_BY_PRIORITY) {}
+};
+
+// Replays a stream of orders against a courier fleet on a simulated clock. A min-heap of
+// events drives the run: an order comes in (arrival), a courier reaches the customer
+// (delivered) and a courier is back at the warehouse and free again (release). After an
+// arrival or release, a dispatch round matches pending orders with free couriers once every
+// event at that time has been handled. Orders and couriers live in their own
+// AppointmentStore and CircularQueue, so the dispatch policy under test is the real one.
+// Each order's travel time comes from the road distance of its route from the warehouse.
+class DeliverySimulation {
+public:
+    // Values in the log-linear buckets of the hot-path metrics, about 6% resolution
+    struct Distribution {
+        vector<uint64_t> buckets;
+        uint64_t count;       // total weight recorded
+        uint64_t maximum;
+        double sum;
+        
+        Distribution() : buckets(LatencyHistogram::BUCKET_COUNT, 0), count(0), maximum(0), sum(0.0) {}
+        
+        void record(uint64_t value, uint64_t weight = 1) {
+            if (weight == 0) return;
+            buckets[LatencyHistogram::bucketOf(value)] += weight;
+            count += weight;
+            maximum = max(maximum, value);
+            sum += (double)value * weight;
+        }
+        
+        void merge(const Distribution& other) {
+            for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; b++) buckets[b] += other.buckets[b];
+            count += other.count;
+            maximum = max(maximum, other.maximum);
+            sum += other.sum;
+        }
+        
+        double mean() const { return count ? sum / count : 0.0; }
+        
+        // Upper edge of the bucket holding the q-th quantile, capped at the maximum
+        uint64_t quantile(double q) const {
+            if (count == 0) return 0;
+            uint64_t rank = max<uint64_t>(1, (uint64_t)ceil(q * count));
+            uint64_t seen = 0;
+            for (int b = 0; b < LatencyHistogram::BUCKET_COUNT; b++) {
+                seen += buckets[b];
+                if (seen >= rank) return min(LatencyHistogram::upperBound(b), maximum);
+            }
+            return maximum;
+        }
+    };
+    
+    struct Result {
+        int orders;             // orders that came in
+        int rejected;           // rows with an unreadable delivery time
+        int delivered;
+        int late;               // delivered after their window closed
+        int unroutable;         // no road from the warehouse; dropped at dispatch
+        int waiting;            // never dispatched before the stream ran dry
+        long long events;
+        double setupMs;         // sorting and copying the stream
+        double wallMs;          // the event loop
+        double firstMinute;     // simulated clock at the first and last event
+        double lastMinute;
+        double busyMinutes;     // courier time spent on trips
+        int fleetSize;
+        Distribution latencySeconds;     // order arrival -> delivered
+        Distribution queueDepth;         // pending orders, weighted by simulated milliseconds
+        
+        Result() : orders(0), rejected(0), delivered(0), late(0), unroutable(0), waiting(0), events(0),
+                   setupMs(0.0), wallMs(0.0), firstMinute(0.0), lastMinute(0.0), busyMinutes(0.0), fleetSize(0) {}
+    };
+    
+private:
+    enum EventType {
+        EVENT_ARRIVAL,
+        EVENT_DISPATCH,
+        EVENT_DELIVERED,
+        EVENT_RELEASE
+    };
+    
+    // 16 bytes, which keeps the heap small and its moves cheap
+    struct Event {
+        double time;          // simulated minutes since epoch
+        int type;
+        int order;            // position in the arrival-ordered stream
+        
+        bool operator>(const Event& other) const { return time > other.time; }
+    };
+    
+    const vector<AppointmentRow>& rows;
+    const vector<double>& travelKm;      // per row, infinity when unroutable
+    const vector<Courier>& roster;
+    SimulationOptions options;
+    
+public:
+    DeliverySimulation(const vector<AppointmentRow>& stream, const vector<double>& routeKm,
+                       const vector<Courier>& fleet, const SimulationOptions& settings)
+        : rows(stream), travelKm(routeKm), roster(fleet), options(settings) {}
+    
+    Result run() {
+        Result result;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        
+        // Orders come in `leadMinutes` before their window opens. The stream is copied into
+        // arrival order so each event reads the per-order arrays close to the previous one,
+        // and only the next arrival sits in the heap, so it holds about one event per trip.
+        vector<pair<double, int>> byArrival;
+        byArrival.reserve(rows.size());
+        vector<double> closes(rows.size());
+        TimeWindow window;
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (rows[i].hasWindow) {
+                window = rows[i].window;
+            } else if (!parseTimeWindow(rows[i].deliveryTime, window)) {
+                result.rejected++;
+                continue;
+            }
+            byArrival.push_back({(double)(window.earliest - options.leadMinutes), (int)i});
+            closes[i] = (double)window.latest;
+        }
+        sort(byArrival.begin(), byArrival.end());
+        size_t count = byArrival.size();
+        vector<AppointmentRow> stream(count);
+        vector<double> arrival(count), deadline(count), tripKm(count);
+        for (size_t k = 0; k < count; k++) {
+            int i = byArrival[k].second;
+            // IDs are stream positions, so all are unique. Names and addresses are never shown
+            // and destinations are already resolved, so the store is spared copying them.
+            stream[k] = rows[i];
+            stream[k].appointmentId = (int)k;
+            stream[k].customerName = string_view();
+            stream[k].address = string_view();
+            arrival[k] = byArrival[k].first;
+            deadline[k] = closes[i];
+            tripKm[k] = travelKm[i];
+        }
+        vector<pair<double, int>>().swap(byArrival);
+        vector<double>().swap(closes);
+        
+        AppointmentStore orders;
+        orders.setDispatchPolicy(options.policy);
+        CircularQueue fleet((int)roster.size());
+        for (const Courier& courier : roster) fleet.push(courier.courierId, courier.name, courier.zoneName(), courier.maxLoad);
+        result.fleetSize = fleet.getSize();
+        double minutesPerKm = 60.0 / max(1e-9, options.speedKmh);
+        result.setupMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        start = chrono::steady_clock::now();
+        
+        priority_queue<Event, vector<Event>, greater<Event>> events;
+        auto schedule = [&](double time, int type, int order) { events.push({time, type, order}); };
+        if (count > 0) {
+            schedule(arrival[0], EVENT_ARRIVAL, 0);
+            result.firstMinute = arrival[0];
+        }
+        vector<int> courierOf(count, -1);
+        vector<double> tripMinutes(count, 0.0);
+        
+        vector<AppointmentRow> single(1);
+        int pending = 0;
+        bool dispatchDue = false;   // an order came in or a courier came back since the last round
+        double clock = result.firstMinute;
+        while (!events.empty() || dispatchDue) {
+            Event event;
+            if (dispatchDue && (events.empty() || events.top().time > clock)) {
+                event = {clock, EVENT_DISPATCH, -1};
+            } else {
+                event = events.top();
+                events.pop();
+            }
+            result.events++;
+            result.queueDepth.record(pending, (uint64_t)((event.time - clock) * 60000.0));
+            clock = event.time;
+            
+            switch (event.type) {
+            case EVENT_ARRIVAL:
+                single[0] = stream[event.order];
+                orders.addAppointments(single);
+                pending++;
+                result.orders++;
+                if ((size_t)event.order + 1 < count) schedule(arrival[event.order + 1], EVENT_ARRIVAL, event.order + 1);
+                dispatchDue = true;
+                break;
+                
+            case EVENT_DISPATCH:
+                // Hand out pending orders until none is left or no courier is free
+                dispatchDue = false;
+                orders.advanceClock((long long)clock);
+                while (DeliveryAppointment* next = orders.getNextPendingAppointment()) {
+                    int order = next->appointmentId;
+                    if (tripKm[order] == numeric_limits<double>::infinity()) {
+                        orders.removeAppointment(order);
+                        pending--;
+                        result.unroutable++;
+                        continue;
+                    }
+                    Courier courier = fleet.getAvailableCourierForZone(next->zoneId);
+                    if (courier.courierId == -1) break;
+                    fleet.assignDelivery(courier.courierId, next->zoneId);
+                    orders.completeAppointment(order);
+                    pending--;
+                    courierOf[order] = courier.courierId;
+                    tripMinutes[order] = tripKm[order] * minutesPerKm;
+                    schedule(clock + tripMinutes[order], EVENT_DELIVERED, order);
+                    result.busyMinutes += 2 * tripMinutes[order];
+                }
+                break;
+                
+            case EVENT_DELIVERED:
+                result.delivered++;
+                if (clock > deadline[event.order]) result.late++;
+                result.latencySeconds.record((uint64_t)((clock - arrival[event.order]) * 60.0));
+                orders.removeAppointment(event.order);
+                schedule(clock + tripMinutes[event.order], EVENT_RELEASE, event.order);   // drive back
+                break;
+                
+            case EVENT_RELEASE:
+                fleet.releaseCourier(courierOf[event.order]);
+                dispatchDue = pending > 0;
+                break;
+            }
+        }
+        
+        result.waiting = pending;
+        result.lastMinute = clock;
+        result.wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+};
+
+// ==================== DELIVERY MANAGEMENT SYSTEM ====================
+
+// A route query between two location or zone names and, once answered, the road
+// distance in km (-1 when an end is unknown or unreachable) and the stops on the way
+struct RouteQuery {
+    string_view from;
+    string_view to;
+    double distance;
+    vector<int> path;
+};
+
+class DeliveryOptimizer {
+private:
+    AppointmentStore appointments;
+    CircularQueue courierQueue;
+    SparseMatrix routingMatrix;
+    int appointmentIdCounter;
+    int courierIdCounter;
+    int routeTimeBudgetMs;
+    unique_ptr<WriteAheadLog> journal;   // null unless persistence is open
+    string snapshotFile;
+    DistanceTable distanceTable;         // reused by batch planning while the graph is unchanged
+    
+    // Write the whole state to `filename` through a temporary file and a rename,
+    // so a crash mid-write leaves the previous snapshot intact
+    bool writeSnapshot(const string& filename, uint64_t lastLsn, string& error) {
+        vector<char> text;
+        auto addText = [&text](string_view value) {
+            SnapshotText ref = {text.size(), value.size()};
+            text.insert(text.end(), value.begin(), value.end());
+            return ref;
+        };
+        
+        vector<SnapshotText> zones;
+        unordered_map<int, int> zoneIndex;   // interned zone ID -> SECTION_ZONES index
+        auto zoneOf = [&](int zoneId) {
+            auto known = zoneIndex.find(zoneId);
+            if (known != zoneIndex.end()) return known->second;
+            zones.push_back(addText(nameTable().name(zoneId)));
+            return zoneIndex[zoneId] = (int)zones.size() - 1;
+        };
+        
+        vector<DeliveryAppointment*> allApps = appointments.getAllAppointments();
+        vector<SnapshotAppointment> appRecords(allApps.size());
+        for (size_t i = 0; i < allApps.size(); i++) {
+            const DeliveryAppointment* app = allApps[i];
+            SnapshotAppointment& record = appRecords[i];
+            record.appointmentId = app->appointmentId;
+            record.priority = app->priority;
+            record.zone = zoneOf(app->zoneId);
+            record.completed = app->completed;
+            record.customerName = addText(app->customerName);
+            record.address = addText(app->address);
+            record.deliveryTime = addText(app->deliveryTime);
+            record.earliest = app->window.earliest;
+            record.latest = app->window.latest;
+        }
+        
+        vector<Courier> allCouriers = courierQueue.getAllCouriers();
+        vector<SnapshotCourier> courierRecords(allCouriers.size());
+        for (size_t i = 0; i < allCouriers.size(); i++) {
+            const Courier& courier = allCouriers[i];
+            SnapshotCourier& record = courierRecords[i];
+            record.courierId = courier.courierId;
+            record.zone = zoneOf(courier.zoneId);
+            record.currentLoad = courier.currentLoad;
+            record.maxLoad = courier.maxLoad;
+            record.available = courier.available;
+            record.reserved = 0;
+            record.name = addText(courier.name);
+        }
+        
+        vector<SnapshotLocation> locationRecords;
+        const LocationRegistry& registry = routingMatrix.getLocations();
+        for (int node = 0; node < registry.extent(); node++) {
+            if (registry.name(node).empty()) continue;
+            SnapshotLocation record;
+            record.node = node;
+            record.zone = registry.zoneOf(node) == -1 ? -1 : zoneOf(registry.zoneOf(node));
+            record.externalId = registry.externalId(node);
+            record.name = addText(registry.name(node));
+            locationRecords.push_back(record);
+        }
+        // Coordinates for every location, or an empty section when none are known
+        vector<SnapshotCoordinate> coordinates;
+        const double unknown = numeric_limits<double>::quiet_NaN();
+        for (int node = 0; node < routingMatrix.getLocationCount(); node++) {
+            SnapshotCoordinate point = {unknown, unknown};
+            bool located = routingMatrix.getCoordinates(node, point.latitude, point.longitude);
+            if (located && coordinates.empty()) coordinates.resize(routingMatrix.getLocationCount(), {unknown, unknown});
+            if (located) coordinates[node] = point;
+        }
+        const vector<int>& offset = routingMatrix.getCSROffset();
+        const vector<int>& target = routingMatrix.getCSRTarget();
+        const vector<double>& weight = routingMatrix.getCSRWeight();
+        
+        // Lay the sections out back to back on 8-byte boundaries
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "SDROSN01", sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.sectionCount = SNAPSHOT_SECTION_COUNT;
+        header.lastLsn = lastLsn;
+        header.nextAppointmentId = appointmentIdCounter;
+        header.nextCourierId = courierIdCounter;
+        
+        vector<char> body;
+        auto addSection = [&](SnapshotSectionId id, const void* data, size_t count, size_t elementSize) {
+            body.resize((body.size() + 7) & ~(size_t)7, 0);
+            header.sections[id].offset = sizeof(header) + body.size();
+            header.sections[id].count = count;
+            body.insert(body.end(), (const char*)data, (const char*)data + count * elementSize);
+        };
+        addSection(SECTION_TEXT, text.data(), text.size(), 1);
+        addSection(SECTION_ZONES, zones.data(), zones.size(), sizeof(SnapshotText));
+        addSection(SECTION_APPOINTMENTS, appRecords.data(), appRecords.size(), sizeof(SnapshotAppointment));
+        addSection(SECTION_COURIERS, courierRecords.data(), courierRecords.size(), sizeof(SnapshotCourier));
+        addSection(SECTION_GRAPH_OFFSET, offset.data(), offset.size(), sizeof(int32_t));
+        addSection(SECTION_GRAPH_TARGET, target.data(), target.size(), sizeof(int32_t));
+        addSection(SECTION_GRAPH_WEIGHT, weight.data(), weight.size(), sizeof(double));
+        addSection(SECTION_LOCATIONS, locationRecords.data(), locationRecords.size(), sizeof(SnapshotLocation));
+        addSection(SECTION_COORDINATES, coordinates.data(), coordinates.size(), sizeof(SnapshotCoordinate));
+        header.fileSize = sizeof(header) + body.size();
+        header.checksum = persistenceChecksum(body.data(), body.size());
+        
+        string temporary = filename + ".tmp";
+        FILE* file = fopen(temporary.c_str(), "wb");
+        bool written = file && fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(body.data(), 1, body.size(), file) == body.size() &&
+                       fflush(file) == 0 && fsync(fileno(file)) == 0;
+        if (file) fclose(file);
+        if (!written || rename(temporary.c_str(), filename.c_str()) != 0) {
+            error = "cannot write snapshot " + filename;
+            remove(temporary.c_str());
+            return false;
+        }
+        if (!syncParentDirectory(filename)) {
+            error = "cannot sync the directory of " + filename;
+            return false;
+        }
+        return true;
+    }
+    
+    // Load a snapshot written by writeSnapshot into this (fresh) optimizer
+    bool restoreSnapshot(const string& filename, uint64_t& lastLsn, string& error) {
+        MappedFile file;
+        if (!file.open(filename, error)) return false;
+        const char* data = file.data();
+        size_t size = file.size();
+        
+        SnapshotHeader header;
+        if (size < sizeof(header)) {
+            error = filename + " is not a snapshot";
+            return false;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, "SDROSN01", sizeof(header.magic)) != 0) {
+            error = filename + " is not a snapshot";
+            return false;
+        }
+        if (header.version != SNAPSHOT_VERSION || header.sectionCount != SNAPSHOT_SECTION_COUNT) {
+            error = filename + " has unsupported snapshot version " + to_string(header.version);
+            return false;
+        }
+        if (header.fileSize != size ||
+            persistenceChecksum(data + sizeof(header), size - sizeof(header)) != header.checksum) {
+            error = filename + " is truncated or corrupt";
+            return false;
+        }
+        
+        // Every section must lie inside the file before anything is read from it
+        const size_t elementSizes[SNAPSHOT_SECTION_COUNT] = {
+            1, sizeof(SnapshotText), sizeof(SnapshotAppointment), sizeof(SnapshotCourier),
+            sizeof(int32_t), sizeof(int32_t), sizeof(double), sizeof(SnapshotLocation), sizeof(SnapshotCoordinate)
+        };
+        for (int id = 0; id < SNAPSHOT_SECTION_COUNT; id++) {
+            const SnapshotSection& section = header.sections[id];
+            if (section.offset > size || section.count > (size - section.offset) / elementSizes[id]) {
+                error = filename + " has a bad section table";
+                return false;
+            }
+        }
+        auto section = [&](SnapshotSectionId id) { return data + header.sections[id].offset; };
+        const char* text = section(SECTION_TEXT);
+        uint64_t textSize = header.sections[SECTION_TEXT].count;
+        auto textOf = [&](const SnapshotText& ref, string_view& value) {
+            if (ref.offset > textSize || ref.length > textSize - ref.offset) return false;
+            value = string_view(text + ref.offset, ref.length);
+            return true;
+        };
+        
+        vector<int> zoneIds(header.sections[SECTION_ZONES].count);
+        const SnapshotText* zones = (const SnapshotText*)section(SECTION_ZONES);
+        for (size_t i = 0; i < zoneIds.size(); i++) {
+            string_view zone;
+            if (!textOf(zones[i], zone)) {
+                error = filename + " has a bad zone name";
+                return false;
+            }
+            zoneIds[i] = nameTable().intern(zone);
+        }
+        
+        // Graph first, so a malformed CSR is rejected before any state changes
+        uint64_t locations = header.sections[SECTION_GRAPH_OFFSET].count;
+        const int32_t* offset = (const int32_t*)section(SECTION_GRAPH_OFFSET);
+        const int32_t* target = (const int32_t*)section(SECTION_GRAPH_TARGET);
+        uint64_t edges = header.sections[SECTION_GRAPH_TARGET].count;
+        bool graphValid = locations >= 2 && offset[0] == 0 && (uint64_t)offset[locations - 1] == edges &&
+                          header.sections[SECTION_GRAPH_WEIGHT].count == edges;
+        for (uint64_t i = 1; graphValid && i < locations; i++) graphValid = offset[i] >= offset[i - 1];
+        for (uint64_t e = 0; graphValid && e < edges; e++) {
+            graphValid = target[e] >= 0 && (uint64_t)target[e] < locations - 1;
+        }
+        vector<tuple<int, string_view, string_view, long long>> named(header.sections[SECTION_LOCATIONS].count);
+        const SnapshotLocation* locationRecords = (const SnapshotLocation*)section(SECTION_LOCATIONS);
+        for (size_t i = 0; graphValid && i < named.size(); i++) {
+            const SnapshotLocation& record = locationRecords[i];
+            string_view name;
+            graphValid = record.node >= 0 && (uint64_t)record.node < locations - 1 && textOf(record.name, name) &&
+                         record.zone >= -1 && record.zone < (int64_t)zoneIds.size();
+            if (graphValid) {
+                string_view zone = record.zone == -1 ? string_view() : nameTable().name(zoneIds[record.zone]);
+                named[i] = make_tuple((int)record.node, name, zone, (long long)record.externalId);
+            }
+        }
+        if (!graphValid) {
+            error = filename + " has a malformed routing graph";
+            return false;
+        }
+        routingMatrix.restoreGraph((int)locations - 1, offset, target,
+                                   (const double*)section(SECTION_GRAPH_WEIGHT), named);
+        const SnapshotCoordinate* coordinates = (const SnapshotCoordinate*)section(SECTION_COORDINATES);
+        for (uint64_t node = 0; node < header.sections[SECTION_COORDINATES].count && node < locations - 1; node++) {
+            if (!isnan(coordinates[node].latitude)) {
+                routingMatrix.setCoordinates((int)node, coordinates[node].latitude, coordinates[node].longitude);
+            }
+        }
+        
+        const SnapshotAppointment* appRecords = (const SnapshotAppointment*)section(SECTION_APPOINTMENTS);
+        vector<AppointmentRow> rows(header.sections[SECTION_APPOINTMENTS].count);
+        for (size_t i = 0; i < rows.size(); i++) {
+            const SnapshotAppointment& record = appRecords[i];
+            AppointmentRow& row = rows[i];
+            row.appointmentId = record.appointmentId;
+            row.priority = record.priority;
+            if (record.zone < 0 || (size_t)record.zone >= zoneIds.size() ||
+                !textOf(record.customerName, row.customerName) || !textOf(record.address, row.address) ||
+                !textOf(record.deliveryTime, row.deliveryTime)) {
+                error = filename + " has a malformed appointment record";
+                return false;
+            }
+            row.zone = nameTable().name(zoneIds[record.zone]);
+            row.window.earliest = record.earliest;
+            row.window.latest = record.latest;
+            row.hasWindow = true;
+        }
+        appointments.addAppointments(rows);
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (appRecords[i].completed) appointments.completeAppointment(appRecords[i].appointmentId);
+        }
+        
+        const SnapshotCourier* courierRecords = (const SnapshotCourier*)section(SECTION_COURIERS);
+        for (uint64_t i = 0; i < header.sections[SECTION_COURIERS].count; i++) {
+            const SnapshotCourier& record = courierRecords[i];
+            string_view name;
+            if (record.zone < 0 || (size_t)record.zone >= zoneIds.size() || !textOf(record.name, name)) {
+                error = filename + " has a malformed courier record";
+                return false;
+            }
+            int zone = zoneIds[record.zone];
+            courierQueue.push(record.courierId, name, nameTable().name(zone), max(1, (int)record.maxLoad));
+            courierQueue.restoreCourierState(record.courierId, zone, record.available != 0, record.currentLoad);
+        }
+        
+        appointmentIdCounter = max(appointmentIdCounter, (int)header.nextAppointmentId);
+        courierIdCounter = max(courierIdCounter, (int)header.nextCourierId);
+        lastLsn = header.lastLsn;
+        return true;
+    }
+    
+    // Redo one logged operation. Consecutive appointment adds are collected in `pendingAdds`
+    // and bulk-inserted; any other record inserts them first to keep the original order.
+    void applyLogRecord(LogRecord& record, vector<AppointmentRow>& pendingAdds) {
+        if (record.type != LOG_ADD_APPOINTMENT && !pendingAdds.empty()) {
+            addAppointments(pendingAdds);
+            pendingAdds.clear();
+        }
+        
+        int id = 0, value = 0;
+        string_view name, zone;
+        switch (record.type) {
+            case LOG_ADD_APPOINTMENT: {
+                AppointmentRow row;
+                if (record.readInt(row.appointmentId) && record.readInt(row.priority) &&
+                    record.readText(row.customerName) && record.readText(row.address) &&
+                    record.readText(row.deliveryTime) && record.readText(row.zone)) {
+                    // Records from before the window was logged re-parse the text
+                    row.hasWindow = record.readLong(row.window.earliest) && record.readLong(row.window.latest);
+                    pendingAdds.push_back(row);
+                }
+                break;
+            }
+            case LOG_REMOVE_APPOINTMENT:
+                if (record.readInt(id)) appointments.removeAppointment(id);
+                break;
+            case LOG_COMPLETE_APPOINTMENT:
+                if (record.readInt(id)) appointments.completeAppointment(id);
+                break;
+            case LOG_ADD_COURIER:
+                if (record.readInt(id) && record.readInt(value) && record.readText(name) && record.readText(zone) &&
+                    courierQueue.push(id, name, zone, max(1, value))) {
+                    courierIdCounter = max(courierIdCounter, id + 1);
+                }
+                break;
+            case LOG_ASSIGN_COURIER:
+                if (record.readInt(id) && record.readText(zone)) courierQueue.assignDelivery(id, zone);
+                break;
+            case LOG_RELEASE_COURIER:
+                if (record.readInt(id)) courierQueue.releaseCourier(id);
+                break;
+            case LOG_ASSIGN_BATCH: {
+                vector<BatchAssignment> batch;
+                if (!record.readInt(value) || value < 0) break;
+                for (int i = 0; i < value; i++) {
+                    BatchAssignment assignment;
+                    if (!record.readInt(assignment.courierId) || !record.readInt(assignment.appointmentId) ||
+                        !record.readText(assignment.zone)) {
+                        return;
+                    }
+                    batch.push_back(assignment);
+                }
+                for (const BatchAssignment& assignment : batch) {
+                    courierQueue.assignDelivery(assignment.courierId, assignment.zone);
+                    appointments.completeAppointment(assignment.appointmentId);
+                }
+                break;
+            }
+        }
+    }
+    
+public:
+    DeliveryOptimizer() 
+        : appointments(), courierQueue(10), routingMatrix(10), 
+          appointmentIdCounter(1), courierIdCounter(1), routeTimeBudgetMs(200) {
+        initializeRoutingMatrix();
+    }
+    
+    // Restore from the snapshot (if present) plus the log tail, then keep logging every
+    // change to `logFile`. Call on a freshly constructed optimizer.
+    bool openPersistence(const string& snapshot, const string& logFile, bool syncWrites, string& error) {
+        uint64_t lastLsn = 0;
+        if (!snapshot.empty() && access(snapshot.c_str(), F_OK) == 0 &&
+            !restoreSnapshot(snapshot, lastLsn, error)) {
+            return false;
+        }
+        snapshotFile = snapshot;
+        if (logFile.empty()) return true;
+        
+        vector<AppointmentRow> pendingAdds;
+        uint64_t validBytes = 0;
+        if (!WriteAheadLog::replay(logFile, lastLsn,
+                                   [&](LogRecord& record) { applyLogRecord(record, pendingAdds); },
+                                   [&]() { if (!pendingAdds.empty()) addAppointments(pendingAdds); },
+                                   lastLsn, validBytes, error)) {
+            return false;
+        }
+        
+        journal.reset(new WriteAheadLog());
+        journal->setSyncOnFlush(syncWrites);
+        if (!journal->open(logFile, lastLsn, validBytes, error)) {
+            journal.reset();
+            return false;
+        }
+        return true;
+    }
+    
+    // Fold the log into a fresh snapshot, then empty the log
+    bool checkpoint(string& error) {
+        if (snapshotFile.empty()) {
+            error = "no snapshot file configured";
+            return false;
+        }
+        uint64_t lastLsn = journal ? journal->getLastLsn() : 0;
+        if (!writeSnapshot(snapshotFile, lastLsn, error)) return false;
+        if (journal && !journal->reset()) {
+            error = "cannot truncate the log";
+            return false;
+        }
+        return true;
+    }
+    
+    // Push buffered log records to the file (and disk, when syncing)
+    bool flushLog() {
+        return !journal || journal->flush();
+    }
+    
+    // Routing node for an appointment: its address when that is a registered location,
+    // otherwise the hub of its zone. Both are hash lookups.
+    int locationOf(const DeliveryAppointment* app) {
+        int node = routingMatrix.getLocations().findByName(app->address);
+        return node != -1 ? node : routingMatrix.getZoneHub(app->zoneId);
+    }
+    
+    void initializeRoutingMatrix() {
+        // Zone A connections
+        routingMatrix.addEdge(0, 1, 3.5);  // Zone-A-Center -> Zone-A-East
+        routingMatrix.addEdge(0, 2, 4.0);  // Zone-A-Center -> Zone-A-West
+        routingMatrix.addEdge(0, 9, 8.0);  // Zone-A-Center -> Warehouse
+        
+        // Zone B connections
+        routingMatrix.addEdge(3, 4, 5.0);  // Zone-B-Center -> Zone-B-North
+        routingMatrix.addEdge(3, 5, 4.5);  // Zone-B-Center -> Zone-B-South
+        routingMatrix.addEdge(3, 9, 10.0); // Zone-B-Center -> Warehouse
+        
+        // Zone C connections
+        routingMatrix.addEdge(6, 7, 3.0);  // Zone-C-Center -> Zone-C-East
+        routingMatrix.addEdge(6, 8, 3.5);  // Zone-C-Center -> Zone-C-West
+        routingMatrix.addEdge(6, 9, 12.0); // Zone-C-Center -> Warehouse
+        
+        // Inter-zone connections
+        routingMatrix.addEdge(0, 3, 15.0); // Zone-A -> Zone-B
+        routingMatrix.addEdge(3, 6, 18.0); // Zone-B -> Zone-C
+        routingMatrix.addEdge(0, 6, 20.0); // Zone-A -> Zone-C
+    }
+    
+    void addAppointment() {
+        string name, address, time, zone;
+        int priority;
+        
+        cout << "\nEnter customer name: ";
+        cin.ignore();
+        getline(cin, name);
+        cout << "Enter address: ";
+        getline(cin, address);
+        cout << "Enter delivery time (HH:MM or HH:MM-HH:MM): ";
+        cin >> time;
+        cout << "Enter priority (1-5, 1=highest): ";
+        cin >> priority;
+        if (priority < 1) priority = 1;
+        if (priority > 5) priority = 5;
+        cout << "Enter zone (A, B, or C): ";
+        cin >> zone;
+        
+        string fullZone = "Zone-" + zone;
+        if (appointments.addAppointment(appointmentIdCounter, name, address, time, priority, fullZone)) {
+            if (journal) {
+                const DeliveryAppointment* app = appointments.findAppointment(appointmentIdCounter);
+                journal->logAddAppointment(app->appointmentId, app->customerName, app->address, app->deliveryTime,
+                                           app->priority, app->zoneName(), app->window);
+            }
+            appointmentIdCounter++;
+        }
+        flushLog();
+    }
+    
+    void addCourier() {
+        string name, zone;
+        cout << "\nEnter courier name: ";
+        cin.ignore();
+        getline(cin, name);
+        cout << "Enter initial zone (A, B, or C): ";
+        cin >> zone;
+        
+        string fullZone = "Zone-" + zone;
+        if (journal) journal->logAddCourier(courierIdCounter, name, fullZone, 5);
+        courierQueue.enqueue(courierIdCounter++, name, fullZone);
+        flushLog();
+    }
+    
+    bool removeAppointment(int id) {
+        if (!appointments.removeAppointment(id)) return false;
+        if (journal) journal->logRemoveAppointment(id);
+        return true;
+    }
+    
+    // A courier finished a delivery: one load off, available again. False for an unknown ID.
+    bool releaseCourier(int courierId) {
+        if (!courierQueue.releaseCourier(courierId)) return false;
+        if (journal) journal->logReleaseCourier(courierId);
+        return true;
+    }
+    
+    bool dispatchNextDelivery() {
+        METRIC_TIMER(HIST_DISPATCH_NEXT);
+        DeliveryAppointment* nextApp = appointments.getNextPendingAppointment();
+        if (!nextApp) {
+            cout << "No pending appointments to dispatch.\n";
+            return false;
+        }
+        
+        Courier courier = courierQueue.getAvailableCourierForZone(nextApp->zoneId);
+        if (courier.courierId == -1) {
+            cout << "No available courier for appointment #" << nextApp->appointmentId << "\n";
+            return false;
+        }
+        
+        cout << "\n========== DISPATCH ASSIGNMENT ==========\n";
+        cout << "Appointment #" << nextApp->appointmentId << "\n";
+        cout << "Customer: " << nextApp->customerName << "\n";
+        cout << "Address: " << nextApp->address << "\n";
+        cout << "Zone: " << nextApp->zoneName() << "\n";
+        cout << "Assigned to: " << courier.name << " (ID: " << courier.courierId << ")\n";
+        
+        // Calculate route
+        int warehouseIndex = 9; // Warehouse index
+        int targetZoneIndex = locationOf(nextApp);
+        
+        if (targetZoneIndex != -1) {
+            const ShortestPathTree& tree = routingMatrix.getShortestPathTree(warehouseIndex);
+            vector<int> route = routingMatrix.getPathFromTree(tree, targetZoneIndex);
+            double cost = route.empty() ? 0.0 : routingMatrix.getTreeDistance(tree, targetZoneIndex);
+            
+            cout << "\nOptimized Route:\n";
+            cout << "Warehouse";
+            for (size_t i = 1; i < route.size(); i++) {
+                cout << " -> " << routingMatrix.getLocationName(route[i]);
+            }
+            cout << "\nTotal Distance: " << fixed << setprecision(2) << cost << " km\n";
+            cout << "Estimated Cost: $" << fixed << setprecision(2) << (cost * 1.5) << "\n";
+        }
+        
+        if (journal) {
+            journal->logAssignCourier(courier.courierId, nextApp->zoneName());
+            journal->logCompleteAppointment(nextApp->appointmentId);
+        }
+        courierQueue.assignDelivery(courier.courierId, nextApp->zoneId);
+        appointments.completeAppointment(nextApp->appointmentId);
+        cout << "\nDelivery dispatched successfully!\n\n";
+        return true;
+    }
+    
+    // Dispatch every pending appointment on a pool of worker threads fed by `producers`
+    // intake threads, then commit the courier assignments. Prints one line per delivery.
+    // Assigns exactly what dispatchAll would; `assigned`, if given, gets the assignments in
+    // dispatch order.
+    int dispatchConcurrent(int workerCount, int producers = 1, vector<DispatchResult>* assigned = nullptr) {
+        vector<DeliveryAppointment*> pendingApps = appointments.getPendingAppointments();
+        if (pendingApps.empty()) {
+            cout << "No pending appointments to dispatch.\n";
+            return 0;
+        }
+        
+        int warehouseIndex = 9;
+        ConcurrentDispatchEngine engine(routingMatrix.createSnapshot({warehouseIndex}), warehouseIndex,
+                                        courierQueue.getCouriersInDispatchOrder());
+        engine.start(workerCount, pendingApps.size());
+        
+        producers = max(1, producers);
+        vector<thread> intake;
+        for (int p = 0; p < producers; p++) {
+            intake.emplace_back([&, p]() {
+                for (size_t i = p; i < pendingApps.size(); i += producers) {
+                    engine.submit((int)i, pendingApps[i]->appointmentId, pendingApps[i]->zoneId,
+                                  locationOf(pendingApps[i]));
+                }
+            });
+        }
+        for (thread& producer : intake) producer.join();
+        vector<DispatchResult> results = engine.finish();
+        
+        int dispatched = 0;
+        for (const DispatchResult& result : results) {
+            if (result.courierId == -1) {
+                cout << "No available courier for appointment #" << result.appointmentId << "\n";
+                continue;
+            }
+            DeliveryAppointment* app = appointments.findAppointment(result.appointmentId);
+            if (journal) {
+                journal->logAssignCourier(result.courierId, app->zoneName());
+                journal->logCompleteAppointment(result.appointmentId);
+            }
+            courierQueue.assignDelivery(result.courierId, app->zoneId);
+            appointments.completeAppointment(result.appointmentId);
+            if (assigned) assigned->push_back(result);
+            cout << "Appointment #" << result.appointmentId << " -> Courier " << result.courierId;
+            if (result.distance >= 0) {
+                cout << " via " << routingMatrix.getLocationName(result.location) << ", "
+                     << fixed << setprecision(2) << result.distance << " km";
+            }
+            cout << "\n";
+            dispatched++;
+        }
+        return dispatched;
+    }
+    
+    // Batch assignment weights, in km. Serving any reachable order beats leaving it, each
+    // priority level above 5 is worth PRIORITY_BONUS_KM of travel, and busier couriers cost
+    // up to LOAD_PENALTY_KM more (FULL_PENALTY_KM once at capacity, as the greedy fallback).
+    static constexpr double SERVICE_VALUE_KM = 1000.0;
+    static constexpr double PRIORITY_BONUS_KM = 100.0;
+    static constexpr double LOAD_PENALTY_KM = 10.0;
+    static constexpr double FULL_PENALTY_KM = 50.0;
+    static constexpr double UNROUTED_TRAVEL_KM = 100.0;   // courier or order without a location
+    
+    // Match up to `batchSize` pending appointments (in dispatch order) with up to as many
+    // available couriers (in queue order) as one batch, maximising the summed benefit:
+    // service value plus priority bonus, minus travel from the courier's zone hub and the
+    // courier's load penalty. The assignments are logged as one record, then applied together.
+    int dispatchBatch(int threads = 0, int batchSize = 2048) {
+        vector<DeliveryAppointment*> pendingApps = appointments.getPendingAppointments();
+        if (pendingApps.empty()) {
+            cout << "No pending appointments to dispatch.\n";
+            return 0;
+        }
+        batchSize = max(1, batchSize);
+        if ((int)pendingApps.size() > batchSize) pendingApps.resize(batchSize);
+        vector<Courier> fleet = courierQueue.getAvailableCouriers();
+        if ((int)fleet.size() > batchSize) fleet.resize(batchSize);
+        if (fleet.empty()) {
+            cout << "No available courier for " << pendingApps.size() << " pending appointments\n";
+            return 0;
+        }
+        
+        // Travel from every distinct courier hub to every order, one shortest-path tree per hub
+        int orders = (int)pendingApps.size(), couriers = (int)fleet.size();
+        vector<int> orderLocation(orders);
+        for (int i = 0; i < orders; i++) orderLocation[i] = locationOf(pendingApps[i]);
+        vector<int> hubOf(couriers, -1);
+        unordered_map<int, int> hubIndex;
+        vector<int> hubs;
+        for (int c = 0; c < couriers; c++) {
+            int hub = routingMatrix.getZoneHub(fleet[c].zoneId);
+            if (hub == -1) continue;
+            auto known = hubIndex.find(hub);
+            if (known == hubIndex.end()) {
+                known = hubIndex.emplace(hub, (int)hubs.size()).first;
+                hubs.push_back(hub);
+            }
+            hubOf[c] = known->second;
+        }
+        vector<double> travel((size_t)hubs.size() * orders);
+        for (size_t h = 0; h < hubs.size(); h++) {
+            const ShortestPathTree& tree = routingMatrix.getShortestPathTree(hubs[h]);
+            for (int i = 0; i < orders; i++) {
+                travel[h * orders + i] = orderLocation[i] == -1 ? UNROUTED_TRAVEL_KM
+                                                                : routingMatrix.getTreeDistance(tree, orderLocation[i]);
+            }
+        }
+        
+        // Benefits in metres; unreachable pairs are worth 0, i.e. never matched
+        vector<double> loadPenalty(couriers);
+        for (int c = 0; c < couriers; c++) {
+            const Courier& courier = fleet[c];
+            loadPenalty[c] = courier.currentLoad >= courier.maxLoad
+                                 ? FULL_PENALTY_KM
+                                 : LOAD_PENALTY_KM * courier.currentLoad / max(1, courier.maxLoad);
+        }
+        vector<long long> benefit((size_t)orders * couriers);
+        for (int i = 0; i < orders; i++) {
+            double value = SERVICE_VALUE_KM + PRIORITY_BONUS_KM * (5 - min(5, max(1, pendingApps[i]->priority)));
+            for (int c = 0; c < couriers; c++) {
+                double distance = hubOf[c] == -1 ? UNROUTED_TRAVEL_KM : travel[(size_t)hubOf[c] * orders + i];
+                double net = distance < 0 ? 0.0 : value - distance - loadPenalty[c];
+                benefit[(size_t)i * couriers + c] = max(0LL, llround(net * 1000.0));
+            }
+        }
+        vector<int> courierOf = AssignmentSolver::solve(benefit, orders, couriers, threads);
+        
+        // Commit: one log record for the whole batch, then every assignment
+        vector<BatchAssignment> batch;
+        for (int i = 0; i < orders; i++) {
+            if (courierOf[i] == -1) continue;
+            batch.push_back({fleet[courierOf[i]].courierId, pendingApps[i]->appointmentId, pendingApps[i]->zoneName()});
+        }
+        if (journal && !batch.empty()) journal->logAssignBatch(batch);
+        double totalTravel = 0.0;
+        for (int i = 0; i < orders; i++) {
+            if (courierOf[i] == -1) continue;
+            const Courier& courier = fleet[courierOf[i]];
+            courierQueue.assignDelivery(courier.courierId, pendingApps[i]->zoneId);
+            appointments.completeAppointment(pendingApps[i]->appointmentId);
+            cout << "Appointment #" << pendingApps[i]->appointmentId << " -> Courier " << courier.courierId;
+            if (hubOf[courierOf[i]] != -1 && orderLocation[i] != -1) {
+                double distance = travel[(size_t)hubOf[courierOf[i]] * orders + i];
+                totalTravel += distance;
+                cout << " from " << routingMatrix.getLocationName(hubs[hubOf[courierOf[i]]]) << ", "
+                     << fixed << setprecision(2) << distance << " km";
+            }
+            cout << "\n";
+        }
+        cout << "Batch: " << batch.size() << " of " << orders << " appointments assigned, "
+             << fixed << setprecision(2) << totalTravel << " km courier travel\n";
+        return (int)batch.size();
+    }
+    
+    // Dispatch until no appointment is pending or no courier is free
+    int dispatchAll() {
+        int dispatched = 0;
+        while (dispatchNextDelivery()) dispatched++;
+        return dispatched;
+    }
+    
+    // Dispatch up to `limit` appointments in dispatch order without printing, each priced from
+    // the warehouse tree (distance -1 when unroutable). Stops once nothing is pending or no
+    // courier is free for the next appointment. Appends to `results`; returns how many.
+    int dispatchQuietly(int limit, vector<DispatchResult>& results) {
+        int warehouseIndex = 9;
+        const ShortestPathTree& tree = routingMatrix.getShortestPathTree(warehouseIndex);
+        int dispatched = 0;
+        while (dispatched < limit) {
+            DeliveryAppointment* app = appointments.getNextPendingAppointment();
+            if (!app) break;
+            Courier courier = courierQueue.getAvailableCourierForZone(app->zoneId);
+            if (courier.courierId == -1) break;
+            
+            if (journal) {
+                journal->logAssignCourier(courier.courierId, app->zoneName());
+                journal->logCompleteAppointment(app->appointmentId);
+            }
+            int location = locationOf(app);
+            results.push_back({app->appointmentId, courier.courierId, location,
+                               location == -1 ? -1.0 : routingMatrix.getTreeDistance(tree, location)});
+            courierQueue.assignDelivery(courier.courierId, app->zoneId);
+            appointments.completeAppointment(app->appointmentId);
+            dispatched++;
+        }
+        return dispatched;
+    }
+    
+    // Answer route queries as one batch. A source asked more than once shares one cached
+    // shortest-path tree; the rest run the selected point-to-point backend.
+    void answerRoutes(vector<RouteQuery>& queries) {
+        vector<pair<int, int>> ends(queries.size());
+        unordered_map<int, int> asked;
+        for (size_t q = 0; q < queries.size(); q++) {
+            ends[q] = {routingMatrix.getLocationIndex(queries[q].from), routingMatrix.getLocationIndex(queries[q].to)};
+            if (ends[q].first != -1) asked[ends[q].first]++;
+        }
+        for (size_t q = 0; q < queries.size(); q++) {
+            RouteQuery& query = queries[q];
+            int from = ends[q].first, to = ends[q].second;
+            query.distance = -1.0;
+            query.path.clear();
+            if (from == -1 || to == -1) continue;
+            if (asked[from] > 1) {
+                const ShortestPathTree& tree = routingMatrix.getShortestPathTree(from);
+                query.path = routingMatrix.getPathFromTree(tree, to);
+                if (!query.path.empty()) query.distance = routingMatrix.getTreeDistance(tree, to);
+            } else {
+                query.path = routingMatrix.findShortestPath(from, to);
+                if (!query.path.empty()) query.distance = routingMatrix.calculateRouteCost(query.path);
+            }
+        }
+    }
+    
+    // ID for a row about to go through addAppointments
+    int nextAppointmentId() { return appointmentIdCounter++; }
+    
+    string getLocationName(int node) { return routingMatrix.getLocationName(node); }
+    
+    // Replay the pending appointments plus `extra` orders through a DeliverySimulation, with
+    // a copy of the fleet or, when no courier is registered, `fleetSize` couriers spread over
+    // the zones. Live appointments and couriers are left as they are. Prints a report.
+    DeliverySimulation::Result simulate(const vector<AppointmentRow>& extra, int fleetSize,
+                                        const SimulationOptions& settings) {
+        vector<AppointmentRow> stream;
+        for (DeliveryAppointment* app : appointments.getPendingAppointments()) {
+            stream.push_back({app->appointmentId, app->customerName, app->address, app->deliveryTime,
+                              app->priority, app->zoneName(), app->window, true});
+        }
+        stream.insert(stream.end(), extra.begin(), extra.end());
+        
+        // Road distance from the warehouse, worked out once per destination
+        int warehouseIndex = 9;
+        const LocationRegistry& registry = routingMatrix.getLocations();
+        const ShortestPathTree& tree = routingMatrix.getShortestPathTree(warehouseIndex);
+        unordered_map<int, double> kmTo;
+        vector<double> travelKm(stream.size());
+        for (size_t i = 0; i < stream.size(); i++) {
+            int node = registry.findByName(stream[i].address);
+            if (node == -1) node = routingMatrix.getZoneHub(nameTable().find(stream[i].zone));
+            auto it = kmTo.find(node);
+            if (it == kmTo.end()) {
+                vector<int> route = routingMatrix.getPathFromTree(tree, node);
+                double km = route.empty() ? numeric_limits<double>::infinity() : routingMatrix.calculateRouteCost(route);
+                it = kmTo.emplace(node, km).first;
+            }
+            travelKm[i] = it->second;
+        }
+        
+        vector<Courier> fleet = courierQueue.getAllCouriers();
+        CircularQueue generated(max(1, fleetSize));   // owns the generated couriers' names
+        if (fleet.empty()) {
+            static const char* const zoneNames[] = {"Zone-A", "Zone-B", "Zone-C"};
+            for (int i = 0; i < fleetSize; i++) generated.push(i + 1, "Courier-" + to_string(i + 1), zoneNames[i % 3]);
+            fleet = generated.getAllCouriers();
+        }
+        
+        DeliverySimulation::Result result = DeliverySimulation(stream, travelKm, fleet, settings).run();
+        double span = result.lastMinute - result.firstMinute;
+        cout << "\n========== SIMULATION REPORT ==========\n";
+        cout << "Orders: " << result.orders << " in, " << result.delivered << " delivered (" << result.late
+             << " late), " << result.unroutable << " unroutable, " << result.waiting << " never dispatched\n";
+        if (result.rejected > 0) cout << "Rejected: " << result.rejected << " orders with an unreadable delivery time\n";
+        cout << "Fleet: " << result.fleetSize << " couriers at " << fixed << setprecision(1) << settings.speedKmh
+             << " km/h, busy " << (span > 0 && result.fleetSize > 0 ? 100.0 * result.busyMinutes / (span * result.fleetSize) : 0.0)
+             << "% of " << span / 60.0 << " simulated hours\n";
+        cout << "Events: " << result.events << " in " << setprecision(1) << result.wallMs << " ms ("
+             << setprecision(0) << (result.wallMs > 0 ? result.events / result.wallMs * 1000.0 : 0.0)
+             << " per second) after " << setprecision(1) << result.setupMs << " ms of setup\n";
+        const DeliverySimulation::Distribution& latency = result.latencySeconds;
+        cout << "Delivery latency (minutes): mean " << setprecision(1) << latency.mean() / 60.0
+             << ", p50 " << latency.quantile(0.5) / 60.0 << ", p90 " << latency.quantile(0.9) / 60.0
+             << ", p99 " << latency.quantile(0.99) / 60.0 << ", max " << latency.maximum / 60.0 << "\n";
+        const DeliverySimulation::Distribution& depth = result.queueDepth;
+        cout << "Queue depth (pending orders, time-weighted): mean " << depth.mean() << ", p50 " << depth.quantile(0.5)
+             << ", p99 " << depth.quantile(0.99) << ", max " << depth.maximum << "\n";
+        return result;
+    }
+    
+    void setDispatchPolicy(DispatchPolicy policy) { appointments.setDispatchPolicy(policy); }
+    
+    void advanceClock(long long now) { appointments.advanceClock(now); }
+    
+    // List pending appointments whose deadline falls within the next `minutes`
+    int reportDue(int minutes) {
+        vector<DeliveryAppointment*> due = appointments.getDueWithin(minutes);
+        long long now = appointments.getClock();
+        cout << "\n========== DUE IN NEXT " << minutes << " MINUTES ==========\n";
+        cout << left << setw(8) << "ID" << setw(20) << "Customer" << setw(20) << "Time"
+             << setw(10) << "Priority" << setw(10) << "Zone" << "Minutes Left\n";
+        cout << string(80, '-') << "\n";
+        for (DeliveryAppointment* app : due) {
+            cout << left << setw(8) << app->appointmentId
+                 << setw(20) << app->customerName
+                 << setw(20) << app->deliveryTime
+                 << setw(10) << app->priority
+                 << setw(10) << app->zoneName()
+                 << app->window.latest - now << "\n";
+        }
+        cout << "Due: " << due.size() << "\n";
+        return (int)due.size();
+    }
+    
+    // "A" and "Zone-A" both name Zone-A
+    static string normalizeZone(string_view zone) {
+        if (zone.substr(0, 5) == "Zone-") return string(zone);
+        return "Zone-" + string(zone);
+    }
+    
+    // Bulk-load appointments from CSV (customer,address,time,priority,zone[,id]) or JSONL
+    bool loadAppointments(const string& filename, int& loaded, int& rejected, string& error) {
+        RecordReader reader;
+        if (!reader.open(filename, {"customer", "address", "time", "priority", "zone", "id"}, error)) {
+            return false;
+        }
+        
+        vector<AppointmentRow> rows;
+        unordered_map<string_view, string> zoneNames;  // Raw zone -> normalized name the rows point at
+        loaded = rejected = 0;
+        bool valid = true;
+        while (reader.next(valid)) {
+            AppointmentRow row;
+            string_view zone = reader.get("zone");
+            if (!valid || zone.empty() || !RecordReader::parseInt(reader.get("priority"), row.priority)) {
+                rejected++;
+                continue;
+            }
+            if (reader.has("id")) {
+                if (!RecordReader::parseInt(reader.get("id"), row.appointmentId)) {
+                    rejected++;
+                    continue;
+                }
+            } else {
+                row.appointmentId = appointmentIdCounter++;
+            }
+            row.priority = min(5, max(1, row.priority));
+            row.customerName = reader.get("customer");
+            row.address = reader.get("address");
+            row.deliveryTime = reader.get("time");
+            
+            auto known = zoneNames.find(zone);
+            if (known == zoneNames.end()) known = zoneNames.emplace(zone, normalizeZone(zone)).first;
+            row.zone = known->second;
+            rows.push_back(row);
+        }
+        
+        loaded = addAppointments(rows);
+        rejected += (int)rows.size() - loaded;
+        return true;
+    }
+    
+    // Insert prepared rows without prompting; returns how many were new. Only rows that
+    // went in are logged and move the ID counter, so replay ends in the same state.
+    int addAppointments(const vector<AppointmentRow>& rows) {
+        vector<DeliveryAppointment*> added;
+        int inserted = appointments.addAppointments(rows, &added);
+        for (const DeliveryAppointment* app : added) {
+            appointmentIdCounter = max(appointmentIdCounter, app->appointmentId + 1);
+            if (journal) {
+                journal->logAddAppointment(app->appointmentId, app->customerName, app->address,
+                                           app->deliveryTime, app->priority, app->zoneName(), app->window);
+            }
+        }
+        return inserted;
+    }
+    
+    // Register a courier without prompting; returns its ID, or -1 if the ID was taken
+    int registerCourier(const string& name, const string& zone, int maxLoad = 5) {
+        int id = courierIdCounter;
+        if (journal) journal->logAddCourier(id, name, normalizeZone(zone), max(1, maxLoad));
+        if (!courierQueue.push(id, name, normalizeZone(zone), max(1, maxLoad))) return -1;
+        courierIdCounter++;
+        return id;
+    }
+    
+    // Bulk-load delivery locations from CSV (name,zone,near,distance[,id][,lat,lon]) or JSONL.
+    // Each location is joined by a road of `distance` km to the already known location `near`,
+    // and appointments whose address equals its name are routed to it.
+    bool loadLocations(const string& filename, int& loaded, int& rejected, string& error) {
+        RecordReader reader;
+        if (!reader.open(filename, {"name", "zone", "near", "distance", "id", "lat", "lon"}, error)) {
+            return false;
+        }
+        
+        loaded = rejected = 0;
+        bool valid = true;
+        while (reader.next(valid)) {
+            string_view zone = reader.get("zone");
+            int near = routingMatrix.getLocationIndex(reader.get("near"));
+            double distance = 0.0, lat = 0.0, lon = 0.0;
+            long long externalId = -1;
+            bool located = reader.has("lat") || reader.has("lon");
+            if (!valid || near == -1 || !RecordReader::parseDouble(reader.get("distance"), distance) ||
+                distance < 0 || (reader.has("id") && !RecordReader::parseInt(reader.get("id"), externalId)) ||
+                (located && (!RecordReader::parseDouble(reader.get("lat"), lat) ||
+                             !RecordReader::parseDouble(reader.get("lon"), lon)))) {
+                rejected++;
+                continue;
+            }
+            int node = routingMatrix.addLocation(reader.get("name"), zone.empty() ? string() : normalizeZone(zone),
+                                                 externalId);
+            if (node == -1) {
+                rejected++;
+                continue;
+            }
+            routingMatrix.addEdge(node, near, distance);
+            if (located) routingMatrix.setCoordinates(node, lat, lon);
+            loaded++;
+        }
+        return true;
+    }
+    
+    // Apply a traffic feed from CSV (from,to,distance) or JSONL as one batch. Endpoints are
+    // location or zone names; a distance of "closed" closes the road.
+    bool applyTrafficUpdates(const string& filename, int& changed, int& rejected, string& error) {
+        RecordReader reader;
+        if (!reader.open(filename, {"from", "to", "distance"}, error)) {
+            return false;
+        }
+        
+        vector<EdgeUpdate> updates;
+        rejected = 0;
+        bool valid = true;
+        while (reader.next(valid)) {
+            EdgeUpdate update;
+            update.from = routingMatrix.getLocationIndex(reader.get("from"));
+            update.to = routingMatrix.getLocationIndex(reader.get("to"));
+            string_view distance = reader.get("distance");
+            if (distance == "closed") {
+                update.distance = numeric_limits<double>::infinity();
+            } else if (!RecordReader::parseDouble(distance, update.distance) || update.distance < 0) {
+                valid = false;
+            }
+            if (!valid || update.from == -1 || update.to == -1) {
+                rejected++;
+                continue;
+            }
+            updates.push_back(update);
+        }
+        changed = routingMatrix.updateEdges(updates);
+        return true;
+    }
+    
+    // Bulk-load couriers from CSV (name,zone[,maxLoad][,id]) or JSONL
+    bool loadCouriers(const string& filename, int& loaded, int& rejected, string& error) {
+        RecordReader reader;
+        if (!reader.open(filename, {"name", "zone", "maxLoad", "id"}, error)) {
+            return false;
+        }
+        
+        loaded = rejected = 0;
+        bool valid = true;
+        while (reader.next(valid)) {
+            string_view name = reader.get("name");
+            string_view zone = reader.get("zone");
+            int maxLoad = 5;
+            int id = courierIdCounter;
+            if (!valid || name.empty() || zone.empty() ||
+                (reader.has("maxLoad") && !RecordReader::parseInt(reader.get("maxLoad"), maxLoad)) ||
+                (reader.has("id") && !RecordReader::parseInt(reader.get("id"), id))) {
+                rejected++;
+                continue;
+            }
+            string fullZone = normalizeZone(zone);
+            if (journal) journal->logAddCourier(id, name, fullZone, max(1, maxLoad));
+            if (courierQueue.push(id, name, fullZone, max(1, maxLoad))) {
+                courierIdCounter = max(courierIdCounter, id + 1);
+                loaded++;
+            } else {
+                rejected++;
+            }
+        }
+        return true;
+    }
+    
+    // Table cells are float32, so a table over every named location stays usable up to here (1 GB)
+    static const int DISTANCE_TABLE_LIMIT = 16384;
+    
+    // Map the distance table in `filename` for batch planning. If the file is missing, was
+    // built from another graph or misses a named location, rebuild it over every named
+    // location and save it back.
+    bool useDistanceTable(const string& filename, bool& rebuilt, string& error) {
+        vector<int> named;
+        const LocationRegistry& registry = routingMatrix.getLocations();
+        for (int node = 0; node < registry.extent(); node++) {
+            if (!registry.name(node).empty()) named.push_back(node);
+        }
+        
+        string loadError;
+        rebuilt = !distanceTable.load(filename, loadError) ||
+                  !distanceTable.builtFrom(routingMatrix.getFingerprint()) || !distanceTable.covers(named);
+        if (!rebuilt) return true;
+        if ((int)named.size() > DISTANCE_TABLE_LIMIT) {
+            error = "too many locations for a distance table (" + to_string(named.size()) + ", limit " +
+                    to_string(DISTANCE_TABLE_LIMIT) + ")";
+            return false;
+        }
+        distanceTable.build(routingMatrix, named);
+        return distanceTable.save(filename, error);
+    }
+    
+    void setRouteTimeBudget(int milliseconds) { routeTimeBudgetMs = milliseconds; }
+    
+    void setRouteCacheCapacity(size_t bytes) { routingMatrix.setRouteCacheCapacity(bytes); }
+    
+    void setRoutingBackend(RoutingBackend mode) { routingMatrix.setRoutingBackend(mode); }
+    
+    // Call once the graph is loaded; a later graph change falls back to Dijkstra until called again
+    void prepareRouting(int threads = 0) { routingMatrix.prepareRoutingBackend(threads); }
+    
+    RouteCacheStats getRouteCacheStats() { return routingMatrix.getRouteCacheStats(); }
+    
+    void optimizeMultipleDeliveries() {
+        vector<DeliveryAppointment*> pendingApps = appointments.getPendingAppointments();
+        
+        if (pendingApps.empty()) {
+            cout << "No pending deliveries to optimize.\n";
+            return;
+        }
+        
+        cout << "\n========== BATCH ROUTE OPTIMIZATION ==========\n";
+        cout << "Optimizing " << pendingApps.size() << " deliveries...\n\n";
+        
+        int warehouseIndex = 9;
+        
+        // Distance table over the warehouse and every distinct delivery location
+        vector<int> locations(1, warehouseIndex);
+        unordered_map<int, int> tableIndex;
+        tableIndex[warehouseIndex] = 0;
+        vector<int> stopLocation;
+        vector<DeliveryAppointment*> stopApps;
+        for (DeliveryAppointment* app : pendingApps) {
+            int location = locationOf(app);
+            if (location == -1) continue;
+            if (!tableIndex.count(location)) {
+                tableIndex[location] = (int)locations.size();
+                locations.push_back(location);
+            }
+            stopLocation.push_back(tableIndex[location]);
+            stopApps.push_back(app);
+        }
+        
+        // Rows come from the current distance table, or from a new one built in parallel
+        if (!distanceTable.builtFrom(routingMatrix.getFingerprint()) || !distanceTable.covers(locations)) {
+            distanceTable.build(routingMatrix, locations);
+        }
+        int k = (int)locations.size();
+        vector<int> rows(k);
+        for (int i = 0; i < k; i++) rows[i] = distanceTable.rowOf(locations[i]);
+        vector<double> table((size_t)k * k);
+        for (int i = 0; i < k; i++) {
+            for (int j = 0; j < k; j++) table[(size_t)i * k + j] = distanceTable.at(rows[i], rows[j]);
+        }
+        
+        // Couriers in queue order with their spare capacity; without any, plan one open tour
+        vector<pair<int, int>> vehicles;
+        unordered_map<int, string_view> courierNames;
+        for (const Courier& courier : courierQueue.getAvailableCouriers()) {
+            int spare = courier.maxLoad - courier.currentLoad;
+            if (spare <= 0) continue;
+            vehicles.push_back({courier.courierId, spare});
+            courierNames[courier.courierId] = courier.name;
+        }
+        if (vehicles.empty()) {
+            vehicles.push_back({-1, (int)stopApps.size()});
+            courierNames[-1] = "Unassigned";
+        }
+        
+        BatchRouteEngine engine(k, table, 0, stopLocation);
+        engine.setTimeBudget(routeTimeBudgetMs);
+        vector<int> unserved;
+        vector<CourierTour> tours = engine.plan(vehicles, unserved);
+        
+        double totalDistance = 0.0;
+        for (const CourierTour& tour : tours) {
+            cout << "Courier " << courierNames[tour.courierId];
+            if (tour.courierId != -1) cout << " (ID: " << tour.courierId << ")";
+            cout << " - " << tour.stops.size() << " stops, " 
+                 << fixed << setprecision(2) << tour.distance << " km\n";
+            cout << "  Warehouse";
+            for (int stop : tour.stops) {
+                cout << " -> " << routingMatrix.getLocationName(locations[stopLocation[stop]])
+                     << " (#" << stopApps[stop]->appointmentId << ")";
+            }
+            cout << " -> Warehouse\n";
+            totalDistance += tour.distance;
+        }
+        
+        if (!unserved.empty()) {
+            cout << "\nNot routed (no capacity or unreachable):";
+            for (int stop : unserved) cout << " #" << stopApps[stop]->appointmentId;
+            cout << "\n";
+        }
+        
+        cout << "\nTotal Route Distance: " << fixed << setprecision(2) << totalDistance << " km\n";
+        cout << "Estimated Total Cost: $" << fixed << setprecision(2) << (totalDistance * 1.5) << "\n\n";
+    }
+    
+    void displayMenu() {
         cout << "\n========== SMART DELIVERY ROUTE OPTIMIZER ==========\n";
         cout << "1. Add Delivery Appointment\n";
         cout << "2. Add Courier\n";
@@ -653,61 +7464,1869 @@ public:
         cout << "7. View Routing Matrix\n";
         cout << "8. Remove Appointment\n";
         cout << "9. Exit\n";
+        cout << "10. View Performance Metrics\n";
         cout << "Enter your choice: ";
     }
     
     void run() {
-        int choice;
+        int choice;
+        while (true) {
+            displayMenu();
+            cin >> choice;
+            
+            switch (choice) {
+                case 1:
+                    addAppointment();
+                    break;
+                case 2:
+                    addCourier();
+                    break;
+                case 3:
+                    appointments.displayAppointments();
+                    break;
+                case 4:
+                    courierQueue.displayCouriers();
+                    break;
+                case 5:
+                    dispatchNextDelivery();
+                    break;
+                case 6:
+                    optimizeMultipleDeliveries();
+                    break;
+                case 7:
+                    routingMatrix.displayMatrix();
+                    break;
+                case 8: {
+                    int id;
+                    cout << "Enter appointment ID to remove: ";
+                    cin >> id;
+                    bool removed = removeAppointment(id);
+                    flushLog();
+                    if (removed) {
+                        cout << "Appointment removed successfully!\n";
+                    } else {
+                        cout << "Appointment not found!\n";
+                    }
+                    break;
+                }
+                case 9:
+                    cout << "Exiting system...\n";
+                    return;
+                case 10:
+                    MetricsReport().writeText(cout);
+                    break;
+                default:
+                    cout << "Invalid choice! Please try again.\n";
+            }
+        }
+    }
+};
+
+// ==================== SYNTHETIC WORKLOADS AND BENCHMARKS ====================
+
+struct GeneratedEdge {
+    int from;
+    int to;
+    double distance;
+};
+
+// Seeded generators for appointments, courier fleets and road graphs
+class WorkloadGenerator {
+private:
+    mt19937_64 rng;
+    vector<string> strings;  // Backing storage for the generated rows' text
+    
+    double uniform() { return uniform_real_distribution<double>(0.0, 1.0)(rng); }
+    
+public:
+    WorkloadGenerator(unsigned long long seed) : rng(seed) {}
+    
+    // Priorities skew toward the low-urgency end (prioritySkew > 1 strengthens it);
+    // times cluster around a morning and an evening peak with spread timeSkew minutes
+    vector<AppointmentRow> appointments(int count, int firstId, double prioritySkew = 2.0,
+                                        double timeSkew = 90.0) {
+        static const char* zoneNames[] = {"Zone-A", "Zone-B", "Zone-C"};
+        normal_distribution<double> morning(10 * 60, timeSkew), evening(18 * 60, timeSkew);
+        
+        strings.clear();
+        strings.reserve((size_t)count * 3);
+        vector<AppointmentRow> rows(count);
+        for (int i = 0; i < count; i++) {
+            double peak = uniform() < 0.6 ? morning(rng) : evening(rng);
+            int minute = min(24 * 60 - 1, max(0, (int)peak));
+            char time[16];
+            snprintf(time, sizeof(time), "%02d:%02d", minute / 60, minute % 60);
+            
+            strings.push_back("Customer-" + to_string(firstId + i));
+            strings.push_back(to_string(i % 997 + 1) + " Synthetic Road");
+            strings.push_back(time);
+            rows[i].appointmentId = firstId + i;
+            rows[i].priority = 5 - min(4, (int)(5 * pow(uniform(), prioritySkew)));
+            rows[i].customerName = strings[strings.size() - 3];
+            rows[i].address = strings[strings.size() - 2];
+            rows[i].deliveryTime = strings[strings.size() - 1];
+            rows[i].zone = zoneNames[rng() % 3];
+        }
+        return rows;
+    }
+    
+    string zone() {
+        static const char* zoneNames[] = {"Zone-A", "Zone-B", "Zone-C"};
+        return zoneNames[rng() % 3];
+    }
+    
+    // side x side grid with 4-neighbour roads of 1-3 km
+    vector<GeneratedEdge> gridGraph(int side) {
+        vector<GeneratedEdge> edges;
+        for (int y = 0; y < side; y++) {
+            for (int x = 0; x < side; x++) {
+                int id = y * side + x;
+                if (x + 1 < side) edges.push_back({id, id + 1, 1.0 + 2.0 * uniform()});
+                if (y + 1 < side) edges.push_back({id, id + side, 1.0 + 2.0 * uniform()});
+            }
+        }
+        return edges;
+    }
+    
+    // Points in a unit square joined to neighbours within the radius giving averageDegree.
+    // The square spans about 100 km; positions, when asked for, are (lat, lon) in degrees.
+    vector<GeneratedEdge> randomGeometricGraph(int nodes, double averageDegree,
+                                               vector<pair<double, double>>* positions = nullptr) {
+        double radius = sqrt(averageDegree / (3.141592653589793 * max(1, nodes)));
+        int cells = max(1, (int)(1.0 / radius));
+        vector<double> x(nodes), y(nodes);
+        vector<vector<int>> grid((size_t)cells * cells);
+        for (int i = 0; i < nodes; i++) {
+            x[i] = uniform();
+            y[i] = uniform();
+            grid[(size_t)min(cells - 1, (int)(y[i] * cells)) * cells + min(cells - 1, (int)(x[i] * cells))].push_back(i);
+        }
+        
+        vector<GeneratedEdge> edges;
+        for (int i = 0; i < nodes; i++) {
+            int cx = min(cells - 1, (int)(x[i] * cells));
+            int cy = min(cells - 1, (int)(y[i] * cells));
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int gx = cx + dx, gy = cy + dy;
+                    if (gx < 0 || gy < 0 || gx >= cells || gy >= cells) continue;
+                    for (int j : grid[(size_t)gy * cells + gx]) {
+                        double d = hypot(x[i] - x[j], y[i] - y[j]);
+                        if (j > i && d <= radius) edges.push_back({i, j, d * 100.0}); // Unit square = 100 km
+                    }
+                }
+            }
+        }
+        if (positions) {
+            positions->resize(nodes);
+            for (int i = 0; i < nodes; i++) (*positions)[i] = {y[i] * 100.0 / 111.195, x[i] * 100.0 / 111.195};
+        }
+        return edges;
+    }
+    
+    int pick(int bound) { return (int)(rng() % (unsigned long long)max(1, bound)); }
+};
+
+// Discards everything written to it; used to silence console reports while timing
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize count) override { return count; }
+};
+
+// Times every core structure across growing sizes and reports machine-readable JSON
+class BenchmarkSuite {
+private:
+    struct Result {
+        string name;
+        int size;
+        long long operations;
+        double totalMs;
+        size_t bytes;   // memory the benchmark built, 0 when not measured
+    };
+    
+    vector<Result> results;
+    int maxSize;
+    unsigned long long seed;
+    int passedChecks;
+    vector<string> failedChecks;
+    
+    // Sizes past these limits are skipped for quadratic reference implementations
+    static const int LINKED_LIST_LIMIT = 20000;
+    static const int ARRAY_SCAN_LIMIT = 20000;
+    static const int TOUR_PLANNING_LIMIT = 10000;
+    static const int DISTANCE_TABLE_SIZE = 1024;
+    static const int REGION_SIZE = 1024;
+    
+    template <typename Body>
+    void measure(const string& name, int size, long long operations, Body body) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        body();
+        double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        results.push_back({name, size, operations, elapsed, 0});
+    }
+    
+    // Results two implementations must agree on. A failure goes to stderr and the report,
+    // and fails the run.
+    void check(const string& name, bool ok) {
+        if (ok) {
+            passedChecks++;
+            return;
+        }
+        failedChecks.push_back(name);
+        cerr << "Check failed: " << name << "\n";
+    }
+    
+    // A* on a copy of the graph where every seventh node has no coordinates and its roads are
+    // ten times shorter than the straight line, like a highway off the map. A bound scaled
+    // from the placed nodes alone would overestimate through them.
+    void checkAStarPartlyLocated(int n, const string& graphName, const vector<GeneratedEdge>& edges,
+                                 const vector<pair<double, double>>& positions, const vector<pair<int, int>>& pairs) {
+        SparseMatrix matrix(n);
+        matrix.setRouteCacheCapacity(0);
+        for (const GeneratedEdge& edge : edges) {
+            bool offMap = edge.from % 7 == 0 || edge.to % 7 == 0;
+            matrix.addEdge(edge.from, edge.to, offMap ? edge.distance / 10 : edge.distance);
+        }
+        for (int node = 0; node < n; node++) {
+            if (node % 7 != 0) matrix.setCoordinates(node, positions[node].first, positions[node].second);
+        }
+        vector<double> expected;
+        for (const auto& query : pairs) {
+            vector<int> route = matrix.findShortestPath(query.first, query.second);
+            expected.push_back(route.empty() ? -1.0 : matrix.sumRouteCost(route));
+        }
+        matrix.setRoutingBackend(ROUTE_ASTAR);
+        check("astarPartlyLocated." + graphName + "." + to_string(n), sameCosts(matrix, pairs, expected));
+    }
+    
+    // Whether each route costs what Dijkstra's does for the same pair, give or take
+    // kmPerRoad for every road on it when the backend rounds road lengths
+    bool sameCosts(SparseMatrix& matrix, const vector<pair<int, int>>& pairs, const vector<double>& expected,
+                   double kmPerRoad = 0.0) {
+        for (size_t q = 0; q < pairs.size(); q++) {
+            vector<int> route = matrix.findShortestPath(pairs[q].first, pairs[q].second);
+            double cost = route.empty() ? -1.0 : matrix.sumRouteCost(route);
+            double slack = 1e-9 * max(1.0, expected[q]) + kmPerRoad * route.size();
+            if (fabs(cost - expected[q]) > slack || route.empty() != (expected[q] < 0)) return false;
+        }
+        return true;
+    }
+    
+    // One-way and wide-index variants against graphs that compute the same distances another
+    // way: a directed graph holding each road both ways must match the undirected one, and on
+    // one-way roads its backward search has to use the reverse arcs to match forward Dijkstra.
+    // The 64-bit index variant must match the 32-bit one.
+    void checkRoutingGraphVariants(int n, const string& graphName, const vector<GeneratedEdge>& edges,
+                                   const vector<pair<int, int>>& pairs) {
+        vector<GeneratedEdge> bothWays = edges;
+        for (const GeneratedEdge& edge : edges) bothWays.push_back({edge.to, edge.from, edge.distance});
+        RoadGraph undirected;
+        RoutingGraph<double, int32_t, true> directed, oneWay;
+        RoutingGraph<double, uint64_t, false> wide;
+        undirected.build(n, edges);
+        directed.build(n, bothWays);
+        oneWay.build(n, edges);
+        wide.build(n, edges);
+        
+        bool directedMatches = true, oneWayMatches = true, wideMatches = true;
+        for (const auto& query : pairs) {
+            double expected = undirected.distanceKm(query.first, query.second);
+            double tolerance = 1e-9 * max(1.0, expected == numeric_limits<double>::infinity() ? 1.0 : expected);
+            auto near = [&](double km, double target) {
+                return km == target || fabs(km - target) <= tolerance;
+            };
+            directedMatches = directedMatches && near(directed.distanceKm(query.first, query.second), expected) &&
+                              near(directed.pathKm(directed.bidirectionalPath(query.first, query.second)), expected);
+            double oneWayKm = oneWay.distanceKm(query.first, query.second);
+            oneWayMatches = oneWayMatches &&
+                            near(oneWay.pathKm(oneWay.bidirectionalPath(query.first, query.second)), oneWayKm);
+            wideMatches = wideMatches && near(wide.distanceKm(query.first, query.second), expected) &&
+                          near(wide.pathKm(wide.bidirectionalPath(query.first, query.second)), expected);
+        }
+        check("routingGraphDirected." + graphName + "." + to_string(n), directedMatches);
+        check("routingGraphOneWay." + graphName + "." + to_string(n), oneWayMatches);
+        check("routingGraphWideIndex." + graphName + "." + to_string(n), wideMatches);
+    }
+    
+    // A compile-time specialised copy of the benchmark graph, built and searched on the same pairs
+    template <typename Graph>
+    void benchRoutingGraph(const string& variant, int n, const string& graphName, const vector<GeneratedEdge>& edges,
+                           const vector<pair<int, int>>& pairs) {
+        Graph graph;
+        measure("RoutingGraph.build." + variant + "." + graphName, n, (long long)edges.size(), [&]() {
+            graph.build(n, edges);
+        });
+        results.back().bytes = graph.memoryBytes();
+        double total = 0.0;
+        measure("RoutingGraph.findShortestPath." + variant + "." + graphName, n, (long long)pairs.size(), [&]() {
+            for (const auto& query : pairs) total += graph.shortestPath(query.first, query.second).size();
+        });
+    }
+    
+    // Removing three orders in four must leave the survivors' text intact, and once the
+    // dead text passes a block the store's arena must shrink
+    void checkTextCompaction(int n, const vector<AppointmentRow>& rows) {
+        AppointmentStore store;
+        store.addAppointments(rows);
+        size_t before = store.bytesReserved();
+        for (const AppointmentRow& row : rows) {
+            if (row.appointmentId % 4 != 0) store.removeAppointment(row.appointmentId);
+        }
+        bool same = true;
+        for (const AppointmentRow& row : rows) {
+            DeliveryAppointment* app = store.findAppointment(row.appointmentId);
+            if (row.appointmentId % 4 != 0) {
+                same = same && !app;
+            } else {
+                same = same && app && app->customerName == row.customerName && app->address == row.address &&
+                       app->deliveryTime == row.deliveryTime;
+            }
+        }
+        check("AppointmentStore.textCompaction." + to_string(n), same && (n < 10000 || store.bytesReserved() < before));
+    }
+    
+    void benchAppointments(int n) {
+        WorkloadGenerator generator(seed + n);
+        vector<AppointmentRow> rows = generator.appointments(n, 1);
+        
+        if (n <= LINKED_LIST_LIMIT) {
+            AppointmentLinkedList list;
+            measure("AppointmentLinkedList.insert", n, n, [&]() {
+                for (const AppointmentRow& row : rows) {
+                    list.addAppointment(row.appointmentId, row.customerName, row.address,
+                                        row.deliveryTime, row.priority, row.zone);
+                }
+            });
+            measure("AppointmentLinkedList.next", n, n / 2, [&]() {
+                for (int i = 0; i < n / 2; i++) {
+                    DeliveryAppointment* next = list.getNextPendingAppointment();
+                    if (next) list.completeAppointment(next->appointmentId);
+                }
+            });
+            measure("AppointmentLinkedList.remove", n, n, [&]() {
+                for (int i = n; i >= 1; i--) list.removeAppointment(i);
+            });
+        }
+        
+        AppointmentStore store;
+        measure("AppointmentStore.insert", n, n, [&]() {
+            for (const AppointmentRow& row : rows) {
+                store.addAppointment(row.appointmentId, row.customerName, row.address,
+                                     row.deliveryTime, row.priority, row.zone);
+            }
+        });
+        measure("AppointmentStore.next", n, n / 2, [&]() {
+            for (int i = 0; i < n / 2; i++) {
+                DeliveryAppointment* next = store.getNextPendingAppointment();
+                if (next) store.completeAppointment(next->appointmentId);
+            }
+        });
+        measure("AppointmentStore.remove", n, n, [&]() {
+            for (int i = n; i >= 1; i--) store.removeAppointment(i);
+        });
+        
+        checkTextCompaction(n, rows);
+        
+        AppointmentStore bulkStore;
+        measure("AppointmentStore.bulkInsert", n, n, [&]() { bulkStore.addAppointments(rows); });
+        
+        // Sweep the clock across the day in 15 minute steps, completing whatever falls due
+        long long swept = 0;
+        measure("AppointmentStore.dueSweep", n, n, [&]() {
+            for (int step = 0; step <= 96; step++) {
+                bulkStore.advanceClock(serviceDay() * MINUTES_PER_DAY + step * 15);
+                for (DeliveryAppointment* app : bulkStore.getDueWithin(15)) {
+                    swept += bulkStore.completeAppointment(app->appointmentId);
+                }
+            }
+        });
+        
+        AppointmentStore deadlineStore;
+        deadlineStore.addAppointments(rows);
+        deadlineStore.setDispatchPolicy(DISPATCH_BY_DEADLINE);
+        measure("AppointmentStore.nextByDeadline", n, n / 2, [&]() {
+            for (int i = 0; i < n / 2; i++) {
+                DeliveryAppointment* next = deadlineStore.getNextPendingAppointment();
+                if (next) deadlineStore.completeAppointment(next->appointmentId);
+            }
+        });
+    }
+    
+    void benchCouriers(int n) {
+        WorkloadGenerator generator(seed + n);
+        CircularQueue queue(10);
+        measure("CircularQueue.push", n, n, [&]() {
+            for (int i = 1; i <= n; i++) queue.push(i, "Courier-" + to_string(i), generator.zone());
+        });
+        
+        int lookups = 100000;
+        vector<int> zones(lookups);
+        for (int& zone : zones) zone = nameTable().intern(generator.zone());
+        long long found = 0;
+        measure("CircularQueue.zoneLookup", n, lookups, [&]() {
+            for (int zone : zones) found += queue.getAvailableCourierForZone(zone).courierId;
+        });
+        measure("CircularQueue.assignRelease", n, 2LL * lookups, [&]() {
+            for (int i = 0; i < lookups; i++) {
+                int id = 1 + generator.pick(n);
+                queue.assignDelivery(id, zones[i]);
+                queue.releaseCourier(id);
+            }
+        });
+        
+        // Ranked candidates over a mixed fleet: half on a delivery, some of them done
+        for (int i = 0; i < n / 2; i++) queue.assignDelivery(1 + generator.pick(n), zones[i % lookups]);
+        for (int i = 0; i < n / 4; i++) queue.releaseCourier(1 + generator.pick(n));
+        int scans = n >= 100000 ? 20 : 200;
+        measure("CircularQueue.rankCouriers", n, scans, [&]() {
+            for (int i = 0; i < scans; i++) found += queue.rankCouriersForZone(zones[i], 10).size();
+        });
+        // The same ranking by a scan over the courier records, for comparison
+        vector<Courier> fleet = queue.getAllCouriers();
+        measure("CircularQueue.rankCouriersRecordScan", n, scans, [&]() {
+            for (int i = 0; i < scans; i++) {
+                vector<pair<long long, int>> ranked;
+                for (int position = 0; position < (int)fleet.size(); position++) {
+                    const Courier& courier = fleet[position];
+                    bool spare = courier.currentLoad < courier.maxLoad;
+                    bool same = courier.zoneId == zones[i];
+                    if (!courier.available || (!spare && !same)) continue;
+                    int tier = same ? (spare ? 0 : 2) : 1;
+                    ranked.push_back({(long long)tier << 32 | courier.currentLoad, position});
+                }
+                size_t keep = min(ranked.size(), (size_t)10);
+                partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end());
+                found += keep;
+            }
+        });
+        measure("CircularQueue.availableCouriers", n, 1, [&]() {
+            found += queue.getAvailableCouriers().size();
+        });
+    }
+    
+    void benchRouting(int n, const string& graphName, const vector<GeneratedEdge>& edges,
+                      const vector<pair<double, double>>& positions = vector<pair<double, double>>()) {
+        SparseMatrix matrix(n);
+        matrix.setRouteCacheCapacity(0);   // every backend searches each pair itself
+        measure("SparseMatrix.build." + graphName, n, (long long)edges.size(), [&]() {
+            for (const GeneratedEdge& edge : edges) matrix.addEdge(edge.from, edge.to, edge.distance);
+            matrix.getEdgeCount(); // Forces the CSR merge
+        });
+        results.back().bytes = matrix.getGraphBytes();
+        
+        WorkloadGenerator generator(seed + n + 1);
+        int queries = n >= 50000 ? 10 : 100;
+        vector<pair<int, int>> pairs(queries);
+        for (auto& query : pairs) query = {generator.pick(n), generator.pick(n)};
+        
+        measure("SparseMatrix.findShortestPath." + graphName, n, queries, [&]() {
+            for (const auto& query : pairs) matrix.findShortestPath(query.first, query.second);
+        });
+        benchRoutingGraph<CompactRoadGraph>("float", n, graphName, edges, pairs);
+        benchRoutingGraph<FixedPointRoadGraph>("decimetres", n, graphName, edges, pairs);
+        checkRoutingGraphVariants(n, graphName, edges, pairs);
+        
+        // The same pairs again from a warm route cache, then their costs
+        matrix.setRouteCacheCapacity(SparseMatrix::DEFAULT_ROUTE_CACHE_BYTES);
+        for (const auto& query : pairs) matrix.findShortestPath(query.first, query.second);
+        vector<vector<int>> routes;
+        measure("SparseMatrix.findShortestPathCached." + graphName, n, queries, [&]() {
+            for (const auto& query : pairs) routes.push_back(matrix.findShortestPath(query.first, query.second));
+        });
+        double totalCost = 0.0;
+        measure("SparseMatrix.calculateRouteCostCached." + graphName, n, queries, [&]() {
+            for (const vector<int>& route : routes) totalCost += matrix.calculateRouteCost(route);
+        });
+        measure("SparseMatrix.calculateRouteCost." + graphName, n, queries, [&]() {
+            for (const vector<int>& route : routes) totalCost -= matrix.sumRouteCost(route);
+        });
+        matrix.setRouteCacheCapacity(0);
+        vector<double> dijkstraCosts;
+        for (const vector<int>& route : routes) dijkstraCosts.push_back(route.empty() ? -1.0 : matrix.sumRouteCost(route));
+        if (n <= ARRAY_SCAN_LIMIT) {
+            int scanQueries = min(queries, 10);
+            measure("SparseMatrix.findShortestPathArrayScan." + graphName, n, scanQueries, [&]() {
+                for (int q = 0; q < scanQueries; q++) matrix.findShortestPathArrayScan(pairs[q].first, pairs[q].second);
+            });
+        }
+        
+        // Goal-directed searches over the same pairs
+        if (!positions.empty()) {
+            for (int node = 0; node < n; node++) matrix.setCoordinates(node, positions[node].first, positions[node].second);
+            matrix.setRoutingBackend(ROUTE_ASTAR);
+            measure("SparseMatrix.findShortestPathAStar." + graphName, n, queries, [&]() {
+                for (const auto& query : pairs) matrix.findShortestPath(query.first, query.second);
+            });
+            check("astar." + graphName + "." + to_string(n), sameCosts(matrix, pairs, dijkstraCosts));
+            if (n <= ARRAY_SCAN_LIMIT) checkAStarPartlyLocated(n, graphName, edges, positions, pairs);
+        }
+        matrix.setRoutingBackend(ROUTE_BIDIRECTIONAL);
+        measure("SparseMatrix.findShortestPathBidirectional." + graphName, n, queries, [&]() {
+            for (const auto& query : pairs) matrix.findShortestPath(query.first, query.second);
+        });
+        check("bidirectional." + graphName + "." + to_string(n), sameCosts(matrix, pairs, dijkstraCosts));
+        measure("SparseMatrix.exportFixedPoint." + graphName, n, 1, [&]() {
+            matrix.setRoutingBackend(ROUTE_FIXED_POINT);
+            matrix.prepareRoutingBackend();
+        });
+        measure("SparseMatrix.findShortestPathFixedPoint." + graphName, n, queries, [&]() {
+            for (const auto& query : pairs) matrix.findShortestPath(query.first, query.second);
+        });
+        // Decimetre rounding moves each road by at most 5 cm, on this route and on Dijkstra's
+        check("fixedPoint." + graphName + "." + to_string(n), sameCosts(matrix, pairs, dijkstraCosts, 1e-4));
+        measure("SparseMatrix.buildLandmarks." + graphName, n, 1, [&]() { matrix.buildLandmarks(); });
+        matrix.setRoutingBackend(ROUTE_ALT);
+        measure("SparseMatrix.findShortestPathALT." + graphName, n, queries, [&]() {
+            for (const auto& query : pairs) matrix.findShortestPath(query.first, query.second);
+        });
+        check("alt." + graphName + "." + to_string(n), sameCosts(matrix, pairs, dijkstraCosts));
+        
+        // Regions of about 1,024 nodes; batched queries with both ends in one region run on
+        // a single worker, then on one worker per region
+        int regionCount = max(2, min(64, n / REGION_SIZE));
+        measure("SparseMatrix.buildRegionRouter." + graphName, n, 1, [&]() { matrix.buildRegionRouter(regionCount); });
+        matrix.setRoutingBackend(ROUTE_REGIONS);
+        measure("SparseMatrix.findShortestPathRegions." + graphName, n, queries, [&]() {
+            for (const auto& query : pairs) matrix.findShortestPath(query.first, query.second);
+        });
+        check("regions." + graphName + "." + to_string(n), sameCosts(matrix, pairs, dijkstraCosts));
+        const RegionRouter& router = matrix.getRegionRouter();
+        vector<pair<int, int>> regional(10 * queries);
+        for (auto& query : regional) {
+            query.first = generator.pick(n);
+            query.second = generator.pick(n);
+            for (int tries = 0; tries < 256 && router.getRegionOf(query.second) != router.getRegionOf(query.first); tries++) {
+                query.second = generator.pick(n);
+            }
+        }
+        measure("SparseMatrix.routeDistancesOneWorker." + graphName, n, (long long)regional.size(), [&]() {
+            matrix.routeDistances(regional, 1);
+        });
+        measure("SparseMatrix.routeDistancesPerRegion." + graphName, n, (long long)regional.size(), [&]() {
+            matrix.routeDistances(regional);
+        });
+        matrix.setRoutingBackend(ROUTE_DIJKSTRA);
+        measure("SparseMatrix.shortestPathTree." + graphName, n, 1, [&]() {
+            matrix.getShortestPathTree(pairs[0].first);
+        });
+        
+        // Random hubs (1,024, or 128 on the largest graphs): exact rows from parallel
+        // searches, then the min-plus closure
+        int hubCount = min(n, n <= ARRAY_SCAN_LIMIT ? DISTANCE_TABLE_SIZE : DISTANCE_TABLE_SIZE / 8);
+        vector<int> hubs;
+        for (int i = 0; i < hubCount; i++) hubs.push_back(generator.pick(n));
+        DistanceTable distances;
+        measure("DistanceTable.build." + graphName, n, (long long)hubs.size(), [&]() {
+            distances.build(matrix, hubs);
+        });
+        measure("DistanceTable.close." + graphName, n, (long long)distances.size(), [&]() {
+            distances.close();
+        });
+        
+        // Traffic batches of 16 roads each, scaled by 0.5-2x; the cached tree is repaired
+        int batches = 10;
+        vector<vector<EdgeUpdate>> traffic(batches);
+        for (vector<EdgeUpdate>& batch : traffic) {
+            for (int i = 0; i < 16 && !edges.empty(); i++) {
+                const GeneratedEdge& edge = edges[generator.pick((int)edges.size())];
+                batch.push_back({edge.from, edge.to, edge.distance * (0.5 + generator.pick(151) / 100.0)});
+            }
+        }
+        measure("SparseMatrix.updateEdges." + graphName, n, batches, [&]() {
+            for (const vector<EdgeUpdate>& batch : traffic) matrix.updateEdges(batch);
+        });
+        
+        // Nodes past the ten defaults get an address, a zone and an external ID
+        vector<string> addresses(n);
+        measure("LocationRegistry.register." + graphName, n, max(0, n - 10), [&]() {
+            for (int node = 10; node < n; node++) {
+                addresses[node] = graphName + "-" + to_string(node);
+                matrix.nameLocation(node, addresses[node], generator.zone(), 1000000LL + node);
+            }
+        });
+        int lookups = 100000;
+        long long found = 0;
+        measure("LocationRegistry.lookup." + graphName, n, lookups, [&]() {
+            for (int i = 0; i < lookups; i++) {
+                int node = 10 + generator.pick(max(1, n - 10));
+                found += node < n ? matrix.getLocationIndex(addresses[node]) : 0;
+            }
+        });
+    }
+    
+    // The concurrent engine against the sequential dispatcher's courier choice on the same
+    // fleet: a third the size of the orders, none in Zone-C and every fourth one restored at
+    // full load. Both must hand the same couriers to the same orders.
+    void checkConcurrentDispatch(int n, const vector<AppointmentRow>& rows) {
+        WorkloadGenerator generator(seed + n + 3);
+        CircularQueue queue(16);
+        int fleetSize = max(1, n / 3);
+        for (int id = 1; id <= fleetSize; id++) {
+            string zone = generator.zone();
+            if (zone == "Zone-C") zone = "Zone-A";
+            int maxLoad = 1 + id % 3;
+            queue.push(id, "Courier-" + to_string(id), zone, maxLoad);
+            queue.restoreCourierState(id, nameTable().find(zone), true, id % 4 == 0 ? maxLoad : id % 2);
+        }
+        
+        SparseMatrix roads(1);
+        ConcurrentDispatchEngine engine(roads.createSnapshot({0}), 0, queue.getCouriersInDispatchOrder());
+        engine.start(4, rows.size());
+        vector<thread> intake;
+        for (int p = 0; p < 2; p++) {
+            intake.emplace_back([&, p]() {
+                for (size_t i = p; i < rows.size(); i += 2) {
+                    engine.submit((int)i, rows[i].appointmentId, nameTable().find(rows[i].zone));
+                }
+            });
+        }
+        for (thread& producer : intake) producer.join();
+        vector<DispatchResult> actual = engine.finish();
+        
+        bool same = actual.size() == rows.size();
+        for (size_t i = 0; same && i < rows.size(); i++) {
+            int zone = nameTable().find(rows[i].zone);
+            Courier courier = queue.getAvailableCourierForZone(zone);
+            same = actual[i].appointmentId == rows[i].appointmentId && actual[i].courierId == courier.courierId;
+            if (courier.courierId != -1) queue.assignDelivery(courier.courierId, zone);
+        }
+        check("dispatchConcurrent." + to_string(n), same);
+    }
+    
+    void benchDispatch(int n) {
+        WorkloadGenerator generator(seed + n + 2);
+        vector<AppointmentRow> rows = generator.appointments(n, 1);
+        
+        DeliveryOptimizer optimizer;
+        optimizer.addAppointments(rows);
+        for (int i = 0; i < n; i++) optimizer.registerCourier("Courier-" + to_string(i + 1), generator.zone());
+        measure("DeliveryOptimizer.dispatchNextDelivery", n, n, [&]() { optimizer.dispatchAll(); });
+        checkConcurrentDispatch(n, rows);
+        
+        // A day of n orders against a fleet a twentieth that size
+        DeliveryOptimizer simulator;
+        simulator.addAppointments(rows);
+        measure("DeliveryOptimizer.simulate", n, n, [&]() {
+            simulator.simulate(vector<AppointmentRow>(), max(1, n / 20), SimulationOptions());
+        });
+        
+        if (n <= TOUR_PLANNING_LIMIT) {
+            DeliveryOptimizer planner;
+            planner.addAppointments(rows);
+            for (int i = 0; i < max(1, n / 5); i++) {
+                planner.registerCourier("Courier-" + to_string(i + 1), generator.zone());
+            }
+            planner.setRouteTimeBudget(100);
+            measure("DeliveryOptimizer.optimizeMultipleDeliveries", n, n, [&]() {
+                planner.optimizeMultipleDeliveries();
+            });
+            
+            // One batch of up to 2,048 orders against a fleet a quarter that size
+            DeliveryOptimizer matcher;
+            matcher.addAppointments(rows);
+            for (int i = 0; i < max(1, min(n, 2048) / 4); i++) {
+                matcher.registerCourier("Courier-" + to_string(i + 1), generator.zone());
+            }
+            measure("DeliveryOptimizer.dispatchBatch", n, min(n, 2048), [&]() { matcher.dispatchBatch(); });
+        }
+    }
+    
+public:
+    BenchmarkSuite(int maximum, unsigned long long rngSeed) : maxSize(maximum), seed(rngSeed), passedChecks(0) {}
+    
+    bool checksPassed() const { return failedChecks.empty(); }
+    
+    void run() {
+        NullBuffer sink;
+        streambuf* console = cout.rdbuf(&sink);
+        for (long long n = 10; n <= maxSize; n *= 10) {
+            int size = (int)n;
+            cerr << "Benchmarking size " << size << "...\n";
+            benchAppointments(size);
+            benchCouriers(size);
+            int side = max(2, (int)sqrt((double)size));
+            benchRouting(side * side, "grid", WorkloadGenerator(seed).gridGraph(side));
+            vector<pair<double, double>> positions;
+            vector<GeneratedEdge> geometric = WorkloadGenerator(seed).randomGeometricGraph(size, 6.0, &positions);
+            benchRouting(size, "geometric", geometric, positions);
+            benchDispatch(size);
+        }
+        cout.rdbuf(console);
+    }
+    
+    void writeJSON(ostream& out) {
+        out << "{\n  \"suite\": \"smart-delivery-route-optimizer\",\n"
+            << "  \"seed\": " << seed << ",\n  \"maxSize\": " << maxSize << ",\n  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& result = results[i];
+            double nsPerOp = result.operations > 0 ? result.totalMs * 1e6 / result.operations : 0.0;
+            out << "    {\"name\": \"" << result.name << "\", \"size\": " << result.size
+                << ", \"operations\": " << result.operations
+                << ", \"totalMs\": " << fixed << setprecision(3) << result.totalMs
+                << ", \"nsPerOp\": " << setprecision(1) << nsPerOp;
+            if (result.bytes > 0) out << ", \"bytes\": " << result.bytes;
+            out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n  \"checks\": {\"passed\": " << passedChecks << ", \"failed\": [";
+        for (size_t i = 0; i < failedChecks.size(); i++) out << (i ? ", " : "") << "\"" << failedChecks[i] << "\"";
+        out << "]}\n}\n";
+    }
+};
+
+// ==================== SOCKET SERVER ====================
+//
+// Line protocol: one request per line, fields separated by tabs, one reply line per
+// request in request order.
+//   PING                                         -> OK
+//   APPT customer address time priority zone     -> OK <appointmentId>
+//   COURIER name zone [maxLoad]                  -> OK <courierId>
+//   DISPATCH                                     -> OK <appointmentId> <courierId> <km> | NONE
+//   ROUTE from to                                -> OK <km> <stop>><stop>... | NONE
+// A malformed request gets ERR and a reason. The km of an unroutable dispatch is -1.
+
+// Set by SIGINT and SIGTERM; the server loop returns at its next wakeup
+volatile sig_atomic_t serverStopRequested = 0;
+
+void requestServerStop(int) { serverStopRequested = 1; }
+
+// A listen or connect address: "unix:PATH" for a Unix domain socket, otherwise
+// "[HOST:]PORT" over TCP, with HOST an IPv4 address (default 127.0.0.1)
+struct SocketAddress {
+    sockaddr_storage storage;
+    socklen_t length;
+    string unixPath;    // empty for TCP
+    
+    SocketAddress() : length(0) { memset(&storage, 0, sizeof(storage)); }
+    
+    bool parse(const string& text, string& error) {
+        memset(&storage, 0, sizeof(storage));
+        unixPath.clear();
+        if (text.compare(0, 5, "unix:") == 0) {
+            sockaddr_un* local = (sockaddr_un*)&storage;
+            unixPath = text.substr(5);
+            if (unixPath.empty() || unixPath.size() >= sizeof(local->sun_path)) {
+                error = "invalid socket path '" + unixPath + "'";
+                return false;
+            }
+            local->sun_family = AF_UNIX;
+            memcpy(local->sun_path, unixPath.c_str(), unixPath.size() + 1);
+            length = (socklen_t)sizeof(sockaddr_un);
+            return true;
+        }
+        
+        size_t colon = text.rfind(':');
+        string host = colon == string::npos ? "127.0.0.1" : text.substr(0, colon);
+        if (host == "localhost") host = "127.0.0.1";
+        int port = 0;
+        sockaddr_in* inet = (sockaddr_in*)&storage;
+        inet->sin_family = AF_INET;
+        if (!RecordReader::parseInt(string_view(text).substr(colon == string::npos ? 0 : colon + 1), port) ||
+            port <= 0 || port > 65535 || inet_pton(AF_INET, host.c_str(), &inet->sin_addr) != 1) {
+            error = "invalid address '" + text + "'";
+            return false;
+        }
+        inet->sin_port = htons((uint16_t)port);
+        length = (socklen_t)sizeof(sockaddr_in);
+        return true;
+    }
+    
+    bool isLocal() const { return !unixPath.empty(); }
+};
+
+// Single-threaded epoll server in front of a DeliveryOptimizer. Each wakeup reads every
+// ready connection, optionally waits up to `batchWindowMs` for more requests (until
+// `maxBatch` are buffered), then runs everything buffered as one batch:
+// appointment rows go in through one bulk insert, consecutive dispatches share one
+// dispatch pass, route queries are answered together, and the log is flushed once
+// before any reply of the batch is sent.
+class DeliveryServer {
+private:
+    enum RequestType {
+        REQUEST_PING,
+        REQUEST_APPOINTMENT,
+        REQUEST_COURIER,
+        REQUEST_DISPATCH,
+        REQUEST_ROUTE,
+        REQUEST_RELEASE,
+        REQUEST_INVALID
+    };
+    
+    struct Connection {
+        int fd;
+        string input;       // received bytes not yet handled
+        string output;      // replies not yet written
+        size_t sent;        // bytes of output already written
+        int lines;          // complete requests buffered in input
+        bool closing;       // peer finished sending; closed once its replies are out
+        bool dead;          // failed; closed at the end of the wakeup
+        bool writing;       // waiting for EPOLLOUT
+        bool paused;        // not reading until unsent output drops under OUTPUT_LIMIT
+        bool retiring;      // already listed in `retiring`
+        
+        explicit Connection(int socket) : fd(socket), sent(0), lines(0), closing(false), dead(false),
+                                          writing(false), paused(false), retiring(false) {}
+    };
+    
+    // A parsed request and, once its batch has run, the values for its reply
+    struct Request {
+        Connection* connection;
+        RequestType type;
+        string_view fields[6];
+        int fieldCount;
+        const char* error;      // REQUEST_INVALID: reason
+        int id;                 // new appointment or courier
+        int route;              // index into routes
+        DispatchResult dispatch;
+    };
+    
+    static constexpr int EVENT_BATCH = 256;
+    static constexpr size_t READ_CHUNK = 64 * 1024;
+    static constexpr size_t READ_LIMIT = 1024 * 1024;    // bytes per connection per wakeup
+    static constexpr size_t MAX_LINE = 64 * 1024;
+    static constexpr size_t OUTPUT_LIMIT = 4 * 1024 * 1024;   // unsent reply bytes before reading stops
+    static constexpr int MAX_NAMES = 4096;                      // zone names in the shared name table
+    
+    DeliveryOptimizer& optimizer;
+    SocketAddress address;
+    int listenFd;
+    int epollFd;
+    int batchWindowMs;
+    int maxBatch;
+    unordered_map<int, unique_ptr<Connection>> connections;
+    vector<Connection*> active;       // connections with buffered requests
+    vector<Connection*> retiring;     // closing or dead connections
+    int bufferedLines;
+    unordered_map<string, string> zoneNames;   // raw zone -> normalized, as rows point at it
+    vector<Request> batch;
+    vector<AppointmentRow> rows;
+    vector<RouteQuery> routes;
+    vector<DispatchResult> dispatched;
+    long long requestCount;
+    long long batchCount;
+    int largestBatch;
+    long long connectionCount;
+    long long pauseCount;
+    
+    void watch(Connection* connection) {
+        epoll_event event;
+        event.events = (connection->closing || connection->paused ? 0u : (uint32_t)EPOLLIN) |
+                       (connection->writing ? (uint32_t)EPOLLOUT : 0u);
+        event.data.ptr = connection;
+        if (epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event) != 0) retire(connection, true);
+    }
+    
+    void retire(Connection* connection, bool failed) {
+        if (failed) connection->dead = true;
+        else connection->closing = true;
+        if (!connection->retiring) {
+            connection->retiring = true;
+            retiring.push_back(connection);
+        }
+    }
+    
+    void acceptConnections() {
         while (true) {
-            displayMenu();
-            cin >> choice;
-            
-            switch (choice) {
-                case 1:
-                    addAppointment();
-                    break;
-                case 2:
-                    addCourier();
-                    break;
-                case 3:
-                    appointments.displayAppointments();
-                    break;
-                case 4:
-                    courierQueue.displayCouriers();
-                    break;
-                case 5:
-                    dispatchNextDelivery();
-                    break;
-                case 6:
-                    optimizeMultipleDeliveries();
-                    break;
-                case 7:
-                    routingMatrix.displayMatrix();
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                return;   // EAGAIN, or a transient failure such as EMFILE
+            }
+            if (!address.isLocal()) {
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            unique_ptr<Connection> connection(new Connection(fd));
+            epoll_event event;
+            event.events = EPOLLIN;
+            event.data.ptr = connection.get();
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                close(fd);
+                continue;
+            }
+            connections[fd] = move(connection);
+            connectionCount++;
+        }
+    }
+    
+    void readInput(Connection* connection) {
+        size_t received = 0;
+        while (received < READ_LIMIT) {
+            size_t used = connection->input.size();
+            connection->input.resize(used + READ_CHUNK);
+            ssize_t n = recv(connection->fd, &connection->input[used], READ_CHUNK, 0);
+            connection->input.resize(used + max<ssize_t>(n, 0));
+            if (n > 0) {
+                received += n;
+                int lines = (int)count(connection->input.begin() + used, connection->input.end(), '\n');
+                if (lines > 0 && connection->lines == 0) active.push_back(connection);
+                connection->lines += lines;
+                bufferedLines += lines;
+                if (connection->lines == 0 && connection->input.size() > MAX_LINE) {
+                    retire(connection, true);
+                    return;
+                }
+                continue;
+            }
+            if (n == 0) {
+                retire(connection, false);
+                watch(connection);
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                retire(connection, true);
+            }
+            return;
+        }
+    }
+    
+    void writeOutput(Connection* connection) {
+        while (connection->sent < connection->output.size()) {
+            ssize_t n = send(connection->fd, connection->output.data() + connection->sent,
+                             connection->output.size() - connection->sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                connection->sent += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                // A peer that sends requests without reading its replies stops being read
+                // until it catches up, so its requests wait in the socket buffer instead
+                bool paused = connection->output.size() - connection->sent > OUTPUT_LIMIT;
+                if (paused && !connection->paused) pauseCount++;
+                if (!connection->writing || paused != connection->paused) {
+                    connection->writing = true;
+                    connection->paused = paused;
+                    watch(connection);
+                }
+            } else {
+                retire(connection, true);
+            }
+            return;
+        }
+        connection->output.clear();
+        connection->sent = 0;
+        if (connection->writing) {
+            connection->writing = false;
+            connection->paused = false;
+            watch(connection);
+        }
+    }
+    
+    void handleEvents(const epoll_event* events, int ready) {
+        for (int i = 0; i < ready; i++) {
+            Connection* connection = (Connection*)events[i].data.ptr;
+            if (!connection) {
+                acceptConnections();
+                continue;
+            }
+            if (connection->dead) continue;
+            if (events[i].events & EPOLLERR) {
+                retire(connection, true);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) writeOutput(connection);
+            if (!connection->dead && !connection->closing && !connection->paused &&
+                (events[i].events & (EPOLLIN | EPOLLHUP))) {
+                readInput(connection);
+            }
+        }
+    }
+    
+    void parseRequest(Connection* connection, string_view line, Request& request) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        request.connection = connection;
+        request.type = REQUEST_INVALID;
+        request.error = "unknown request";
+        request.fieldCount = 0;
+        request.id = -1;
+        request.route = -1;
+        
+        string_view verb = line.substr(0, line.find('\t'));
+        size_t start = verb.size() + 1;
+        while (start <= line.size()) {
+            if (request.fieldCount == 6) {
+                request.error = "too many fields";
+                return;
+            }
+            size_t end = min(line.find('\t', start), line.size());
+            request.fields[request.fieldCount++] = line.substr(start, end - start);
+            start = end + 1;
+        }
+        
+        int fields = request.fieldCount;
+        if (verb == "PING") {
+            request.type = REQUEST_PING;
+        } else if (verb == "APPT") {
+            request.type = fields == 5 ? REQUEST_APPOINTMENT : REQUEST_INVALID;
+            request.error = "APPT takes customer, address, time, priority and zone";
+        } else if (verb == "COURIER") {
+            request.type = fields == 2 || fields == 3 ? REQUEST_COURIER : REQUEST_INVALID;
+            request.error = "COURIER takes name, zone and an optional maxLoad";
+        } else if (verb == "DISPATCH") {
+            request.type = REQUEST_DISPATCH;
+        } else if (verb == "ROUTE") {
+            request.type = fields == 2 ? REQUEST_ROUTE : REQUEST_INVALID;
+            request.error = "ROUTE takes two location names";
+        } else if (verb == "RELEASE") {
+            request.type = fields == 1 ? REQUEST_RELEASE : REQUEST_INVALID;
+            request.error = "RELEASE takes a courier ID";
+        }
+    }
+    
+    // Interned names are never freed, so a client can only add zones while the table
+    // has room. Empty once it is full and `zone` is new.
+    string_view zoneName(string_view zone) {
+        if (zone.substr(0, 5) == "Zone-") return admitZone(zone) ? zone : string_view();
+        auto known = zoneNames.find(string(zone));
+        if (known != zoneNames.end()) return known->second;
+        string name = DeliveryOptimizer::normalizeZone(zone);
+        if (!admitZone(name)) return string_view();
+        return zoneNames.emplace(string(zone), move(name)).first->second;
+    }
+    
+    bool admitZone(string_view name) {
+        if (nameTable().find(name) != -1) return true;
+        if (nameTable().size() >= MAX_NAMES) return false;
+        nameTable().intern(name);
+        return true;
+    }
+    
+    void addRows() {
+        if (rows.empty()) return;
+        optimizer.addAppointments(rows);
+        rows.clear();
+    }
+    
+    void execute(Request& request) {
+        switch (request.type) {
+            case REQUEST_APPOINTMENT: {
+                AppointmentRow row;
+                TimeWindow window;
+                if (!RecordReader::parseInt(request.fields[3], row.priority)) {
+                    request.type = REQUEST_INVALID;
+                    request.error = "invalid priority";
+                } else if (!parseTimeWindow(request.fields[2], window)) {
+                    request.type = REQUEST_INVALID;
+                    request.error = "invalid delivery time";
+                } else if (request.fields[4].empty()) {
+                    request.type = REQUEST_INVALID;
+                    request.error = "missing zone";
+                } else if ((row.zone = zoneName(request.fields[4])).empty()) {
+                    request.type = REQUEST_INVALID;
+                    request.error = "too many zones";
+                } else {
+                    row.appointmentId = request.id = optimizer.nextAppointmentId();
+                    row.priority = min(5, max(1, row.priority));
+                    row.customerName = request.fields[0];
+                    row.address = request.fields[1];
+                    row.deliveryTime = request.fields[2];
+                    rows.push_back(row);
+                }
+                break;
+            }
+            case REQUEST_COURIER: {
+                int maxLoad = 5;
+                if ((request.fieldCount == 3 && !RecordReader::parseInt(request.fields[2], maxLoad)) ||
+                    request.fields[1].empty()) {
+                    request.type = REQUEST_INVALID;
+                    request.error = "invalid courier";
                     break;
-                case 8: {
-                    int id;
-                    cout << "Enter appointment ID to remove: ";
-                    cin >> id;
-                    if (appointments.removeAppointment(id)) {
-                        cout << "Appointment removed successfully!\n";
-                    } else {
-                        cout << "Appointment not found!\n";
-                    }
+                }
+                string_view zone = zoneName(request.fields[1]);
+                if (zone.empty()) {
+                    request.type = REQUEST_INVALID;
+                    request.error = "too many zones";
                     break;
                 }
-                case 9:
-                    cout << "Exiting system...\n";
+                request.id = optimizer.registerCourier(string(request.fields[0]), string(zone), maxLoad);
+                if (request.id == -1) {
+                    request.type = REQUEST_INVALID;
+                    request.error = "courier ID taken";
+                }
+                break;
+            }
+            case REQUEST_ROUTE:
+                request.route = (int)routes.size();
+                routes.push_back({request.fields[0], request.fields[1], -1.0, {}});
+                break;
+            case REQUEST_RELEASE:
+                if (!RecordReader::parseInt(request.fields[0], request.id) || !optimizer.releaseCourier(request.id)) {
+                    request.type = REQUEST_INVALID;
+                    request.error = "unknown courier";
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    
+    void formatReply(const Request& request, string& out) {
+        char buffer[64];
+        switch (request.type) {
+            case REQUEST_PING:
+                out += "OK\n";
+                return;
+            case REQUEST_APPOINTMENT:
+            case REQUEST_COURIER:
+            case REQUEST_RELEASE:
+                snprintf(buffer, sizeof(buffer), "OK %d\n", request.id);
+                out += buffer;
+                return;
+            case REQUEST_DISPATCH:
+                if (request.dispatch.courierId == -1) {
+                    out += "NONE\n";
                     return;
-                default:
-                    cout << "Invalid choice! Please try again.\n";
+                }
+                snprintf(buffer, sizeof(buffer), "OK %d %d %.2f\n", request.dispatch.appointmentId,
+                         request.dispatch.courierId, request.dispatch.distance);
+                out += buffer;
+                return;
+            case REQUEST_ROUTE: {
+                const RouteQuery& query = routes[request.route];
+                if (query.path.empty()) {
+                    out += "NONE\n";
+                    return;
+                }
+                snprintf(buffer, sizeof(buffer), "OK %.2f ", query.distance);
+                out += buffer;
+                for (size_t i = 0; i < query.path.size(); i++) {
+                    if (i > 0) out += '>';
+                    out += optimizer.getLocationName(query.path[i]);
+                }
+                out += '\n';
+                return;
+            }
+            case REQUEST_INVALID:
+                out += "ERR ";
+                out += request.error;
+                out += '\n';
+                return;
+        }
+    }
+    
+    // Parse every complete line buffered on every connection and run them as one batch
+    void processBatch() {
+        batch.clear();
+        for (Connection* connection : active) {
+            if (connection->dead) continue;
+            string_view input = connection->input;
+            size_t start = 0;
+            for (size_t end; (end = input.find('\n', start)) != string_view::npos; start = end + 1) {
+                batch.emplace_back();
+                parseRequest(connection, input.substr(start, end - start), batch.back());
+            }
+        }
+        if (batch.empty()) {
+            active.clear();
+            bufferedLines = 0;
+            return;
+        }
+        
+        // In request order, except that route queries (which read only the graph) wait for
+        // the end; a run of dispatches first inserts the appointments that came before it
+        routes.clear();
+        for (size_t i = 0; i < batch.size();) {
+            if (batch[i].type != REQUEST_DISPATCH) {
+                execute(batch[i++]);
+                continue;
+            }
+            size_t end = i;
+            while (end < batch.size() && batch[end].type == REQUEST_DISPATCH) end++;
+            addRows();
+            dispatched.clear();
+            optimizer.dispatchQuietly((int)(end - i), dispatched);
+            for (size_t k = 0; i < end; i++, k++) {
+                batch[i].dispatch = k < dispatched.size() ? dispatched[k] : DispatchResult{-1, -1, -1, -1.0};
+            }
+        }
+        addRows();
+        optimizer.answerRoutes(routes);
+        bool logged = optimizer.flushLog();
+        if (!logged) cerr << "Error: cannot write the log\n";
+        
+        for (Request& request : batch) {
+            if (!logged && request.type != REQUEST_PING && request.type != REQUEST_ROUTE) {
+                request.type = REQUEST_INVALID;
+                request.error = "cannot write the log";
+            }
+            formatReply(request, request.connection->output);
+        }
+        for (Connection* connection : active) {
+            if (connection->dead) continue;
+            connection->input.erase(0, connection->input.rfind('\n') + 1);
+            connection->lines = 0;
+            writeOutput(connection);
+        }
+        
+        requestCount += (long long)batch.size();
+        batchCount++;
+        largestBatch = max(largestBatch, (int)batch.size());
+        active.clear();
+        bufferedLines = 0;
+    }
+    
+    // Close connections that failed, or whose peer is done and whose replies are all out
+    void sweep() {
+        size_t kept = 0;
+        for (Connection* connection : retiring) {
+            if (!connection->dead && (connection->lines > 0 || !connection->output.empty())) {
+                retiring[kept++] = connection;
+                continue;
+            }
+            int fd = connection->fd;
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            connections.erase(fd);
+        }
+        retiring.resize(kept);
+    }
+
+public:
+    DeliveryServer(DeliveryOptimizer& target, int windowMs, int batchLimit)
+        : optimizer(target), listenFd(-1), epollFd(-1), batchWindowMs(max(0, windowMs)),
+          maxBatch(max(1, batchLimit)), bufferedLines(0), requestCount(0), batchCount(0), largestBatch(0),
+          connectionCount(0), pauseCount(0) {}
+    
+    ~DeliveryServer() {
+        for (auto& entry : connections) close(entry.first);
+        if (epollFd != -1) close(epollFd);
+        if (listenFd != -1) close(listenFd);
+        if (address.isLocal()) unlink(address.unixPath.c_str());
+    }
+    
+    DeliveryServer(const DeliveryServer&) = delete;
+    DeliveryServer& operator=(const DeliveryServer&) = delete;
+    
+    // Bind and listen on `where`. A stale Unix socket file at the path is replaced.
+    bool listenOn(const SocketAddress& where, string& error) {
+        address = where;
+        struct stat info;
+        if (address.isLocal() && lstat(address.unixPath.c_str(), &info) == 0) {
+            if (!S_ISSOCK(info.st_mode)) {
+                error = address.unixPath + " exists and is not a socket";
+                address = SocketAddress();
+                return false;
+            }
+            unlink(address.unixPath.c_str());
+        }
+        listenFd = socket(address.storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int on = 1;
+        if (listenFd != -1 && !address.isLocal()) setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (listenFd == -1 || bind(listenFd, (const sockaddr*)&address.storage, address.length) != 0 ||
+            listen(listenFd, SOMAXCONN) != 0) {
+            error = string("cannot listen: ") + strerror(errno);
+            address = SocketAddress();   // no socket file of ours to unlink
+            return false;
+        }
+        
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (epollFd == -1 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) != 0) {
+            error = string("cannot create the event loop: ") + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+    
+    // Serve until SIGINT or SIGTERM
+    bool run(string& error) {
+        epoll_event events[EVENT_BATCH];
+        while (!serverStopRequested) {
+            int ready = epoll_wait(epollFd, events, EVENT_BATCH, -1);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                error = string("epoll_wait: ") + strerror(errno);
+                return false;
+            }
+            handleEvents(events, ready);
+            
+            // Hold a partial batch open for the window so more requests share its work
+            if (batchWindowMs > 0 && bufferedLines > 0 && bufferedLines < maxBatch) {
+                chrono::steady_clock::time_point deadline =
+                    chrono::steady_clock::now() + chrono::milliseconds(batchWindowMs);
+                while (bufferedLines < maxBatch && !serverStopRequested) {
+                    long long left = chrono::duration_cast<chrono::milliseconds>(
+                                         deadline - chrono::steady_clock::now()).count();
+                    if (left <= 0) break;
+                    ready = epoll_wait(epollFd, events, EVENT_BATCH, (int)left);
+                    if (ready > 0) handleEvents(events, ready);
+                }
+            }
+            if (bufferedLines > 0) processBatch();
+            sweep();
+        }
+        return true;
+    }
+    
+    long long getRequestCount() const { return requestCount; }
+    long long getBatchCount() const { return batchCount; }
+    int getLargestBatch() const { return largestBatch; }
+    long long getConnectionCount() const { return connectionCount; }
+    long long getPauseCount() const { return pauseCount; }
+};
+
+// Closed-loop load generator for DeliveryServer. Every connection runs on its own thread
+// and keeps `pipeline` requests in flight, timing each reply from when its request was
+// written. Half the requests are route queries between the built-in locations, a quarter
+// add appointments, and the rest add couriers (1 in 10) or dispatch (3 in 20).
+class LoadGenerator {
+public:
+    struct Result {
+        long long replies;
+        long long ok;
+        long long none;         // dispatch with nothing to do, or no route
+        long long errors;
+        int failedConnections;
+        double wallMs;
+        DeliverySimulation::Distribution latencyMicros;
+        
+        Result() : replies(0), ok(0), none(0), errors(0), failedConnections(0), wallMs(0.0) {}
+    };
+
+private:
+    SocketAddress address;
+    int connectionCount;
+    long long requestCount;
+    int pipeline;
+    unsigned long long seed;
+    
+    static const char* const* locationNames() {
+        static const char* const names[] = {"Zone-A-Center", "Zone-A-East", "Zone-A-West",
+                                            "Zone-B-Center", "Zone-B-North", "Zone-B-South",
+                                            "Zone-C-Center", "Zone-C-East", "Zone-C-West", "Warehouse"};
+        return names;
+    }
+    
+    static void appendRequest(string& out, mt19937_64& random, int connection, long long serial) {
+        const char* const* names = locationNames();
+        char buffer[160];
+        int kind = (int)(random() % 20);
+        if (kind < 10) {
+            snprintf(buffer, sizeof(buffer), "ROUTE\t%s\t%s\n", names[random() % 10], names[random() % 10]);
+        } else if (kind < 15) {
+            int zone = (int)(random() % 3);
+            int start = 8 * 60 + (int)(random() % (11 * 60));
+            snprintf(buffer, sizeof(buffer), "APPT\tCustomer-%d-%lld\t%s\t%02d:%02d-%02d:%02d\t%d\tZone-%c\n",
+                     connection, serial, names[zone * 3 + (int)(random() % 3)], start / 60, start % 60,
+                     (start + 60) / 60, (start + 60) % 60, 1 + (int)(random() % 5), 'A' + zone);
+        } else if (kind < 17) {
+            snprintf(buffer, sizeof(buffer), "COURIER\tCourier-%d-%lld\tZone-%c\n", connection, serial,
+                     'A' + (int)(random() % 3));
+        } else {
+            snprintf(buffer, sizeof(buffer), "DISPATCH\n");
+        }
+        out += buffer;
+    }
+    
+    // One connection's share of the requests; false if it could not finish
+    bool runConnection(int connection, long long quota, Result& result) {
+        int fd = socket(address.storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1 || connect(fd, (const sockaddr*)&address.storage, address.length) != 0) {
+            if (fd != -1) close(fd);
+            return false;
+        }
+        if (!address.isLocal()) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        
+        mt19937_64 random(seed + connection);
+        deque<chrono::steady_clock::time_point> inFlight;
+        string out;
+        string partial;
+        vector<char> buffer(64 * 1024);
+        long long sent = 0, received = 0;
+        bool healthy = true;
+        while (received < quota && healthy) {
+            out.clear();
+            while (sent < quota && sent - received < pipeline) appendRequest(out, random, connection, sent++);
+            chrono::steady_clock::time_point written = chrono::steady_clock::now();
+            for (size_t offset = 0; offset < out.size() && healthy;) {
+                ssize_t n = send(fd, out.data() + offset, out.size() - offset, MSG_NOSIGNAL);
+                if (n > 0) offset += n;
+                else healthy = n < 0 && errno == EINTR;
+            }
+            inFlight.insert(inFlight.end(), sent - received - inFlight.size(), written);
+            if (!healthy) break;
+            
+            ssize_t n = recv(fd, buffer.data(), buffer.size(), 0);
+            if (n <= 0) {
+                healthy = n < 0 && errno == EINTR;
+                continue;
+            }
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            partial.append(buffer.data(), n);
+            size_t start = 0;
+            for (size_t end; (end = partial.find('\n', start)) != string::npos; start = end + 1) {
+                result.latencyMicros.record(
+                    (uint64_t)chrono::duration_cast<chrono::microseconds>(now - inFlight.front()).count());
+                inFlight.pop_front();
+                if (partial.compare(start, 2, "OK") == 0) result.ok++;
+                else if (partial.compare(start, 4, "NONE") == 0) result.none++;
+                else result.errors++;
+                received++;
             }
+            partial.erase(0, start);
+        }
+        result.replies = received;
+        close(fd);
+        return healthy;
+    }
+
+public:
+    LoadGenerator(const SocketAddress& target, int connections, long long requests, int depth,
+                  unsigned long long randomSeed)
+        : address(target), connectionCount(max(1, connections)), requestCount(max(0LL, requests)),
+          pipeline(max(1, depth)), seed(randomSeed) {}
+    
+    Result run() {
+        vector<Result> shares(connectionCount);
+        vector<char> finished(connectionCount, 0);
+        vector<thread> workers;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int c = 0; c < connectionCount; c++) {
+            long long quota = requestCount / connectionCount + (c < requestCount % connectionCount ? 1 : 0);
+            workers.emplace_back([&, c, quota]() { finished[c] = runConnection(c, quota, shares[c]); });
+        }
+        for (thread& worker : workers) worker.join();
+        
+        Result total;
+        total.wallMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        for (int c = 0; c < connectionCount; c++) {
+            total.replies += shares[c].replies;
+            total.ok += shares[c].ok;
+            total.none += shares[c].none;
+            total.errors += shares[c].errors;
+            total.failedConnections += finished[c] ? 0 : 1;
+            total.latencyMicros.merge(shares[c].latencyMicros);
         }
+        return total;
     }
 };
 
 // ==================== MAIN FUNCTION ====================
 
-int main() {
+struct CommandOptions {
+    string mode;        // batch, bench or load
+    string appointmentsFile;
+    string couriersFile;
+    string locationsFile;
+    string trafficFile;
+    string distanceTableFile;
+    string action;      // dispatch, assign, optimize, due, simulate, serve or none
+    string outputFile;
+    int maxSize;
+    unsigned long long seed;
+    int threads;        // dispatch workers; 0 keeps the sequential dispatcher
+    int producers;
+    int batchSize;      // assign: appointments and couriers per batch; serve: requests per batch
+    int orders;         // simulate: generated orders; -1 generates only without --appointments
+    int fleetSize;      // simulate: generated couriers when none are loaded
+    double speedKmh;    // simulate: courier speed
+    int leadMinutes;    // simulate: how early orders come in
+    string address;     // serve: listen address; load: server address
+    int batchWindowMs;  // serve: how long a partial batch waits for more requests
+    long long requests; // load: requests to send
+    int connections;    // load: client connections, one thread each
+    int pipeline;       // load: requests in flight per connection
+    int routeCacheMb;   // route cache ceiling; 0 disables it
+    string routing;     // dijkstra, ch, astar, alt, bidirectional, regions or fixed
+    string dispatchOrder;   // priority or deadline
+    string now;             // calendar clock as a delivery time; empty for the wall clock
+    int window;             // minutes ahead for the due action
+    string snapshotFile;
+    string logFile;
+    bool checkpoint;        // fold the log into the snapshot after the action
+    bool syncLog;
+    string metricsFormat;   // text or json; empty skips the metrics dump
+    string metricsFile;     // empty for stderr
+    
+    CommandOptions() : action("dispatch"), maxSize(100000), seed(42), threads(0), producers(1),
+                       batchSize(2048), orders(-1), fleetSize(7000), speedKmh(30.0), leadMinutes(120),
+                       address("127.0.0.1:7070"), batchWindowMs(0), requests(100000), connections(4), pipeline(32),
+                       routeCacheMb(16), routing("dijkstra"),
+                       dispatchOrder("priority"), window(60), checkpoint(false), syncLog(false) {}
+};
+
+void printUsage() {
+    cout << "Usage:\n"
+         << "  optimizer                       interactive menu\n"
+         << "  optimizer --batch [options]     headless batch run\n"
+         << "  optimizer --bench [options]     benchmark suite, JSON report\n"
+         << "  optimizer --load [options]      load generator for a running server\n\n"
+         << "Batch options:\n"
+         << "  --appointments FILE   CSV (customer,address,time,priority,zone[,id]) or JSONL\n"
+         << "  --couriers FILE       CSV (name,zone[,maxLoad][,id]) or JSONL\n"
+         << "  --locations FILE      CSV (name,zone,near,distance[,id][,lat,lon]) or JSONL; addresses naming\n"
+         << "                        a location are routed to it instead of their zone's hub\n"
+         << "  --traffic FILE        CSV (from,to,distance) or JSONL road changes, applied after\n"
+         << "                        loading; distance 'closed' closes the road\n"
+         << "  --distance-table FILE all-pairs table over the named locations for the optimize action;\n"
+         << "                        mapped from FILE, or built and saved there if missing or stale\n"
+         << "  --action ACTION       dispatch (default), assign, optimize, due, simulate, serve or none\n"
+         << "  --batch-size N        assign: match up to N appointments with up to N couriers at once,\n"
+         << "                        repeated until nothing more is assigned (default 2048);\n"
+         << "                        serve: stop waiting for more requests once N are buffered\n"
+         << "  --listen ADDR         serve: [HOST:]PORT or unix:PATH (default 127.0.0.1:7070); runs\n"
+         << "                        until SIGINT or SIGTERM\n"
+         << "  --batch-window MS     serve: hold a partial batch up to MS milliseconds (default 0)\n"
+         << "  --orders N            simulate: replay the loaded appointments plus N generated orders\n"
+         << "                        (default 100000 when no appointments file is given, else 0)\n"
+         << "  --fleet N             simulate: generated couriers when none are loaded (default 7000)\n"
+         << "  --speed KMH           simulate: courier speed (default 30)\n"
+         << "  --lead N              simulate: orders come in N minutes before their window (default 120)\n"
+         << "  --route-cache MB      memory ceiling of the shortest-path cache (default 16, 0 disables)\n"
+         << "  --routing BACKEND     backend for point-to-point route queries: dijkstra (default), ch,\n"
+         << "                        astar, alt, bidirectional, regions or fixed (decimetre graph);\n"
+         << "                        built once after loading\n"
+         << "  --output FILE         write results to FILE instead of stdout\n"
+         << "  --threads N           dispatch on N worker threads (lock-free order queue)\n"
+         << "  --producers N         intake threads feeding the workers (default 1)\n"
+         << "  --dispatch-order O    priority (default) or deadline\n"
+         << "  --now TIME            clock for deadlines, e.g. 09:30 or 2024-05-01T09:30 (default: now)\n"
+         << "  --window N            due action: deadlines within N minutes (default 60)\n"
+         << "  Delivery times are HH:MM or HH:MM-HH:MM, optionally after a YYYY-MM-DD date.\n"
+         << "  --snapshot FILE       restore state from FILE at start (if it exists)\n"
+         << "  --wal FILE            replay FILE at start, then log every change to it\n"
+         << "  --checkpoint          after the action, write the snapshot and empty the log\n"
+         << "  --sync                fdatasync the log on every flush\n"
+         << "  --metrics FORMAT      after the run, dump latency percentiles and counters (text or json)\n"
+         << "  --metrics-output FILE write the metrics dump to FILE instead of stderr\n\n"
+         << "Benchmark options:\n"
+         << "  --max-size N          largest workload size, grown from 10 in powers of 10 (default 100000)\n"
+         << "  --seed N              generator seed (default 42)\n"
+         << "  --output FILE         write the JSON report to FILE instead of stdout\n"
+         << "  --metrics FORMAT      also dump hot-path metrics gathered during the run\n\n"
+         << "Load generator options:\n"
+         << "  --connect ADDR        server address, as for --listen (default 127.0.0.1:7070)\n"
+         << "  --requests N          requests to send in total (default 100000)\n"
+         << "  --connections N       client connections, one thread each (default 4)\n"
+         << "  --pipeline N          requests in flight per connection (default 32)\n"
+         << "  --seed N              request mix seed (default 42)\n";
+}
+
+// Dump the hot-path metrics if --metrics was given
+bool writeMetrics(const CommandOptions& options) {
+    if (options.metricsFormat.empty()) return true;
+    MetricsReport report;
+    ofstream file;
+    if (!options.metricsFile.empty()) {
+        file.open(options.metricsFile);
+        if (!file) {
+            cerr << "Error: cannot write " << options.metricsFile << "\n";
+            return false;
+        }
+    }
+    ostream& out = options.metricsFile.empty() ? cerr : file;
+    if (options.metricsFormat == "json") report.writeJSON(out);
+    else report.writeText(out);
+    return true;
+}
+
+// Load the input files, run the requested action and stream its report
+int runBatch(const CommandOptions& options) {
+    ios::sync_with_stdio(false);
+    DeliveryOptimizer optimizer;
+    string error;
+    int loaded = 0, rejected = 0;
+    
+    TimeWindow now;
+    if (options.now.empty()) {
+        now.earliest = currentMinute();
+    } else if (!parseTimeWindow(options.now, now)) {
+        cerr << "Error: invalid --now time '" << options.now << "'\n";
+        return 1;
+    }
+    optimizer.advanceClock(now.earliest);
+    optimizer.setRouteCacheCapacity((size_t)options.routeCacheMb << 20);
+    RoutingBackend backend = ROUTE_DIJKSTRA;
+    parseRoutingBackend(options.routing, backend);
+    optimizer.setRoutingBackend(backend);
+    optimizer.setDispatchPolicy(options.dispatchOrder == "deadline" ? DISPATCH_BY_DEADLINE
+                                                                    : DISPATCH_BY_PRIORITY);
+    
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (!options.snapshotFile.empty() || !options.logFile.empty()) {
+        if (!optimizer.openPersistence(options.snapshotFile, options.logFile, options.syncLog, error)) {
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        cerr << "Restore time: " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count()
+             << " ms\n";
+        start = chrono::steady_clock::now();
+    }
+    if (!options.locationsFile.empty()) {
+        if (!optimizer.loadLocations(options.locationsFile, loaded, rejected, error)) {
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        cerr << "Loaded " << loaded << " locations (" << rejected << " rejected)\n";
+    }
+    if (!options.couriersFile.empty()) {
+        if (!optimizer.loadCouriers(options.couriersFile, loaded, rejected, error)) {
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        cerr << "Loaded " << loaded << " couriers (" << rejected << " rejected)\n";
+    }
+    if (!options.appointmentsFile.empty()) {
+        if (!optimizer.loadAppointments(options.appointmentsFile, loaded, rejected, error)) {
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        cerr << "Loaded " << loaded << " appointments (" << rejected << " rejected)\n";
+    }
+    cerr << "Load time: " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count()
+         << " ms\n";
+    if (!options.trafficFile.empty()) {
+        if (!optimizer.applyTrafficUpdates(options.trafficFile, loaded, rejected, error)) {
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        cerr << "Traffic updates changed " << loaded << " roads (" << rejected << " rejected)\n";
+    }
+    if (backend == ROUTE_CONTRACTION_HIERARCHY || backend == ROUTE_ALT || backend == ROUTE_REGIONS ||
+        backend == ROUTE_FIXED_POINT) {
+        start = chrono::steady_clock::now();
+        optimizer.prepareRouting();
+        cerr << "Prepared " << options.routing << " routing in "
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms\n";
+    }
+    if (!options.distanceTableFile.empty()) {
+        start = chrono::steady_clock::now();
+        bool rebuilt = false;
+        if (!optimizer.useDistanceTable(options.distanceTableFile, rebuilt, error)) {
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        cerr << (rebuilt ? "Built" : "Mapped") << " distance table in "
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms\n";
+    }
+    
+    ofstream output;
+    streambuf* console = cout.rdbuf();
+    if (!options.outputFile.empty()) {
+        output.open(options.outputFile);
+        if (!output) {
+            cerr << "Error: cannot write " << options.outputFile << "\n";
+            return 1;
+        }
+        cout.rdbuf(output.rdbuf());
+    }
+    
+    if (options.action == "dispatch") {
+        int dispatched = options.threads > 0 ? optimizer.dispatchConcurrent(options.threads, options.producers)
+                                             : optimizer.dispatchAll();
+        cerr << "Dispatched " << dispatched << " deliveries\n";
+    } else if (options.action == "assign") {
+        int assigned = 0;
+        for (int batch; (batch = optimizer.dispatchBatch(options.threads, options.batchSize)) > 0;) assigned += batch;
+        cerr << "Assigned " << assigned << " deliveries\n";
+    } else if (options.action == "optimize") {
+        optimizer.optimizeMultipleDeliveries();
+    } else if (options.action == "due") {
+        optimizer.reportDue(options.window);
+    } else if (options.action == "simulate") {
+        int orders = options.orders >= 0 ? options.orders : (options.appointmentsFile.empty() ? 100000 : 0);
+        WorkloadGenerator generator(options.seed);
+        SimulationOptions settings;
+        settings.speedKmh = options.speedKmh;
+        settings.leadMinutes = options.leadMinutes;
+        settings.policy = options.dispatchOrder == "deadline" ? DISPATCH_BY_DEADLINE : DISPATCH_BY_PRIORITY;
+        DeliverySimulation::Result result = optimizer.simulate(generator.appointments(orders, 1), options.fleetSize, settings);
+        cerr << "Simulated " << result.events << " events in " << result.wallMs << " ms\n";
+    } else if (options.action == "serve") {
+        SocketAddress address;
+        DeliveryServer server(optimizer, options.batchWindowMs, options.batchSize);
+        if (!address.parse(options.address, error) || !server.listenOn(address, error)) {
+            cout.rdbuf(console);
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        struct sigaction stop;
+        memset(&stop, 0, sizeof(stop));
+        stop.sa_handler = requestServerStop;   // no SA_RESTART, so epoll_wait wakes up
+        sigaction(SIGINT, &stop, nullptr);
+        sigaction(SIGTERM, &stop, nullptr);
+        cerr << "Listening on " << options.address << "\n";
+        start = chrono::steady_clock::now();
+        if (!server.run(error)) {
+            cout.rdbuf(console);
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        cerr << "Served " << server.getRequestCount() << " requests in " << server.getBatchCount()
+             << " batches (largest " << server.getLargestBatch() << ") over " << server.getConnectionCount()
+             << " connections in " << chrono::duration<double>(chrono::steady_clock::now() - start).count()
+             << " s; reading paused " << server.getPauseCount() << " times for unread replies\n";
+    }
+    
+    cout.flush();
+    cout.rdbuf(console);
+    RouteCacheStats cache = optimizer.getRouteCacheStats();
+    if (cache.hits + cache.misses > 0) {
+        cerr << "Route cache: " << cache.hits << " hits, " << cache.misses << " misses (" << cache.stale
+             << " stale), " << cache.evictions << " evictions, " << cache.entries << " entries in "
+             << cache.bytes / 1024 << " KiB\n";
+    }
+    if (!optimizer.flushLog()) {
+        cerr << "Error: cannot write the log\n";
+        return 1;
+    }
+    if (options.checkpoint) {
+        start = chrono::steady_clock::now();
+        if (!optimizer.checkpoint(error)) {
+            cerr << "Error: " << error << "\n";
+            return 1;
+        }
+        cerr << "Checkpoint time: "
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms\n";
+    }
+    return writeMetrics(options) ? 0 : 1;
+}
+
+// Drive a running server with the built-in request mix; report throughput and latency
+int runLoad(const CommandOptions& options) {
+    SocketAddress address;
+    string error;
+    if (!address.parse(options.address, error)) {
+        cerr << "Error: " << error << "\n";
+        return 1;
+    }
+    LoadGenerator generator(address, options.connections, options.requests, options.pipeline, options.seed);
+    LoadGenerator::Result result = generator.run();
+    const DeliverySimulation::Distribution& latency = result.latencyMicros;
+    cout << "Requests: " << result.replies << " in " << fixed << setprecision(1) << result.wallMs << " ms ("
+         << setprecision(0) << (result.wallMs > 0 ? result.replies / result.wallMs * 1000.0 : 0.0)
+         << " per second) over " << options.connections << " connections, " << options.pipeline
+         << " in flight each\n";
+    cout << "Replies: " << result.ok << " OK, " << result.none << " NONE, " << result.errors << " ERR\n";
+    cout << "Latency (microseconds): mean " << setprecision(1) << latency.mean() << ", p50 " << latency.quantile(0.5)
+         << ", p99 " << latency.quantile(0.99) << ", p999 " << latency.quantile(0.999) << ", max "
+         << latency.maximum << "\n";
+    if (result.failedConnections > 0) {
+        cerr << "Error: " << result.failedConnections << " connections failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+int runBenchmarks(const CommandOptions& options) {
+    BenchmarkSuite suite(options.maxSize, options.seed);
+    suite.run();
+    
+    if (options.outputFile.empty()) {
+        suite.writeJSON(cout);
+        return writeMetrics(options) && suite.checksPassed() ? 0 : 1;
+    }
+    ofstream output(options.outputFile);
+    if (!output) {
+        cerr << "Error: cannot write " << options.outputFile << "\n";
+        return 1;
+    }
+    suite.writeJSON(output);
+    return writeMetrics(options) && suite.checksPassed() ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        CommandOptions options;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--batch" || arg == "--bench" || arg == "--load") {
+                options.mode = arg.substr(2);
+            } else if (arg == "--appointments" && hasValue) {
+                options.appointmentsFile = argv[++i];
+            } else if (arg == "--couriers" && hasValue) {
+                options.couriersFile = argv[++i];
+            } else if (arg == "--locations" && hasValue) {
+                options.locationsFile = argv[++i];
+            } else if (arg == "--traffic" && hasValue) {
+                options.trafficFile = argv[++i];
+            } else if (arg == "--distance-table" && hasValue) {
+                options.distanceTableFile = argv[++i];
+            } else if (arg == "--action" && hasValue) {
+                options.action = argv[++i];
+            } else if (arg == "--output" && hasValue) {
+                options.outputFile = argv[++i];
+            } else if (arg == "--max-size" && hasValue) {
+                options.maxSize = max(10, atoi(argv[++i]));
+            } else if (arg == "--threads" && hasValue) {
+                options.threads = max(0, atoi(argv[++i]));
+            } else if (arg == "--producers" && hasValue) {
+                options.producers = max(1, atoi(argv[++i]));
+            } else if (arg == "--batch-size" && hasValue) {
+                options.batchSize = max(1, atoi(argv[++i]));
+            } else if (arg == "--orders" && hasValue) {
+                options.orders = max(0, atoi(argv[++i]));
+            } else if (arg == "--fleet" && hasValue) {
+                options.fleetSize = max(0, atoi(argv[++i]));
+            } else if (arg == "--speed" && hasValue) {
+                options.speedKmh = max(0.1, atof(argv[++i]));
+            } else if (arg == "--lead" && hasValue) {
+                options.leadMinutes = max(0, atoi(argv[++i]));
+            } else if ((arg == "--listen" || arg == "--connect") && hasValue) {
+                options.address = argv[++i];
+            } else if (arg == "--route-cache" && hasValue) {
+                options.routeCacheMb = max(0, atoi(argv[++i]));
+            } else if (arg == "--routing" && hasValue) {
+                options.routing = argv[++i];
+            } else if (arg == "--batch-window" && hasValue) {
+                options.batchWindowMs = max(0, atoi(argv[++i]));
+            } else if (arg == "--requests" && hasValue) {
+                options.requests = max(0LL, atoll(argv[++i]));
+            } else if (arg == "--connections" && hasValue) {
+                options.connections = max(1, atoi(argv[++i]));
+            } else if (arg == "--pipeline" && hasValue) {
+                options.pipeline = max(1, atoi(argv[++i]));
+            } else if (arg == "--dispatch-order" && hasValue) {
+                options.dispatchOrder = argv[++i];
+            } else if (arg == "--now" && hasValue) {
+                options.now = argv[++i];
+            } else if (arg == "--window" && hasValue) {
+                options.window = max(0, atoi(argv[++i]));
+            } else if (arg == "--snapshot" && hasValue) {
+                options.snapshotFile = argv[++i];
+            } else if (arg == "--wal" && hasValue) {
+                options.logFile = argv[++i];
+            } else if (arg == "--metrics" && hasValue) {
+                options.metricsFormat = argv[++i];
+            } else if (arg == "--metrics-output" && hasValue) {
+                options.metricsFile = argv[++i];
+            } else if (arg == "--checkpoint") {
+                options.checkpoint = true;
+            } else if (arg == "--sync") {
+                options.syncLog = true;
+            } else if (arg == "--seed" && hasValue) {
+                options.seed = strtoull(argv[++i], nullptr, 10);
+            } else {
+                printUsage();
+                return arg == "--help" ? 0 : 1;
+            }
+        }
+        if (!options.metricsFormat.empty() && options.metricsFormat != "text" && options.metricsFormat != "json") {
+            printUsage();
+            return 1;
+        }
+        if (options.mode == "bench") return runBenchmarks(options);
+        if (options.mode == "load") return runLoad(options);
+        RoutingBackend backend;
+        if (options.mode != "batch" ||
+            (options.action != "dispatch" && options.action != "assign" && options.action != "optimize" &&
+             options.action != "due" && options.action != "simulate" && options.action != "serve" &&
+             options.action != "none") ||
+            (options.dispatchOrder != "priority" && options.dispatchOrder != "deadline") ||
+            !parseRoutingBackend(options.routing, backend)) {
+            printUsage();
+            return 1;
+        }
+        return runBatch(options);
+    }
+    
     cout << "========================================\n";
     cout << "  SMART DELIVERY ROUTE OPTIMIZER\n";
     cout << "  with Queue Management System\n";
@@ -720,4 +9339,4 @@ int main() {
     optimizer.run();
     
     return 0;
-}
\ No newline at end of file
+}